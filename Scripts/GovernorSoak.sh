@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+# Surf server under overload with the movement governor off and on (move.Governor, see USurferMovementBudget).
+# Every PhysFalling iteration is made artificially slow (move.SimulatedFallingCostUs) so the server can't hold its
+# tick rate, then the soak runs twice on one server. With the governor the substeps are cut on the server and in
+# the owners' prediction alike: fall_it (falling iterations per frame) should drop, the frame time should come back
+# down after the first reports instead of staying high, corr/min must not go up and the governor level should stay
+# put after the first seconds (gov/min near 0). Its decisions are listed from the server log.
+#
+#   UE_EDITOR=/path/to/UnrealEditor-Cmd Scripts/GovernorSoak.sh [clients] [seconds] [falling cost us] [map]
+set -euo pipefail
+
+CLIENTS=${1:-32}
+SECONDS_PER_RUN=${2:-180}
+FALLING_COST_US=${3:-150}
+MAP=${4:-/Game/FirstPerson/Maps/FirstPersonMap}
+SCRIPTS="$(cd "$(dirname "$0")" && pwd)"
+NAME="governor_$(date +%Y%m%d_%H%M%S)"
+LOGS="$(dirname "$SCRIPTS")/Saved/Soak"
+
+for governor in 0 1; do
+	SERVER_CMDS="move.Governor $governor, move.SimulatedFallingCostUs $FALLING_COST_US" OUT_NAME="${NAME}_$governor" \
+		"$SCRIPTS/SoakTest.sh" 1 "$CLIENTS" "$SECONDS_PER_RUN" "$MAP"
+	echo
+done
+
+echo "Governor decisions:"
+grep -o "Governor level .*" "$LOGS/${NAME}_1/server_0.log" || echo "none"
+
+echo
+echo "Falling iterations per frame, governor off / on:"
+for governor in 0 1; do
+	awk -v g="$governor" '$1 == "server_0" { print "  governor " g ": " $NF }' "$LOGS/${NAME}_$governor/report.txt"
+done
+
+echo
+echo "Frame ms of the first and the last third of the reports, governor off / on (on should come back down):"
+for governor in 0 1; do
+	grep -o "SoakReport .*" "$LOGS/${NAME}_$governor/server_0.log" | tail -n +2 | awk -v g="$governor" '
+		{ for (i = 2; i <= NF; i++) { split($i, kv, "="); if (kv[1] == "frame_avg_ms") frame[NR] = kv[2] } }
+		END {
+			third = int(NR / 3)
+			if (third == 0) { print "  governor " g ": not enough reports"; exit }
+			for (i = 1; i <= third; i++) { first += frame[i]; last += frame[NR - third + i] }
+			printf "  governor %s: %.2f -> %.2f\n", g, first / third, last / third
+		}'
+done
@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+# Server bandwidth with and without the surfer replication policy (move.NetPolicy).
+# Starts a dedicated server and headless bot clients on loopback, once per policy setting,
+# and prints the server's NetReport lines.
+#
+#   UE_EDITOR=/path/to/UnrealEditor-Cmd Scripts/ReplicationBench.sh [clients] [seconds] [map]
+set -euo pipefail
+
+CLIENTS=${1:-64}
+SECONDS_PER_RUN=${2:-60}
+MAP=${3:-/Game/FirstPerson/Maps/FirstPersonMap}
+PORT=${PORT:-7777}
+UE_EDITOR=${UE_EDITOR:?set UE_EDITOR to UnrealEditor-Cmd}
+PROJECT="$(cd "$(dirname "$0")/.." && pwd)/SpeedGam340.uproject"
+LOGS="$(dirname "$PROJECT")/Saved/ReplicationBench"
+mkdir -p "$LOGS"
+
+run() {
+	local policy=$1
+	local pids=()
+	"$UE_EDITOR" "$PROJECT" "$MAP" -server -nullrhi -unattended -nosplash -port="$PORT" \
+		-ExecCmds="move.NetPolicy $policy, move.NetReportInterval 5" -abslog="$LOGS/server_$policy.log" >/dev/null 2>&1 &
+	local server=$!
+	sleep 15
+
+	for i in $(seq 1 "$CLIENTS"); do
+		"$UE_EDITOR" "$PROJECT" "127.0.0.1:$PORT" -game -nullrhi -nosound -unattended -nosplash \
+			-ExecCmds="move.BotStrafe 1" -abslog="$LOGS/client_${policy}_$i.log" >/dev/null 2>&1 &
+		pids+=($!)
+	done
+
+	sleep "$SECONDS_PER_RUN"
+	kill "${pids[@]}" 2>/dev/null || true
+	kill "$server" 2>/dev/null || true
+	wait 2>/dev/null || true
+
+	echo "move.NetPolicy $policy:"
+	grep "NetReport" "$LOGS/server_$policy.log" | tail -n 5
+}
+
+run 0
+run 1
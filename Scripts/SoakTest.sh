@@ -0,0 +1,148 @@
+#!/usr/bin/env bash
+# Capacity soak test: N dedicated servers and M headless bot clients per server on this machine, over loopback.
+# Every server logs a SoakReport line (move.SoakReportInterval), the script samples the RSS and CPU of every
+# process and at the end writes one report with a line per server and the machine totals. CPU is the utime + stime
+# delta from /proc/<pid>/stat over each interval, not the lifetime average ps reports.
+#
+#   UE_EDITOR=/path/to/UnrealEditor-Cmd Scripts/SoakTest.sh [servers] [clients per server] [seconds] [map]
+#
+# INPUT=bot (default) drives the clients with the fixed strafe pattern, INPUT=ghost replays the turns of the
+# recorded best run of the map (move.BotStrafe 2), BOT_GHOST picks another board.
+# SERVER_CMDS adds console commands to every server, OUT_NAME names the output folder.
+set -euo pipefail
+
+SERVERS=${1:-4}
+CLIENTS=${2:-16}
+SECONDS_TOTAL=${3:-600}
+MAP=${4:-/Game/FirstPerson/Maps/FirstPersonMap}
+BASE_PORT=${BASE_PORT:-7777}
+INPUT=${INPUT:-bot}
+BOT_GHOST=${BOT_GHOST:-}
+REPORT_INTERVAL=${REPORT_INTERVAL:-10}
+SERVER_CMDS=${SERVER_CMDS:-}
+UE_EDITOR=${UE_EDITOR:?set UE_EDITOR to UnrealEditor-Cmd}
+PROJECT="$(cd "$(dirname "$0")/.." && pwd)/SpeedGam340.uproject"
+OUT="$(dirname "$PROJECT")/Saved/Soak/${OUT_NAME:-$(date +%Y%m%d_%H%M%S)}"
+mkdir -p "$OUT"
+
+case "$INPUT" in
+	bot) BOT_CMDS="move.BotStrafe 1" ;;
+	ghost) BOT_CMDS="move.BotStrafe 2${BOT_GHOST:+, move.BotGhost $BOT_GHOST}" ;;
+	*) echo "INPUT must be bot or ghost" >&2; exit 1 ;;
+esac
+
+SERVER_PIDS=()
+CLIENT_PIDS=()
+cleanup() {
+	kill "${CLIENT_PIDS[@]}" "${SERVER_PIDS[@]}" 2>/dev/null || true
+	wait 2>/dev/null || true
+}
+trap cleanup EXIT
+
+for s in $(seq 0 $((SERVERS - 1))); do
+	"$UE_EDITOR" "$PROJECT" "$MAP" -server -nullrhi -unattended -nosplash -port=$((BASE_PORT + s)) \
+		-ExecCmds="move.SoakReportInterval $REPORT_INTERVAL${SERVER_CMDS:+, $SERVER_CMDS}" -abslog="$OUT/server_$s.log" >/dev/null 2>&1 &
+	SERVER_PIDS+=($!)
+done
+sleep 20
+
+for s in $(seq 0 $((SERVERS - 1))); do
+	for c in $(seq 1 "$CLIENTS"); do
+		"$UE_EDITOR" "$PROJECT" "127.0.0.1:$((BASE_PORT + s))" -game -nullrhi -nosound -unattended -nosplash \
+			-ExecCmds="$BOT_CMDS" -abslog="$OUT/client_${s}_$c.log" >/dev/null 2>&1 &
+		CLIENT_PIDS+=($!)
+	done
+done
+
+# utime + stime of a process in clock ticks. The command name in the second field can have spaces,
+# so the fields are counted from after its closing parenthesis, where field 3 (state) is the first
+cpu_ticks() {
+	local stat
+	stat=$(cat "/proc/$1/stat" 2>/dev/null) || return 1
+	stat=${stat##*) }
+	set -- $stat
+	echo $(( ${12} + ${13} ))
+}
+
+# RSS in MB now and CPU percent since the last sample of the process, the first sample only sets the baseline
+CLK_TCK=$(getconf CLK_TCK)
+declare -A LAST_TICKS
+sample() {
+	local ticks rss
+	ticks=$(cpu_ticks "$2") || return 0
+	rss=$(awk '/^VmRSS:/ { print $2 }' "/proc/$2/status" 2>/dev/null) || return 0
+	if [ -n "${LAST_TICKS[$2]:-}" ]; then
+		awk -v n="$1" -v rss="$rss" -v ticks="$((ticks - LAST_TICKS[$2]))" -v hz="$CLK_TCK" -v dt="$INTERVAL_S" \
+			'BEGIN { printf "%s\t%.1f\t%.1f\n", n, rss / 1024, (dt > 0 ? ticks / hz / dt * 100 : 0) }' >> "$OUT/processes.tsv"
+	fi
+	LAST_TICKS[$2]=$ticks
+}
+sample_all() {
+	for s in $(seq 0 $((SERVERS - 1))); do
+		sample "server_$s" "${SERVER_PIDS[$s]}"
+	done
+	for pid in "${CLIENT_PIDS[@]}"; do
+		sample client "$pid"
+	done
+}
+
+# Once per report interval
+: > "$OUT/processes.tsv"
+END=$((SECONDS + SECONDS_TOTAL))
+INTERVAL_S=0
+LAST_SAMPLE=$(date +%s.%N)
+sample_all
+while [ "$SECONDS" -lt "$END" ]; do
+	sleep "$REPORT_INTERVAL"
+	NOW=$(date +%s.%N)
+	INTERVAL_S=$(awk -v a="$LAST_SAMPLE" -v b="$NOW" 'BEGIN { print b - a }')
+	LAST_SAMPLE=$NOW
+	sample_all
+done
+cleanup
+trap - EXIT
+
+# Skips the first report of every server, it still has the clients joining in it
+{
+	echo "Soak $(date -Iseconds): $SERVERS servers x $CLIENTS clients, ${SECONDS_TOTAL}s, $MAP, input $INPUT, $(nproc) cores"
+	if [ -n "$SERVER_CMDS" ]; then echo "server commands: $SERVER_CMDS"; fi
+	printf "%-10s %7s %8s %8s %8s %8s %9s %9s %9s %11s %8s %8s %7s %7s %7s\n" \
+		server clients frame_ms frame_max gt_ms gt_max mem_mb rss_mb cpu_pct out_kbs in_kbs corr/min gov_max gov/min fall_it
+	for s in $(seq 0 $((SERVERS - 1))); do
+		grep -o "SoakReport .*" "$OUT/server_$s.log" | tail -n +2 | awk -v n="server_$s" -v interval="$REPORT_INTERVAL" -v procs="$OUT/processes.tsv" '
+			BEGIN {
+				while ((getline line < procs) > 0) {
+					split(line, f, "\t")
+					if (f[1] == n) { rss = f[2] > rss ? f[2] : rss; cpu += f[3]; samples++ }
+				}
+			}
+			{
+				for (i = 2; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] }
+				reports++
+				clients += v["clients"]; frame += v["frame_avg_ms"]; gt += v["gt_avg_ms"]
+				out += v["out_kbs"]; in_ += v["in_kbs"]; corr += v["corrections"]
+				if (v["frame_max_ms"] > frame_max) frame_max = v["frame_max_ms"]
+				if (v["gt_max_ms"] > gt_max) gt_max = v["gt_max_ms"]
+				if (v["mem_peak_mb"] > mem) mem = v["mem_peak_mb"]
+				if (v["governor_max"] > gov) gov = v["governor_max"]
+				gov_changes += v["governor_changes"]; falling += v["falling_iters"]
+			}
+			END {
+				if (reports == 0) { printf "%-10s no SoakReport lines\n", n; exit }
+				printf "%-10s %7.1f %8.2f %8.2f %8.2f %8.2f %9.1f %9.1f %9.1f %11.1f %8.1f %8.1f %7d %7.1f %7.1f\n", n, clients / reports,
+					frame / reports, frame_max, gt / reports, gt_max, mem, rss, samples ? cpu / samples : 0,
+					out / reports, in_ / reports, corr / (reports * interval / 60), gov, gov_changes / (reports * interval / 60),
+					falling / reports
+			}'
+	done
+	awk -F'\t' '
+		$1 == "client" { client_rss += $2; client_cpu += $3; client_samples++ }
+		$1 != "client" { server_rss[$1] = $2 > server_rss[$1] ? $2 : server_rss[$1]; server_cpu += $3; server_samples++ }
+		END {
+			for (s in server_rss) total_server_rss += server_rss[s]
+			printf "servers: %.1f MB RSS peak total, %.1f%% CPU average per server\n", total_server_rss,
+				server_samples ? server_cpu / server_samples : 0
+			printf "bot clients: %.1f MB RSS and %.1f%% CPU average per client (load generators, not part of capacity)\n",
+				client_samples ? client_rss / client_samples : 0, client_samples ? client_cpu / client_samples : 0
+		}' "$OUT/processes.tsv"
+} | tee "$OUT/report.txt"
@@ -3,5 +3,7 @@
 #include "SpeedGam340.h"
 #include "Modules/ModuleManager.h"
 
+DEFINE_LOG_CATEGORY(LogSurfer);
+
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, SpeedGam340, "SpeedGam340" );
  
\ No newline at end of file
@@ -3,3 +3,6 @@
 #pragma once
 
 #include "CoreMinimal.h"
+
+//Log category for the surf gameplay code
+DECLARE_LOG_CATEGORY_EXTERN(LogSurfer, Log, All);
@@ -0,0 +1,389 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "SpeedGam340LagCompensation.h"
+#include "SpeedGam340.h"
+#include "SpeedGam340ProjectileManager.h"
+#include "SpeedGam340ProjectilePool.h"
+#include "Components/CapsuleComponent.h"
+#include "DrawDebugHelpers.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/DamageType.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+
+static TAutoConsoleVariable<float> CVarLagCompMaxRewind(TEXT("weapon.LagCompMaxRewind"), 0.25f, TEXT("Max seconds hitscan shots rewind targets, 0 disables lag compensation\n"), ECVF_Default);
+static TAutoConsoleVariable<int32> CVarDrawHitscan(TEXT("weapon.DrawHitscan"), 0, TEXT("Draw hitscan shots and the rewound capsules they were tested against\n"), ECVF_Cheat);
+
+DECLARE_CYCLE_STAT(TEXT("Lag compensation record"), STAT_LagCompRecord, STATGROUP_SpeedGam340Projectiles);
+DECLARE_CYCLE_STAT(TEXT("Hitscan batch"), STAT_HitscanBatch, STATGROUP_SpeedGam340Projectiles);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Hitscan traces"), STAT_HitscanTraces, STATGROUP_SpeedGam340Projectiles);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Hitscan hits"), STAT_HitscanHits, STATGROUP_SpeedGam340Projectiles);
+
+// Enough for MaxRewind at 120 server frames a second with room to spare
+static constexpr int32 MaxCapsuleSamples = 64;
+// Same push a 3000 u/s projectile gives in ASpeedGam340Projectile::OnHit
+static constexpr float HitscanImpulse = 3000.0f * 100.0f;
+
+// Times a batch of hitscan shots from the first local player view against the same shots fired as projectiles, e.g. "weapon.BenchHitscan 10000"
+static void BenchHitscanForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	USpeedGam340LagCompensation* LagCompensation = World ? World->GetSubsystem<USpeedGam340LagCompensation>() : nullptr;
+	USpeedGam340ProjectileManager* Manager = World ? World->GetSubsystem<USpeedGam340ProjectileManager>() : nullptr;
+	APlayerController* PlayerController = World ? World->GetFirstPlayerController() : nullptr;
+	if (LagCompensation == nullptr || Manager == nullptr || PlayerController == nullptr)
+	{
+		return;
+	}
+
+	const int32 Count = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 10000;
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+	// Spread the shots in a small cone so they don't all hit the exact same cached result
+	TArray<FRotator> Directions;
+	Directions.Reserve(Count);
+	FRandomStream Stream(Count);
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		Directions.Add(Stream.VRandCone(ViewRotation.Vector(), FMath::DegreesToRadians(10.0f)).Rotation());
+	}
+
+	for (const FRotator& Direction : Directions)
+	{
+		LagCompensation->QueueHitscan(PlayerController->GetPawn(), PlayerController, ViewLocation, ViewLocation + Direction.Vector() * 50000.0f, 0.0f, World->GetTimeSeconds());
+	}
+	const double StartTime = FPlatformTime::Seconds();
+	LagCompensation->ResolveHitscans();
+	const double HitscanTime = FPlatformTime::Seconds() - StartTime;
+
+	// The same shots as real projectiles, what the server pays for each one over its whole flight
+	int64 Sweeps = 0;
+	const double ProjectileTime = Manager->TimeShots(ViewLocation + ViewRotation.Vector() * 100.0f, Directions, PlayerController->GetPawn(), 1.0f / 60.0f, Sweeps);
+
+	const double HitscanUs = HitscanTime * 1e6 / Count;
+	const double ProjectileUs = ProjectileTime * 1e6 / Count;
+	UE_LOG(LogSurfer, Display, TEXT("weapon.BenchHitscan %d shots: hitscan %.3f ms, %.0f traces/sec, %.2f us per shot | projectiles %.3f ms, %.0f sweeps/sec, %.1f sweeps and %.2f us per shot | %.1fx cheaper"),
+		Count, HitscanTime * 1000.0, Count / FMath::Max(HitscanTime, 1e-9), HitscanUs,
+		ProjectileTime * 1000.0, Sweeps / FMath::Max(ProjectileTime, 1e-9), double(Sweeps) / Count, ProjectileUs, ProjectileUs / FMath::Max(HitscanUs, 1e-9));
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdBenchHitscan(
+	TEXT("weapon.BenchHitscan"),
+	TEXT("Time a batch of lag compensated hitscan traces against the same shots fired as managed projectiles, optional shot count\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchHitscanForWorld));
+
+static FAutoConsoleCommand CmdTestLagCompensation(
+	TEXT("weapon.TestLagCompensation"),
+	TEXT("Check shot time and rewound capsules against a made up history, logs PASS or FAIL\n"),
+	FConsoleCommandDelegate::CreateLambda([]() { USpeedGam340LagCompensation::RunSelfTest(); }));
+
+double USpeedGam340LagCompensation::GetShotTime(const AController* Controller, double ClientTime) const
+{
+	const UWorld* const World = GetWorld();
+	const double Now = World ? World->GetTimeSeconds() : 0.0;
+
+	// Listen server host and bots see the present
+	if (Controller == nullptr || Controller->IsLocalController() || Controller->PlayerState == nullptr)
+	{
+		return Now;
+	}
+	return ComputeShotTime(Now, ClientTime, Controller->PlayerState->ExactPing, CVarLagCompMaxRewind.GetValueOnGameThread());
+}
+
+double USpeedGam340LagCompensation::ComputeShotTime(double Now, double ClientTime, float PingMs, float MaxRewind)
+{
+	// Never in the future and never older than we rewind, a client can't claim it saw things from further back
+	const double ShotTime = ClientTime - PingMs * 0.5 * 0.001;
+	return FMath::Clamp(ShotTime, Now - FMath::Max(MaxRewind, 0.0f), Now);
+}
+
+bool USpeedGam340LagCompensation::RunSelfTest()
+{
+	bool bPassed = true;
+	auto Check = [&bPassed](bool bCondition, const TCHAR* What)
+	{
+		if (!bCondition)
+		{
+			UE_LOG(LogSurfer, Error, TEXT("weapon.TestLagCompensation FAIL: %s"), What);
+			bPassed = false;
+		}
+	};
+
+	// 100 ms ping, shot 50 ms ago on the client clock: targets were drawn 100 ms back
+	Check(FMath::IsNearlyEqual(ComputeShotTime(20.0, 19.95, 100.0f, 0.25f), 19.9, 1e-6), TEXT("ping correction"));
+	Check(FMath::IsNearlyEqual(ComputeShotTime(20.0, 25.0, 0.0f, 0.25f), 20.0, 1e-6), TEXT("client time in the future"));
+	Check(FMath::IsNearlyEqual(ComputeShotTime(20.0, 10.0, 100.0f, 0.25f), 19.75, 1e-6), TEXT("clamp to max rewind"));
+
+	// One sample every 10 ms moving 100 units each, more than the ring holds so it wraps
+	FSpeedGam340CapsuleHistory History;
+	const int32 NumSamples = MaxCapsuleSamples + 10;
+	for (int32 Index = 0; Index < NumSamples; ++Index)
+	{
+		FSpeedGam340CapsuleSample Sample;
+		Sample.Time = 10.0 + Index * 0.01;
+		Sample.Location = FVector(Index * 100.0f, 0.0f, 0.0f);
+		Sample.Rotation = FQuat::Identity;
+		Sample.HalfHeight = 96.0f;
+		Sample.Radius = 55.0f;
+		PushSample(History, Sample);
+	}
+
+	FSpeedGam340CapsuleSample Rewound;
+	const int32 Known = NumSamples - 20;
+	Check(GetCapsuleAt(History, 10.0 + Known * 0.01, Rewound) && Rewound.Location.Equals(FVector(Known * 100.0f, 0.0f, 0.0f), 0.1f), TEXT("rewind onto a recorded sample"));
+	Check(GetCapsuleAt(History, 10.0 + (Known + 0.25) * 0.01, Rewound) && Rewound.Location.Equals(FVector((Known + 0.25f) * 100.0f, 0.0f, 0.0f), 0.1f), TEXT("rewind between two samples"));
+	Check(GetCapsuleAt(History, 100.0, Rewound) && Rewound.Location.Equals(FVector((NumSamples - 1) * 100.0f, 0.0f, 0.0f), 0.1f), TEXT("newer than the history"));
+	Check(GetCapsuleAt(History, 0.0, Rewound) && Rewound.Location.Equals(FVector((NumSamples - MaxCapsuleSamples) * 100.0f, 0.0f, 0.0f), 0.1f), TEXT("older than the history"));
+
+	UE_LOG(LogSurfer, Display, TEXT("weapon.TestLagCompensation %s"), bPassed ? TEXT("PASS") : TEXT("FAIL"));
+	return bPassed;
+}
+
+TStatId USpeedGam340LagCompensation::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USpeedGam340LagCompensation, STATGROUP_Tickables);
+}
+
+void USpeedGam340LagCompensation::QueueHitscan(AActor* Shooter, AController* Instigator, const FVector& Start, const FVector& End, float Damage, double ShotTime)
+{
+	FSpeedGam340HitscanRequest& Request = PendingShots.AddDefaulted_GetRef();
+	Request.Shooter = Shooter;
+	Request.Instigator = Instigator;
+	Request.Start = Start;
+	Request.End = End;
+	Request.ShotTime = ShotTime;
+	Request.Damage = Damage;
+}
+
+void USpeedGam340LagCompensation::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	UWorld* const World = GetWorld();
+	if (World == nullptr || World->GetNetMode() == NM_Client)
+	{
+		// Real shots go to the server through the weapon's ServerFire, only benchmark shots end up here
+		ResolveHitscans();
+		return;
+	}
+
+	RecordCapsules();
+	ResolveHitscans();
+}
+
+void USpeedGam340LagCompensation::RecordCapsules()
+{
+	SCOPE_CYCLE_COUNTER(STAT_LagCompRecord);
+
+	UWorld* const World = GetWorld();
+	const double Now = World->GetTimeSeconds();
+	const uint64 Frame = GFrameCounter;
+
+	for (TActorIterator<ACharacter> It(World); It; ++It)
+	{
+		ACharacter* Character = *It;
+		const UCapsuleComponent* Capsule = Character->GetCapsuleComponent();
+		if (Capsule == nullptr)
+		{
+			continue;
+		}
+
+		FSpeedGam340CapsuleHistory& History = Histories.FindOrAdd(Character);
+		if (History.Samples.Max() == 0)
+		{
+			History.Samples.Reserve(MaxCapsuleSamples);
+		}
+
+		FSpeedGam340CapsuleSample Sample;
+		Sample.Time = Now;
+		Sample.Location = Capsule->GetComponentLocation();
+		Sample.Rotation = Capsule->GetComponentQuat();
+		Sample.HalfHeight = Capsule->GetScaledCapsuleHalfHeight();
+		Sample.Radius = Capsule->GetScaledCapsuleRadius();
+
+		PushSample(History, Sample);
+		History.LastSeenFrame = Frame;
+	}
+
+	// Drop characters that are gone
+	for (auto It = Histories.CreateIterator(); It; ++It)
+	{
+		if (It.Value().LastSeenFrame != Frame || !It.Key().IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void USpeedGam340LagCompensation::PushSample(FSpeedGam340CapsuleHistory& History, const FSpeedGam340CapsuleSample& Sample)
+{
+	History.Head = (History.Head + 1) % MaxCapsuleSamples;
+	if (History.Samples.Num() < MaxCapsuleSamples)
+	{
+		History.Samples.Add(Sample);
+	}
+	else
+	{
+		History.Samples[History.Head] = Sample;
+	}
+}
+
+bool USpeedGam340LagCompensation::GetCapsuleAt(const FSpeedGam340CapsuleHistory& History, double Time, FSpeedGam340CapsuleSample& OutSample)
+{
+	const int32 NumSamples = History.Samples.Num();
+	if (NumSamples == 0)
+	{
+		return false;
+	}
+
+	// Walk back from the newest sample until we pass Time
+	const FSpeedGam340CapsuleSample* Newer = &History.Samples[History.Head];
+	if (Time >= Newer->Time)
+	{
+		OutSample = *Newer;
+		return true;
+	}
+
+	for (int32 Step = 1; Step < NumSamples; ++Step)
+	{
+		const FSpeedGam340CapsuleSample& Older = History.Samples[(History.Head - Step + NumSamples) % NumSamples];
+		if (Older.Time <= Time)
+		{
+			const float Alpha = static_cast<float>((Time - Older.Time) / FMath::Max(Newer->Time - Older.Time, UE_SMALL_NUMBER));
+			OutSample.Time = Time;
+			OutSample.Location = FMath::Lerp(Older.Location, Newer->Location, Alpha);
+			OutSample.Rotation = FQuat::Slerp(Older.Rotation, Newer->Rotation, Alpha);
+			OutSample.HalfHeight = FMath::Lerp(Older.HalfHeight, Newer->HalfHeight, Alpha);
+			OutSample.Radius = FMath::Lerp(Older.Radius, Newer->Radius, Alpha);
+			return true;
+		}
+		Newer = &Older;
+	}
+
+	// Older than the history goes, use the oldest we have
+	OutSample = *Newer;
+	return true;
+}
+
+bool USpeedGam340LagCompensation::IntersectCapsule(const FVector& Start, const FVector& Dir, float Length, const FSpeedGam340CapsuleSample& Capsule, float& OutDistance)
+{
+	// Closest points between the shot and the capsule's inner segment
+	const FVector Up = Capsule.Rotation.GetUpVector() * FMath::Max(Capsule.HalfHeight - Capsule.Radius, 0.0f);
+	const FVector End = Start + Dir * Length;
+	FVector OnShot;
+	FVector OnAxis;
+	FMath::SegmentDistToSegmentSafe(Start, End, Capsule.Location - Up, Capsule.Location + Up, OnShot, OnAxis);
+
+	const float RadiusSq = FMath::Square(Capsule.Radius);
+	if (FVector::DistSquared(OnShot, OnAxis) > RadiusSq)
+	{
+		return false;
+	}
+
+	// Entry point of the shot into the sphere around the closest axis point
+	const FVector ToCenter = OnAxis - Start;
+	const float Along = ToCenter | Dir;
+	const float PerpSq = ToCenter.SizeSquared() - FMath::Square(Along);
+	OutDistance = FMath::Max(Along - FMath::Sqrt(FMath::Max(RadiusSq - PerpSq, 0.0f)), 0.0f);
+	return OutDistance <= Length;
+}
+
+int32 USpeedGam340LagCompensation::ResolveHitscans()
+{
+	SCOPE_CYCLE_COUNTER(STAT_HitscanBatch);
+
+	UWorld* const World = GetWorld();
+	const int32 NumShots = PendingShots.Num();
+	if (World == nullptr || NumShots == 0)
+	{
+		return 0;
+	}
+
+	const bool bDraw = CVarDrawHitscan.GetValueOnGameThread() != 0;
+
+	// Live capsules are replaced by their rewound copies, so the world trace ignores every tracked character
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(Hitscan), false);
+	for (const TPair<TWeakObjectPtr<ACharacter>, FSpeedGam340CapsuleHistory>& Entry : Histories)
+	{
+		QueryParams.AddIgnoredActor(Entry.Key.Get());
+	}
+
+	for (const FSpeedGam340HitscanRequest& Shot : PendingShots)
+	{
+		FVector Dir;
+		float Length;
+		(Shot.End - Shot.Start).ToDirectionAndLength(Dir, Length);
+
+		FHitResult WorldHit;
+		float HitDistance = Length;
+		if (World->LineTraceSingleByChannel(WorldHit, Shot.Start, Shot.End, ECC_Visibility, QueryParams))
+		{
+			HitDistance = WorldHit.Distance;
+		}
+
+		ACharacter* HitCharacter = nullptr;
+		FSpeedGam340CapsuleSample HitCapsule = {};
+		for (const TPair<TWeakObjectPtr<ACharacter>, FSpeedGam340CapsuleHistory>& Entry : Histories)
+		{
+			ACharacter* Character = Entry.Key.Get();
+			FSpeedGam340CapsuleSample Capsule;
+			if (Character == nullptr || Character == Shot.Shooter.Get() || !GetCapsuleAt(Entry.Value, Shot.ShotTime, Capsule))
+			{
+				continue;
+			}
+
+			float Distance;
+			if (IntersectCapsule(Shot.Start, Dir, HitDistance, Capsule, Distance))
+			{
+				HitDistance = Distance;
+				HitCharacter = Character;
+				HitCapsule = Capsule;
+			}
+		}
+
+		if (HitCharacter != nullptr)
+		{
+			INC_DWORD_STAT(STAT_HitscanHits);
+
+			const FVector HitLocation = Shot.Start + Dir * HitDistance;
+			FHitResult CharacterHit(HitCharacter, HitCharacter->GetCapsuleComponent(), HitLocation, (HitLocation - HitCapsule.Location).GetSafeNormal());
+			CharacterHit.TraceStart = Shot.Start;
+			CharacterHit.TraceEnd = Shot.End;
+			CharacterHit.Distance = HitDistance;
+			if (Shot.Damage > 0.0f)
+			{
+				UGameplayStatics::ApplyPointDamage(HitCharacter, Shot.Damage, Dir, CharacterHit, Shot.Instigator.Get(), Shot.Shooter.Get(), UDamageType::StaticClass());
+			}
+
+			if (bDraw)
+			{
+				DrawDebugCapsule(World, HitCapsule.Location, HitCapsule.HalfHeight, HitCapsule.Radius, HitCapsule.Rotation, FColor::Red, false, 2.0f);
+			}
+		}
+		else if (WorldHit.bBlockingHit)
+		{
+			INC_DWORD_STAT(STAT_HitscanHits);
+
+			// Same as the projectile, only push physics objects
+			UPrimitiveComponent* const OtherComp = WorldHit.GetComponent();
+			if (OtherComp != nullptr && OtherComp->IsSimulatingPhysics() && Shot.Damage > 0.0f)
+			{
+				OtherComp->AddImpulseAtLocation(Dir * HitscanImpulse, WorldHit.ImpactPoint);
+			}
+		}
+
+		if (bDraw)
+		{
+			DrawDebugLine(World, Shot.Start, Shot.Start + Dir * HitDistance, HitCharacter ? FColor::Red : FColor::Green, false, 2.0f);
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_HitscanTraces, NumShots);
+	PendingShots.Reset();
+	return NumShots;
+}
@@ -0,0 +1,93 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SpeedGam340LagCompensation.generated.h"
+
+class ACharacter;
+class AController;
+
+/** Where a character capsule was at one point in server time */
+struct FSpeedGam340CapsuleSample
+{
+	double Time;
+	FVector Location;
+	FQuat Rotation;
+	float HalfHeight;
+	float Radius;
+};
+
+/** Ring buffer of capsule samples for one character */
+struct FSpeedGam340CapsuleHistory
+{
+	TArray<FSpeedGam340CapsuleSample> Samples;
+	/** Index of the newest sample */
+	int32 Head = INDEX_NONE;
+	/** Last frame this character was seen, histories of gone characters are dropped */
+	uint64 LastSeenFrame = 0;
+};
+
+/** A hitscan shot waiting for the end of frame batch */
+struct FSpeedGam340HitscanRequest
+{
+	TWeakObjectPtr<AActor> Shooter;
+	TWeakObjectPtr<AController> Instigator;
+	FVector Start;
+	FVector End;
+	/** Server time the shooter saw the targets at */
+	double ShotTime;
+	float Damage;
+};
+
+/**
+ * Records character capsules on the server every frame and resolves hitscan shots against where the shooter saw them.
+ * Shots are queued during the frame and traced together in one batch when the subsystem ticks.
+ */
+UCLASS()
+class SPEEDGAM340_API USpeedGam340LagCompensation : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/** Queues a hitscan shot traced against the capsules as they were at ShotTime, see GetShotTime */
+	void QueueHitscan(AActor* Shooter, AController* Instigator, const FVector& Start, const FVector& End, float Damage, double ShotTime);
+
+	/** Traces every queued shot, returns how many were resolved */
+	int32 ResolveHitscans();
+
+	/**
+	 * Server time a shot from this controller is traced at. ClientTime is the server clock as the client had it when it fired,
+	 * the targets it drew were half a round trip older than that. Clamped to the recorded history.
+	 */
+	double GetShotTime(const AController* Controller, double ClientTime) const;
+
+	/** GetShotTime without the world, ping in milliseconds */
+	static double ComputeShotTime(double Now, double ClientTime, float PingMs, float MaxRewind);
+
+	/** Checks rewinding against a made up history with known samples, see weapon.TestLagCompensation */
+	static bool RunSelfTest();
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+private:
+	void RecordCapsules();
+
+	/** Adds the newest sample to the ring buffer */
+	static void PushSample(FSpeedGam340CapsuleHistory& History, const FSpeedGam340CapsuleSample& Sample);
+
+	/** Capsule of a history at Time, interpolated between the two samples around it */
+	static bool GetCapsuleAt(const FSpeedGam340CapsuleHistory& History, double Time, FSpeedGam340CapsuleSample& OutSample);
+
+	/** Distance along the shot to the first capsule hit, or false if it misses */
+	static bool IntersectCapsule(const FVector& Start, const FVector& Dir, float Length, const FSpeedGam340CapsuleSample& Capsule, float& OutDistance);
+
+	/** Keyed by character so recording is one lookup per character instead of a search through every history */
+	TMap<TWeakObjectPtr<ACharacter>, FSpeedGam340CapsuleHistory> Histories;
+
+	TArray<FSpeedGam340HitscanRequest> PendingShots;
+};
@@ -3,6 +3,9 @@
 #include "SpeedGam340Projectile.h"
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Components/SphereComponent.h"
+#include "Engine/World.h"
+#include "SpeedGam340ProjectilePool.h"
+#include "TimerManager.h"
 
 ASpeedGam340Projectile::ASpeedGam340Projectile() 
 {
@@ -29,6 +32,8 @@ ASpeedGam340Projectile::ASpeedGam340Projectile()
 
 	// Die after 3 seconds by default
 	InitialLifeSpan = 3.0f;
+
+	bCosmetic = false;
 }
 
 void ASpeedGam340Projectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
@@ -36,8 +41,92 @@ void ASpeedGam340Projectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherAc
 	// Only add impulse and destroy projectile if we hit a physics
 	if ((OtherActor != nullptr) && (OtherActor != this) && (OtherComp != nullptr) && OtherComp->IsSimulatingPhysics())
 	{
-		OtherComp->AddImpulseAtLocation(GetVelocity() * 100.0f, GetActorLocation());
+		// Predicted copies are spawned locally and so have authority over themselves, they still leave the push to the server
+		if (!bCosmetic && HasAuthority())
+		{
+			OtherComp->AddImpulseAtLocation(GetVelocity() * 100.0f, GetActorLocation());
+		}
+
+		ReturnToPool();
+	}
+}
+
+void ASpeedGam340Projectile::InitPooled(USpeedGam340ProjectilePool* InPool)
+{
+	Pool = InPool;
+
+	// The pool decides when this projectile dies, keep the default as the lifetime of each launch
+	PooledLifeSpan = InitialLifeSpan;
+	SetLifeSpan(0.f);
+
+	Deactivate();
+}
+
+bool ASpeedGam340Projectile::LaunchFromPool(const FVector& Location, const FRotator& Rotation)
+{
+	// Same rule as spawning with AdjustIfPossibleButDontSpawnIfColliding: pushed out of walls, or not fired at all
+	SetActorEnableCollision(true);
+	FVector LaunchLocation = Location;
+	if (!GetWorld()->FindTeleportSpot(this, LaunchLocation, Rotation))
+	{
+		SetActorEnableCollision(false);
+		return false;
+	}
+
+	SetActorLocationAndRotation(LaunchLocation, Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	SetActorHiddenInGame(false);
 
+	// Same state the movement component has right after spawning
+	ProjectileMovement->SetUpdatedComponent(CollisionComp);
+	ProjectileMovement->Velocity = Rotation.Vector() * ProjectileMovement->InitialSpeed;
+	ProjectileMovement->UpdateComponentVelocity();
+	ProjectileMovement->SetComponentTickEnabled(true);
+
+	if (PooledLifeSpan > 0.f)
+	{
+		GetWorldTimerManager().SetTimer(PooledLifeSpanTimer, this, &ASpeedGam340Projectile::ReturnToPool, PooledLifeSpan, false);
+	}
+	return true;
+}
+
+void ASpeedGam340Projectile::ReturnToPool()
+{
+	if (Pool == nullptr)
+	{
 		Destroy();
+		return;
 	}
+
+	// Already parked, e.g. hit something on the same frame the lifetime ran out
+	if (IsHidden())
+	{
+		return;
+	}
+
+	Deactivate();
+	Pool->Release(this);
+}
+
+void ASpeedGam340Projectile::SetCosmetic(bool bInCosmetic)
+{
+	bCosmetic = bInCosmetic;
+
+	// Pooled projectiles switch between both roles, so always start again from the profile
+	CollisionComp->SetCollisionProfileName("Projectile");
+	if (bCosmetic)
+	{
+		// No physics body and nothing for the local player's movement to run into, it still sweeps and bounces off the world
+		CollisionComp->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+		CollisionComp->SetCollisionResponseToChannel(ECC_Pawn, ECR_Ignore);
+	}
+}
+
+void ASpeedGam340Projectile::Deactivate()
+{
+	GetWorldTimerManager().ClearTimer(PooledLifeSpanTimer);
+
+	ProjectileMovement->StopMovementImmediately();
+	ProjectileMovement->SetComponentTickEnabled(false);
+	SetActorEnableCollision(false);
+	SetActorHiddenInGame(true);
 }
\ No newline at end of file
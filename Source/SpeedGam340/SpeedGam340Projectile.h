@@ -8,6 +8,7 @@
 
 class USphereComponent;
 class UProjectileMovementComponent;
+class USpeedGam340ProjectilePool;
 
 UCLASS(config=Game)
 class ASpeedGam340Projectile : public AActor
@@ -29,9 +30,37 @@ public:
 	UFUNCTION()
 	void OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
 
+	/** Marks this projectile as owned by the pool and parks it */
+	void InitPooled(USpeedGam340ProjectilePool* InPool);
+
+	/** Places a pooled projectile at the muzzle and starts simulating it again. False if it doesn't fit there */
+	bool LaunchFromPool(const FVector& Location, const FRotator& Rotation);
+
+	/** Stops simulating and hands the projectile back to the pool (or destroys it when not pooled) */
+	void ReturnToPool();
+
+	/** A cosmetic projectile is the shooter's prediction: it only queries the world, never blocks pawns and never pushes anything */
+	void SetCosmetic(bool bInCosmetic);
+
 	/** Returns CollisionComp subobject **/
 	USphereComponent* GetCollisionComp() const { return CollisionComp; }
 	/** Returns ProjectileMovement subobject **/
 	UProjectileMovementComponent* GetProjectileMovement() const { return ProjectileMovement; }
+
+private:
+	/** Parks the projectile: hidden, no collision, no movement tick */
+	void Deactivate();
+
+	/** Pool this projectile goes back to, null for regular spawned projectiles */
+	UPROPERTY(Transient)
+	USpeedGam340ProjectilePool* Pool;
+
+	/** InitialLifeSpan is only used by spawned projectiles, pooled ones run this timer instead */
+	FTimerHandle PooledLifeSpanTimer;
+
+	float PooledLifeSpan;
+
+	/** Set on the shooter's predicted copy, the server's projectile is the one that counts */
+	uint8 bCosmetic : 1;
 };
 
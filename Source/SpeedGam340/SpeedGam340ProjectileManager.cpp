@@ -0,0 +1,449 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "SpeedGam340ProjectileManager.h"
+#include "SpeedGam340.h"
+#include "SpeedGam340Projectile.h"
+#include "SpeedGam340ProjectilePool.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/SphereComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarProjectileManager(TEXT("weapon.ProjectileManager"), 0, TEXT("Simulate projectiles as data in the projectile manager instead of one actor per shot\n"), ECVF_Default);
+
+DECLARE_CYCLE_STAT(TEXT("Projectile manager simulate"), STAT_ProjectileManagerSimulate, STATGROUP_SpeedGam340Projectiles);
+DECLARE_CYCLE_STAT(TEXT("Projectile manager visuals"), STAT_ProjectileManagerVisuals, STATGROUP_SpeedGam340Projectiles);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Simulated projectiles"), STAT_ProjectileManagerCount, STATGROUP_SpeedGam340Projectiles);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Drawn projectiles"), STAT_ProjectileManagerDrawn, STATGROUP_SpeedGam340Projectiles);
+
+// e.g. "weapon.BenchProjectiles 2000 300", count and frames are optional
+static void BenchProjectilesForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 Count = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 2000;
+	const int32 Frames = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 300;
+	USpeedGam340ProjectileManager::Benchmark(World, Count, Frames);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdBenchProjectiles(
+	TEXT("weapon.BenchProjectiles"),
+	TEXT("Time bouncing projectiles in the manager against the same number of projectile actors, optional count and frames\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchProjectilesForWorld));
+
+USpeedGam340ProjectileManager::USpeedGam340ProjectileManager()
+{
+	ProjectileMesh = FSoftObjectPath(TEXT("/Game/FPWeapon/Mesh/FirstPersonProjectileMesh.FirstPersonProjectileMesh"));
+	ProjectileMeshScale = 0.1f;
+	VisualCullDistance = 10000.f;
+}
+
+bool USpeedGam340ProjectileManager::IsEnabled()
+{
+	return CVarProjectileManager.GetValueOnGameThread() != 0;
+}
+
+TStatId USpeedGam340ProjectileManager::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USpeedGam340ProjectileManager, STATGROUP_Tickables);
+}
+
+int32 USpeedGam340ProjectileManager::FindOrAddArchetype(TSubclassOf<ASpeedGam340Projectile> ProjectileClass)
+{
+	const int32 Existing = ArchetypeClasses.Find(ProjectileClass.Get());
+	if (Existing != INDEX_NONE)
+	{
+		return Existing;
+	}
+
+	// Same values the actor version would run with, taken from the class defaults
+	const ASpeedGam340Projectile* Defaults = ProjectileClass->GetDefaultObject<ASpeedGam340Projectile>();
+	const UProjectileMovementComponent* Movement = Defaults->GetProjectileMovement();
+	const USphereComponent* Collision = Defaults->GetCollisionComp();
+
+	FSpeedGam340ProjectileArchetype Archetype;
+	Archetype.InitialSpeed = Movement->InitialSpeed;
+	Archetype.MaxSpeed = Movement->MaxSpeed;
+	Archetype.GravityScale = Movement->ProjectileGravityScale;
+	Archetype.Bounciness = Movement->Bounciness;
+	Archetype.Friction = Movement->Friction;
+	Archetype.StopSimulatingThreshold = Movement->BounceVelocityStopSimulatingThreshold;
+	Archetype.bShouldBounce = Movement->bShouldBounce;
+	Archetype.Radius = Collision->GetScaledSphereRadius();
+	Archetype.LifeSpan = Defaults->InitialLifeSpan > 0.f ? Defaults->InitialLifeSpan : 3.f;
+	Archetype.ObjectType = Collision->GetCollisionObjectType();
+	Archetype.ResponseParams.CollisionResponse = Collision->GetCollisionResponseToChannels();
+
+	ArchetypeClasses.Add(ProjectileClass.Get());
+	return Archetypes.Add(Archetype);
+}
+
+void USpeedGam340ProjectileManager::Fire(TSubclassOf<ASpeedGam340Projectile> ProjectileClass, const FVector& Location, const FRotator& Rotation, const AActor* Instigator, bool bVisualOnly)
+{
+	if (ProjectileClass == nullptr)
+	{
+		return;
+	}
+
+	const int32 ArchetypeIndex = FindOrAddArchetype(ProjectileClass);
+	const FSpeedGam340ProjectileArchetype& Archetype = Archetypes[ArchetypeIndex];
+
+	FSpeedGam340SimulatedProjectile& Projectile = Projectiles.AddDefaulted_GetRef();
+	Projectile.Position = Location;
+	Projectile.PendingEnd = Location;
+	Projectile.Velocity = Rotation.Vector() * Archetype.InitialSpeed;
+	Projectile.LifeRemaining = Archetype.LifeSpan;
+	Projectile.InstigatorId = Instigator != nullptr ? Instigator->GetUniqueID() : 0;
+	Projectile.Archetype = static_cast<uint16>(ArchetypeIndex);
+	Projectile.Bounces = 0;
+	Projectile.bResting = false;
+	Projectile.bVisualOnly = bVisualOnly;
+
+	INC_DWORD_STAT(STAT_ProjectileManagerCount);
+}
+
+void USpeedGam340ProjectileManager::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (GetWorld() != nullptr && Projectiles.Num() > 0)
+	{
+		Simulate(DeltaTime, false);
+	}
+
+	UpdateVisuals();
+}
+
+void USpeedGam340ProjectileManager::Simulate(float DeltaTime, bool bSynchronousSweeps)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ProjectileManagerSimulate);
+
+	UWorld* const World = GetWorld();
+	const float GravityZ = World->GetGravityZ();
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ProjectileManagerSweep), false);
+
+	for (int32 Index = Projectiles.Num() - 1; Index >= 0; --Index)
+	{
+		FSpeedGam340SimulatedProjectile& Projectile = Projectiles[Index];
+		const FSpeedGam340ProjectileArchetype& Archetype = Archetypes[Projectile.Archetype];
+
+		// Commit last frame's move once its sweep is back
+		bool bAlive = true;
+		if (!bSynchronousSweeps && World->IsTraceHandleValid(Projectile.Sweep, false))
+		{
+			FTraceDatum SweepResult;
+			if (World->QueryTraceData(Projectile.Sweep, SweepResult))
+			{
+				if (SweepResult.OutHits.Num() > 0 && SweepResult.OutHits[0].bBlockingHit)
+				{
+					bAlive = ResolveSweep(Projectile, Archetype, SweepResult.OutHits[0]);
+				}
+				else
+				{
+					Projectile.Position = Projectile.PendingEnd;
+				}
+			}
+		}
+
+		Projectile.LifeRemaining -= DeltaTime;
+		if (!bAlive || Projectile.LifeRemaining <= 0.f)
+		{
+			Projectiles.RemoveAtSwap(Index, 1, false);
+			DEC_DWORD_STAT(STAT_ProjectileManagerCount);
+			continue;
+		}
+
+		if (Projectile.bResting)
+		{
+			Projectile.Sweep = FTraceHandle();
+			continue;
+		}
+
+		// Integrate and sweep, the shooter never blocks its own projectile
+		Projectile.Velocity.Z += GravityZ * Archetype.GravityScale * DeltaTime;
+		if (Archetype.MaxSpeed > 0.f)
+		{
+			Projectile.Velocity = Projectile.Velocity.GetClampedToMaxSize(Archetype.MaxSpeed);
+		}
+		Projectile.PendingEnd = Projectile.Position + Projectile.Velocity * DeltaTime;
+		QueryParams.ClearIgnoredActors();
+		if (Projectile.InstigatorId != 0)
+		{
+			QueryParams.AddIgnoredActor(Projectile.InstigatorId);
+		}
+
+		if (bSynchronousSweeps)
+		{
+			FHitResult Hit;
+			if (World->SweepSingleByChannel(Hit, Projectile.Position, Projectile.PendingEnd, FQuat::Identity, Archetype.ObjectType, FCollisionShape::MakeSphere(Archetype.Radius), QueryParams, Archetype.ResponseParams))
+			{
+				if (!ResolveSweep(Projectile, Archetype, Hit))
+				{
+					Projectiles.RemoveAtSwap(Index, 1, false);
+					DEC_DWORD_STAT(STAT_ProjectileManagerCount);
+				}
+			}
+			else
+			{
+				Projectile.Position = Projectile.PendingEnd;
+			}
+			continue;
+		}
+
+		// Queued into the shared async batch, resolved next frame
+		Projectile.Sweep = World->AsyncSweepByChannel(
+			EAsyncTraceType::Single,
+			Projectile.Position,
+			Projectile.PendingEnd,
+			FQuat::Identity,
+			Archetype.ObjectType,
+			FCollisionShape::MakeSphere(Archetype.Radius),
+			QueryParams,
+			Archetype.ResponseParams);
+	}
+}
+
+bool USpeedGam340ProjectileManager::ResolveSweep(FSpeedGam340SimulatedProjectile& Projectile, const FSpeedGam340ProjectileArchetype& Archetype, const FHitResult& Hit)
+{
+	Projectile.Position = Hit.Location;
+
+	// Same as ASpeedGam340Projectile::OnHit, push physics objects and die. Visual copies leave the push to the server
+	UPrimitiveComponent* const OtherComp = Hit.GetComponent();
+	if (OtherComp != nullptr && OtherComp->IsSimulatingPhysics())
+	{
+		if (!Projectile.bVisualOnly)
+		{
+			OtherComp->AddImpulseAtLocation(Projectile.Velocity * 100.0f, Projectile.Position);
+		}
+		return false;
+	}
+
+	if (!Archetype.bShouldBounce)
+	{
+		Projectile.Velocity = FVector::ZeroVector;
+		Projectile.bResting = true;
+		return true;
+	}
+
+	// Bounce like UProjectileMovementComponent::ComputeBounceDelta without the angle dependent friction.
+	// Friction only slows the part along the surface, bounciness only scales the part along the normal
+	const float VelocityDotNormal = Projectile.Velocity | Hit.Normal;
+	if (VelocityDotNormal < 0.f)
+	{
+		const FVector Projected = Hit.Normal * VelocityDotNormal;
+		const FVector Tangential = (Projectile.Velocity - Projected) * FMath::Clamp(1.f - Archetype.Friction, 0.f, 1.f);
+		Projectile.Velocity = Tangential - Projected * FMath::Max(Archetype.Bounciness, 0.f);
+	}
+	Projectile.Bounces = static_cast<uint8>(FMath::Min<int32>(Projectile.Bounces + 1, MAX_uint8));
+
+	// Nudge off the surface so the next sweep doesn't start inside it
+	Projectile.Position += Hit.Normal * 0.1f;
+
+	if (Projectile.Velocity.SizeSquared() < FMath::Square(Archetype.StopSimulatingThreshold))
+	{
+		Projectile.Velocity = FVector::ZeroVector;
+		Projectile.bResting = true;
+	}
+	return true;
+}
+
+void USpeedGam340ProjectileManager::Benchmark(UWorld* World, int32 Count, int32 Frames)
+{
+	USpeedGam340ProjectileManager* Manager = World ? World->GetSubsystem<USpeedGam340ProjectileManager>() : nullptr;
+	USpeedGam340ProjectilePool* Pool = World ? World->GetSubsystem<USpeedGam340ProjectilePool>() : nullptr;
+	APlayerController* PlayerController = World ? World->GetFirstPlayerController() : nullptr;
+	if (Manager == nullptr || Pool == nullptr || PlayerController == nullptr)
+	{
+		return;
+	}
+
+	const TSubclassOf<ASpeedGam340Projectile> ProjectileClass = ASpeedGam340Projectile::StaticClass();
+	const float DeltaTime = 1.f / 60.f;
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+	// Same shots for both, spread in a cone in front of the view so they bounce around the level
+	TArray<FRotator> Directions;
+	FRandomStream Stream(Count);
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		Directions.Add(Stream.VRandCone(ViewRotation.Vector(), FMath::DegreesToRadians(30.f)).Rotation());
+	}
+	const FVector Muzzle = ViewLocation + ViewRotation.Vector() * 100.f;
+
+	// Manager, with the projectiles already in flight put aside. Sweeps are synchronous like the actors' so both do the same work
+	TArray<FSpeedGam340SimulatedProjectile> InFlight = MoveTemp(Manager->Projectiles);
+	Manager->Projectiles.Reset();
+	for (const FRotator& Direction : Directions)
+	{
+		Manager->Fire(ProjectileClass, Muzzle, Direction, PlayerController->GetPawn(), false);
+	}
+	int64 ManagerSteps = 0;
+	const double ManagerStart = FPlatformTime::Seconds();
+	for (int32 Frame = 0; Frame < Frames; ++Frame)
+	{
+		ManagerSteps += Manager->Projectiles.Num();
+		Manager->Simulate(DeltaTime, true);
+	}
+	const double ManagerTime = FPlatformTime::Seconds() - ManagerStart;
+	DEC_DWORD_STAT_BY(STAT_ProjectileManagerCount, Manager->Projectiles.Num());
+	Manager->Projectiles = MoveTemp(InFlight);
+
+	// Pooled actors, each movement component ticked by hand
+	TArray<ASpeedGam340Projectile*> Actors;
+	for (const FRotator& Direction : Directions)
+	{
+		if (ASpeedGam340Projectile* Projectile = Pool->Acquire(ProjectileClass, Muzzle, Direction))
+		{
+			Actors.Add(Projectile);
+		}
+	}
+	int64 ActorSteps = 0;
+	const double ActorStart = FPlatformTime::Seconds();
+	for (int32 Frame = 0; Frame < Frames; ++Frame)
+	{
+		for (ASpeedGam340Projectile* Projectile : Actors)
+		{
+			if (!Projectile->IsHidden())
+			{
+				++ActorSteps;
+				Projectile->GetProjectileMovement()->TickComponent(DeltaTime, LEVELTICK_All, nullptr);
+			}
+		}
+	}
+	const double ActorTime = FPlatformTime::Seconds() - ActorStart;
+	for (ASpeedGam340Projectile* Projectile : Actors)
+	{
+		Projectile->ReturnToPool();
+	}
+
+	const double ManagerUs = ManagerTime * 1e6 / FMath::Max<int64>(ManagerSteps, 1);
+	const double ActorUs = ActorTime * 1e6 / FMath::Max<int64>(ActorSteps, 1);
+	UE_LOG(LogSurfer, Display, TEXT("weapon.BenchProjectiles %d projectiles, %d frames: manager %.3f us/step (%.0f steps/sec) | actors %.3f us/step (%.0f steps/sec, %d launched) | %.1fx cheaper"),
+		Count, Frames, ManagerUs, ManagerSteps / FMath::Max(ManagerTime, 1e-9), ActorUs, ActorSteps / FMath::Max(ActorTime, 1e-9), Actors.Num(), ActorUs / FMath::Max(ManagerUs, 1e-9));
+}
+
+double USpeedGam340ProjectileManager::TimeShots(const FVector& Muzzle, const TArray<FRotator>& Directions, const AActor* Instigator, float DeltaTime, int64& OutSweeps)
+{
+	OutSweeps = 0;
+	if (GetWorld() == nullptr)
+	{
+		return 0.0;
+	}
+
+	const TSubclassOf<ASpeedGam340Projectile> ProjectileClass = ASpeedGam340Projectile::StaticClass();
+	TArray<FSpeedGam340SimulatedProjectile> InFlight = MoveTemp(Projectiles);
+	Projectiles.Reset();
+
+	// Firing is part of the cost, then every frame until the last one hits something or runs out of life
+	const double StartTime = FPlatformTime::Seconds();
+	for (const FRotator& Direction : Directions)
+	{
+		Fire(ProjectileClass, Muzzle, Direction, Instigator, false);
+	}
+	const float LifeSpan = Archetypes[FindOrAddArchetype(ProjectileClass)].LifeSpan;
+	const int32 MaxFrames = FMath::CeilToInt(LifeSpan / DeltaTime) + 1;
+	for (int32 Frame = 0; Frame < MaxFrames && Projectiles.Num() > 0; ++Frame)
+	{
+		for (const FSpeedGam340SimulatedProjectile& Projectile : Projectiles)
+		{
+			OutSweeps += Projectile.bResting ? 0 : 1;
+		}
+		Simulate(DeltaTime, true);
+	}
+	const double Elapsed = FPlatformTime::Seconds() - StartTime;
+
+	DEC_DWORD_STAT_BY(STAT_ProjectileManagerCount, Projectiles.Num());
+	Projectiles = MoveTemp(InFlight);
+	return Elapsed;
+}
+
+void USpeedGam340ProjectileManager::UpdateVisuals()
+{
+	SCOPE_CYCLE_COUNTER(STAT_ProjectileManagerVisuals);
+
+	UWorld* const World = GetWorld();
+	if (World == nullptr || World->GetNetMode() == NM_DedicatedServer)
+	{
+		return;
+	}
+
+	// Only projectiles near a local viewer get a mesh instance
+	TArray<FVector, TInlineAllocator<4>> ViewLocations;
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (PlayerController != nullptr && PlayerController->IsLocalController())
+		{
+			FVector ViewLocation;
+			FRotator ViewRotation;
+			PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+			ViewLocations.Add(ViewLocation);
+		}
+	}
+
+	const float CullDistanceSq = FMath::Square(VisualCullDistance);
+	const FVector MeshScale(ProjectileMeshScale);
+	VisualTransforms.Reset();
+	for (const FSpeedGam340SimulatedProjectile& Projectile : Projectiles)
+	{
+		for (const FVector& ViewLocation : ViewLocations)
+		{
+			if (FVector::DistSquared(ViewLocation, Projectile.Position) <= CullDistanceSq)
+			{
+				VisualTransforms.Emplace(Projectile.Velocity.Rotation(), Projectile.Position, MeshScale);
+				break;
+			}
+		}
+	}
+
+	if (Visuals == nullptr)
+	{
+		if (VisualTransforms.Num() == 0)
+		{
+			return;
+		}
+
+		UStaticMesh* Mesh = Cast<UStaticMesh>(ProjectileMesh.TryLoad());
+		if (Mesh == nullptr)
+		{
+			return;
+		}
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.ObjectFlags |= RF_Transient;
+		AActor* VisualsActor = World->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, SpawnParams);
+		Visuals = NewObject<UInstancedStaticMeshComponent>(VisualsActor);
+		Visuals->SetMobility(EComponentMobility::Movable);
+		Visuals->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		Visuals->SetCastShadow(false);
+		Visuals->SetStaticMesh(Mesh);
+		VisualsActor->SetRootComponent(Visuals);
+		Visuals->RegisterComponent();
+	}
+
+	// Grow or shrink from the end only, then rewrite all transforms in one batch
+	const int32 NumInstances = Visuals->GetInstanceCount();
+	if (NumInstances < VisualTransforms.Num())
+	{
+		TArray<FTransform> NewInstances;
+		NewInstances.Init(FTransform::Identity, VisualTransforms.Num() - NumInstances);
+		Visuals->AddInstances(NewInstances, false);
+	}
+	else
+	{
+		for (int32 InstanceIndex = NumInstances - 1; InstanceIndex >= VisualTransforms.Num(); --InstanceIndex)
+		{
+			Visuals->RemoveInstance(InstanceIndex);
+		}
+	}
+
+	if (VisualTransforms.Num() > 0)
+	{
+		Visuals->BatchUpdateInstancesTransforms(0, VisualTransforms, true, true, true);
+	}
+
+	SET_DWORD_STAT(STAT_ProjectileManagerDrawn, VisualTransforms.Num());
+}
@@ -0,0 +1,122 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "WorldCollision.h"
+#include "SpeedGam340ProjectileManager.generated.h"
+
+class ASpeedGam340Projectile;
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
+
+/** Movement values copied once from a projectile class defaults, shared by every projectile of that class */
+struct FSpeedGam340ProjectileArchetype
+{
+	float InitialSpeed;
+	float MaxSpeed;
+	float GravityScale;
+	float Bounciness;
+	float Friction;
+	float StopSimulatingThreshold;
+	float Radius;
+	float LifeSpan;
+	bool bShouldBounce;
+	ECollisionChannel ObjectType;
+	FCollisionResponseParams ResponseParams;
+};
+
+/** One projectile in flight. Kept small and flat so the whole set is one contiguous array */
+struct FSpeedGam340SimulatedProjectile
+{
+	FVector Position;
+	FVector Velocity;
+	/** End of the sweep queued last frame, committed once the sweep result comes back */
+	FVector PendingEnd;
+	FTraceHandle Sweep;
+	float LifeRemaining;
+	/** Unique ID of the shooter, its own capsule is ignored by the sweeps */
+	uint32 InstigatorId;
+	uint16 Archetype;
+	uint8 Bounces;
+	/** Came to rest after bouncing, no more sweeps */
+	uint8 bResting : 1;
+	/** Replicated or predicted copy of a server projectile, only drawn. Hits don't push anything */
+	uint8 bVisualOnly : 1;
+};
+
+/**
+ * Simulates projectiles as plain data instead of one actor with its own movement and sphere component each.
+ * All sweeps of a frame are queued in the async trace batch and resolved the next frame.
+ * Visuals are one instanced mesh, and only on machines with a local viewer (never on a dedicated server).
+ */
+UCLASS(config=Game)
+class SPEEDGAM340_API USpeedGam340ProjectileManager : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	USpeedGam340ProjectileManager();
+
+	/**
+	 * Adds a projectile using the movement and collision settings of ProjectileClass.
+	 * Only the server fires real projectiles, clients fire visual only copies of the ones the server told them about.
+	 */
+	void Fire(TSubclassOf<ASpeedGam340Projectile> ProjectileClass, const FVector& Location, const FRotator& Rotation, const AActor* Instigator, bool bVisualOnly);
+
+	/** Returns true if weapons should fire through the manager instead of projectile actors */
+	static bool IsEnabled();
+
+	int32 GetNumProjectiles() const { return Projectiles.Num(); }
+
+	/** Times the manager against projectile actors ticking their own movement, see weapon.BenchProjectiles */
+	static void Benchmark(UWorld* World, int32 Count, int32 Frames);
+
+	/**
+	 * Server cost of real projectiles fired along Directions and simulated until every one is gone, in seconds.
+	 * Projectiles already in flight are put aside meanwhile. OutSweeps is the number of sweeps it took, see weapon.BenchHitscan
+	 */
+	double TimeShots(const FVector& Muzzle, const TArray<FRotator>& Directions, const AActor* Instigator, float DeltaTime, int64& OutSweeps);
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	/** Mesh drawn for every projectile */
+	UPROPERTY(config)
+	FSoftObjectPath ProjectileMesh;
+
+	/** Scale of the projectile mesh instances */
+	UPROPERTY(config)
+	float ProjectileMeshScale;
+
+	/** Projectiles further than this from the local view are not drawn */
+	UPROPERTY(config)
+	float VisualCullDistance;
+
+private:
+	int32 FindOrAddArchetype(TSubclassOf<ASpeedGam340Projectile> ProjectileClass);
+
+	/** Moves every projectile one step. Synchronous sweeps resolve in place, otherwise they go into the async batch for next frame */
+	void Simulate(float DeltaTime, bool bSynchronousSweeps);
+
+	/** Applies the result of last frame's sweep, returns false if the projectile is gone */
+	bool ResolveSweep(FSpeedGam340SimulatedProjectile& Projectile, const FSpeedGam340ProjectileArchetype& Archetype, const FHitResult& Hit);
+
+	void UpdateVisuals();
+
+	TArray<FSpeedGam340ProjectileArchetype> Archetypes;
+
+	UPROPERTY()
+	TArray<UClass*> ArchetypeClasses;
+
+	TArray<FSpeedGam340SimulatedProjectile> Projectiles;
+
+	/** Transforms handed to the instanced mesh, kept to avoid reallocating every frame */
+	TArray<FTransform> VisualTransforms;
+
+	UPROPERTY(Transient)
+	UInstancedStaticMeshComponent* Visuals;
+};
@@ -0,0 +1,118 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "SpeedGam340ProjectilePool.h"
+#include "SpeedGam340Projectile.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarProjectilePool(TEXT("weapon.ProjectilePool"), 1, TEXT("Reuse pooled projectiles instead of spawning one actor per shot\n"), ECVF_Default);
+
+DECLARE_CYCLE_STAT(TEXT("Pooled projectile acquire"), STAT_ProjectilePoolAcquire, STATGROUP_SpeedGam340Projectiles);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pooled projectiles"), STAT_ProjectilePoolSize, STATGROUP_SpeedGam340Projectiles);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pooled projectiles in flight"), STAT_ProjectilePoolInUse, STATGROUP_SpeedGam340Projectiles);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Pool misses (spawned)"), STAT_ProjectilePoolMisses, STATGROUP_SpeedGam340Projectiles);
+
+bool USpeedGam340ProjectilePool::IsPoolingEnabled()
+{
+	return CVarProjectilePool.GetValueOnGameThread() != 0;
+}
+
+void USpeedGam340ProjectilePool::Prewarm(TSubclassOf<ASpeedGam340Projectile> ProjectileClass, int32 Count)
+{
+	if (ProjectileClass == nullptr)
+	{
+		return;
+	}
+
+	FSpeedGam340ProjectileBucket& Bucket = Buckets.FindOrAdd(ProjectileClass);
+	Bucket.Free.Reserve(Count);
+	while (Bucket.NumPooled < Count)
+	{
+		ASpeedGam340Projectile* Projectile = SpawnPooled(ProjectileClass);
+		if (Projectile == nullptr)
+		{
+			return;
+		}
+		Bucket.Free.Add(Projectile);
+	}
+}
+
+ASpeedGam340Projectile* USpeedGam340ProjectilePool::Acquire(TSubclassOf<ASpeedGam340Projectile> ProjectileClass, const FVector& Location, const FRotator& Rotation)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ProjectilePoolAcquire);
+
+	if (ProjectileClass == nullptr)
+	{
+		return nullptr;
+	}
+
+	ASpeedGam340Projectile* Projectile = nullptr;
+	FSpeedGam340ProjectileBucket& Bucket = Buckets.FindOrAdd(ProjectileClass);
+	while (Projectile == nullptr && Bucket.Free.Num() > 0)
+	{
+		// Projectiles can be destroyed behind our back (level change, kill volume), skip those
+		ASpeedGam340Projectile* Candidate = Bucket.Free.Pop(false);
+		if (IsValid(Candidate))
+		{
+			Projectile = Candidate;
+		}
+		else
+		{
+			--Bucket.NumPooled;
+			DEC_DWORD_STAT(STAT_ProjectilePoolSize);
+		}
+	}
+
+	if (Projectile == nullptr)
+	{
+		INC_DWORD_STAT(STAT_ProjectilePoolMisses);
+		Projectile = SpawnPooled(ProjectileClass);
+		if (Projectile == nullptr)
+		{
+			return nullptr;
+		}
+	}
+
+	if (!Projectile->LaunchFromPool(Location, Rotation))
+	{
+		// No room at the muzzle, same as a spawn that would collide. Stays parked
+		Buckets.FindOrAdd(ProjectileClass).Free.Add(Projectile);
+		return nullptr;
+	}
+
+	INC_DWORD_STAT(STAT_ProjectilePoolInUse);
+	return Projectile;
+}
+
+void USpeedGam340ProjectilePool::Release(ASpeedGam340Projectile* Projectile)
+{
+	if (!IsValid(Projectile))
+	{
+		return;
+	}
+
+	DEC_DWORD_STAT(STAT_ProjectilePoolInUse);
+	Buckets.FindOrAdd(Projectile->GetClass()).Free.Add(Projectile);
+}
+
+ASpeedGam340Projectile* USpeedGam340ProjectilePool::SpawnPooled(TSubclassOf<ASpeedGam340Projectile> ProjectileClass)
+{
+	UWorld* const World = GetWorld();
+	if (World == nullptr)
+	{
+		return nullptr;
+	}
+
+	FActorSpawnParameters ActorSpawnParams;
+	ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	// Spawned out of the way, it is placed when launched
+	ASpeedGam340Projectile* Projectile = World->SpawnActor<ASpeedGam340Projectile>(ProjectileClass, FVector::ZeroVector, FRotator::ZeroRotator, ActorSpawnParams);
+	if (Projectile != nullptr)
+	{
+		INC_DWORD_STAT(STAT_ProjectilePoolSize);
+		++Buckets.FindOrAdd(ProjectileClass).NumPooled;
+		Projectile->InitPooled(this);
+	}
+	return Projectile;
+}
@@ -0,0 +1,53 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SpeedGam340ProjectilePool.generated.h"
+
+class ASpeedGam340Projectile;
+
+DECLARE_STATS_GROUP(TEXT("Projectiles"), STATGROUP_SpeedGam340Projectiles, STATCAT_Advanced);
+
+/** Projectiles of one class */
+USTRUCT()
+struct FSpeedGam340ProjectileBucket
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<ASpeedGam340Projectile*> Free;
+
+	/** Every projectile of this class owned by the pool, free or in flight */
+	int32 NumPooled = 0;
+};
+
+/**
+ * Keeps fired projectiles around instead of spawning and destroying an actor per shot.
+ * Projectiles are handed out with Acquire and come back through Release when they hit or their lifetime runs out.
+ */
+UCLASS()
+class SPEEDGAM340_API USpeedGam340ProjectilePool : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/** Makes sure the pool owns at least Count projectiles of this class, counting the ones in flight */
+	void Prewarm(TSubclassOf<ASpeedGam340Projectile> ProjectileClass, int32 Count);
+
+	/** Takes a projectile out of the pool (spawning one if the pool is empty) and launches it. Null if the muzzle is inside a wall */
+	ASpeedGam340Projectile* Acquire(TSubclassOf<ASpeedGam340Projectile> ProjectileClass, const FVector& Location, const FRotator& Rotation);
+
+	/** Puts a projectile back, it is hidden and stops simulating */
+	void Release(ASpeedGam340Projectile* Projectile);
+
+	/** Returns true if pooled projectiles should be used instead of SpawnActor */
+	static bool IsPoolingEnabled();
+
+private:
+	ASpeedGam340Projectile* SpawnPooled(TSubclassOf<ASpeedGam340Projectile> ProjectileClass);
+
+	UPROPERTY()
+	TMap<UClass*, FSpeedGam340ProjectileBucket> Buckets;
+};
@@ -0,0 +1,55 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferCameraRollModifier.h"
+
+#include "Camera/CameraTypes.h"
+#include "Camera/PlayerCameraManager.h"
+#include "GameFramework/PlayerController.h"
+
+#include "SurferCharacter.h"
+#include "SurferMovementComponent.h"
+
+bool USurferCameraRollModifier::ModifyCamera(float DeltaTime, FMinimalViewInfo& InOutPOV)
+{
+	Super::ModifyCamera(DeltaTime, InOutPOV);
+
+	const ASurferCharacter* Surfer = CameraOwner ? Cast<ASurferCharacter>(CameraOwner->GetViewTarget()) : nullptr;
+	const USurferMovementComponent* Movement = Surfer ? Surfer->GetMovementPtr() : nullptr;
+	if (Movement == nullptr)
+	{
+		return false;
+	}
+
+	//Roll only ever comes from here so the view has none of its own, the right vector is just the yaw
+	if (InOutPOV.Rotation.Yaw != CachedYaw)
+	{
+		CachedYaw = InOutPOV.Rotation.Yaw;
+		float Sin, Cos;
+		FMath::SinCos(&Sin, &Cos, FMath::DegreesToRadians(CachedYaw));
+		CachedRight = FVector(-Sin, Cos, 0.0f);
+	}
+
+	InOutPOV.Rotation.Roll += Movement->CameraBehaviour(CachedRight);
+	return false;
+}
+
+bool USurferCameraRollModifier::ProcessViewRotation(AActor* ViewTarget, float DeltaTime, FRotator& OutViewRotation, FRotator& OutDeltaRot)
+{
+	Super::ProcessViewRotation(ViewTarget, DeltaTime, OutViewRotation, OutDeltaRot);
+
+	ASurferCharacter* Surfer = Cast<ASurferCharacter>(ViewTarget);
+	APlayerController* PlayerController = CameraOwner ? CameraOwner->GetOwningPlayerController() : nullptr;
+	if (Surfer == nullptr || PlayerController == nullptr || Surfer->GetController() != PlayerController)
+	{
+		return false;
+	}
+
+	//The controller already copied its rotation input for this frame, so what the surfer adds (look ignore and input scales included)
+	//is moved into this frame's delta instead of waiting for the next one
+	const FRotator RotationInput = PlayerController->RotationInput;
+	Surfer->ApplyViewInput();
+	OutDeltaRot += PlayerController->RotationInput - RotationInput;
+	PlayerController->RotationInput = RotationInput;
+	return false;
+}
@@ -0,0 +1,27 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Camera/CameraModifier.h"
+#include "SurferCameraRollModifier.generated.h"
+
+/* View roll when strafing (cl_rollangle / cl_rollspeed).
+* Only exists on the local player's camera manager, so it never runs on a server. The roll never touches the control rotation,
+* which is what gets sent to the server with every move.
+* Also where the surfer's view input reaches the controller, once per frame and right after the input was processed.
+*/
+UCLASS()
+class SPEEDGAM340_API USurferCameraRollModifier : public UCameraModifier
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ModifyCamera(float DeltaTime, struct FMinimalViewInfo& InOutPOV) override;
+	virtual bool ProcessViewRotation(class AActor* ViewTarget, float DeltaTime, FRotator& OutViewRotation, FRotator& OutDeltaRot) override;
+
+private:
+	//Right vector is only rebuilt when the yaw changes
+	float CachedYaw = 0.0f;
+	FVector CachedRight = FVector::RightVector;
+};
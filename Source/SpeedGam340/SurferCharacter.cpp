@@ -5,15 +5,32 @@
 
 
 #include "SurferMovementComponent.h"
+#include "SpeedGam340.h"
+#include "SurferCameraRollModifier.h"
+#include "SurferGhost.h"
+#include "SurferLeaderboard.h"
+#include "SurferNetPolicy.h"
 
 #include "Components/CapsuleComponent.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Engine/GameInstance.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
 
 #include "HAL/IConsoleManager.h"
+#include "Net/UnrealNetwork.h"
 
 
 //Small little console that I set up for a small cheating and extra options press '`' to open
 static TAutoConsoleVariable<int32> CVarBunnyhop(TEXT("move.Bunnyhopping"), 0, TEXT("BHOP ON\n"), ECVF_Default);
 static TAutoConsoleVariable<int32> CVarAutoBHop(TEXT("move.Jumping"), 1, TEXT("Holding space makes player jump\n"), ECVF_Default);
+#if !UE_BUILD_SHIPPING
+//Load test bots, an auto strafe is a cheat so they are never in a shipping build
+static TAutoConsoleVariable<int32> CVarBotStrafe(TEXT("move.BotStrafe"), 0, TEXT("Local surfer strafes, turns and hops by itself, for headless load test clients.\n1: fixed strafe pattern, 2: turns of the recorded best run of move.BotGhost\n"), ECVF_Cheat);
+static TAutoConsoleVariable<FString> CVarBotGhost(TEXT("move.BotGhost"), TEXT(""), TEXT("Board whose ghost move.BotStrafe 2 replays, empty for the current map and style\n"), ECVF_Cheat);
+#endif
+static TAutoConsoleVariable<int32> CVarAllowNoClip(TEXT("move.AllowNoClip"), 0, TEXT("Server lets players and spectators use noclip even when the game mode does not allow cheats\n"), ECVF_Cheat);
 
 
 
@@ -49,6 +66,17 @@ ASurferCharacter::ASurferCharacter(const FObjectInitializer& ObjectInitializer)
 
 	LandJumpSpeed = 330.f;
 
+	//Blueprint drives Move/Turn/LookUp unless this is turned on
+	bBindNativeInput = false;
+	AppliedViewInput = FRotator::ZeroRotator;
+#if !UE_BUILD_SHIPPING
+	BotTrackTime = 0.0f;
+	BotTrackCursor = 0;
+	BotTrackYaw = 0.0f;
+	bBotTrackLoaded = false;
+#endif
+	GhostSendOffset = 0;
+
 	//pointer that casts movement component to surfer
 	MovementPointer = Cast<USurferMovementComponent>(ACharacter::GetMovementComponent());
 
@@ -56,16 +84,86 @@ ASurferCharacter::ASurferCharacter(const FObjectInitializer& ObjectInitializer)
 
 }
 
-//No noclip for now
+//Noclip for map testers and spectators, predicted locally and confirmed by the server
 void ASurferCharacter::ToggleNoClip()
 {
+	const bool bNoClip = !MovementPointer->IsNoClip();
+	if (GetLocalRole() == ROLE_Authority)
+	{
+		//Listen server host goes through the same check as everyone else
+		ServerSetNoClip_Implementation(bNoClip);
+		return;
+	}
+	MovementPointer->SetNoClip(bNoClip);
+	ServerSetNoClip(bNoClip);
 } 
 
+//Only with cheats allowed by the game mode (standalone, editor) or when the server turned on move.AllowNoClip
+bool ASurferCharacter::CanUseNoClip() const
+{
+	if (CVarAllowNoClip.GetValueOnGameThread() != 0)
+	{
+		return true;
+	}
+	AGameModeBase* GameMode = GetWorld() ? GetWorld()->GetAuthGameMode() : nullptr;
+	APlayerController* PlayerController = Cast<APlayerController>(GetController());
+	return GameMode && PlayerController && GameMode->AllowCheats(PlayerController);
+}
+
+void ASurferCharacter::ServerSetNoClip_Implementation(bool bNoClip)
+{
+	if (bNoClip && !CanUseNoClip())
+	{
+		if (!IsLocallyControlled())
+		{
+			ClientSetNoClip(false);
+		}
+		return;
+	}
+	MovementPointer->SetNoClip(bNoClip);
+}
+
+void ASurferCharacter::ClientSetNoClip_Implementation(bool bNoClip)
+{
+	MovementPointer->SetNoClip(bNoClip);
+}
+
+void ASurferCharacter::SetSprinting(bool bNewSprinting)
+{
+	if (bIsSprinting != bNewSprinting)
+	{
+		bIsSprinting = bNewSprinting;
+		MovementPointer->UpdateMaxSpeedCache();
+	}
+}
+
+void ASurferCharacter::SetWantsToWalk(bool bNewWantsToWalk)
+{
+	if (bWantsToWalk != bNewWantsToWalk)
+	{
+		bWantsToWalk = bNewWantsToWalk;
+		MovementPointer->UpdateMaxSpeedCache();
+	}
+}
+
+void ASurferCharacter::OnStartCrouch(float HalfHeightAdjust, float ScaledHalfHeightAdjust)
+{
+	Super::OnStartCrouch(HalfHeightAdjust, ScaledHalfHeightAdjust);
+	MovementPointer->UpdateMaxSpeedCache();
+}
+
+void ASurferCharacter::OnEndCrouch(float HalfHeightAdjust, float ScaledHalfHeightAdjust)
+{
+	Super::OnEndCrouch(HalfHeightAdjust, ScaledHalfHeightAdjust);
+	MovementPointer->UpdateMaxSpeedCache();
+}
+
 
 void ASurferCharacter::Move(FVector Direction, float Value)
 {
 	if (!FMath::IsNearlyZero(Value)) {
-
+		//Blueprint hands over a world direction, it goes to the engine as it is (pitch included for noclip).
+		//Only the native bindings go through the input command
 		AddMovementInput(Direction, Value);
 	}
 }
@@ -76,7 +174,8 @@ void ASurferCharacter::Turn(bool bIsPure, float Rate)
 		Rate = Rate * BaseTurnRate * GetWorld()->GetDeltaSeconds();
 	}
 
-	AddControllerYawInput(Rate);
+	//Only added up here, the controller gets the frame's total once in ApplyViewInput
+	PendingInput.YawDelta += Rate;
 }
 
 void ASurferCharacter::LookUp(bool bIsPure, float Rate)
@@ -84,6 +183,287 @@ void ASurferCharacter::LookUp(bool bIsPure, float Rate)
 	if (!bIsPure) {
 		Rate = Rate * BaseLookUpRate * GetWorld()->GetDeltaSeconds();
 	}
+
+	PendingInput.PitchDelta += Rate;
+}
+
+void ASurferCharacter::InputMoveForward(float Value)
+{
+	PendingInput.ForwardMove += Value;
+}
+
+void ASurferCharacter::InputMoveRight(float Value)
+{
+	PendingInput.SideMove += Value;
+}
+
+void ASurferCharacter::InputTurn(float Value)
+{
+	Turn(true, Value);
+}
+
+void ASurferCharacter::InputTurnAtRate(float Value)
+{
+	Turn(false, Value);
+}
+
+void ASurferCharacter::InputLookUp(float Value)
+{
+	LookUp(true, Value);
+}
+
+void ASurferCharacter::InputLookUpAtRate(float Value)
+{
+	LookUp(false, Value);
+}
+
+/// <summary>
+/// Hands the view part of the command to the controller, once per frame from the camera's view rotation update.
+/// Anything added after that (the bot turns during the movement tick) goes out with the next call.
+/// </summary>
+void ASurferCharacter::ApplyViewInput()
+{
+	const float YawDelta = PendingInput.YawDelta - AppliedViewInput.Yaw;
+	const float PitchDelta = PendingInput.PitchDelta - AppliedViewInput.Pitch;
+	if (YawDelta != 0.0f) {
+		AddControllerYawInput(YawDelta);
+	}
+	if (PitchDelta != 0.0f) {
+		AddControllerPitchInput(PitchDelta);
+	}
+	AppliedViewInput = FRotator(PendingInput.PitchDelta, PendingInput.YawDelta, 0.0f);
+}
+
+/// <summary>
+/// Buttons are read from the character state at the end of the frame,
+/// move and view deltas are whatever the bindings added up.
+/// </summary>
+/// <returns></returns>
+FSurferInputCmd ASurferCharacter::ConsumeInputCmd()
+{
+#if !UE_BUILD_SHIPPING
+	if (CVarBotStrafe.GetValueOnGameThread() != 0) {
+		AddBotStrafeInput(GetWorld()->GetDeltaSeconds());
+	}
+#endif
+
+	//Without a camera modifier (or with the bot's turn) the view has not been applied yet
+	ApplyViewInput();
+
+	FSurferInputCmd Cmd = PendingInput;
+	PendingInput.Reset();
+	AppliedViewInput = FRotator::ZeroRotator;
+
+	Cmd.ForwardMove = FMath::Clamp(Cmd.ForwardMove, -1.0f, 1.0f);
+	Cmd.SideMove = FMath::Clamp(Cmd.SideMove, -1.0f, 1.0f);
+	Cmd.Buttons = (bPressedJump ? ESurferInputButtons::Jump : 0)
+		| (bIsSprinting ? ESurferInputButtons::Sprint : 0)
+		| (bWantsToWalk ? ESurferInputButtons::Walk : 0)
+		| (bIsCrouched ? ESurferInputButtons::Crouch : 0);
+	return Cmd;
+}
+
+#if !UE_BUILD_SHIPPING
+/// <summary>
+/// Switches strafe side every second or so with the turn going the same way, holding jump for auto hops.
+/// Every bot gets its own phase so they don't all turn at once.
+/// </summary>
+/// <param name="DeltaTime"></param>
+void ASurferCharacter::AddBotStrafeInput(float DeltaTime)
+{
+	const float Phase = (GetUniqueID() % 97) * 0.37f;
+	const bool bInAir = MovementPointer && MovementPointer->IsFalling();
+
+	//Recorded turns, read once from the ghost file the server saved on this machine
+	if (CVarBotStrafe.GetValueOnGameThread() == 2 && !bBotTrackLoaded && MovementPointer) {
+		bBotTrackLoaded = true;
+		FString Board = CVarBotGhost.GetValueOnGameThread();
+		if (Board.IsEmpty()) {
+			Board = GetRunBoardName();
+		}
+		if (!BotTrack.LoadFromFile(FSurferGhostTrack::GetBoardGhostPath(Board)) || BotTrack.GetDuration() <= 0.0f) {
+			UE_LOG(LogSurfer, Warning, TEXT("No ghost recorded for %s, bot uses the fixed strafe pattern"), *Board);
+			BotTrack.Samples.Empty();
+		}
+		BotTrackTime = BotTrack.Samples.Num() > 0 ? FMath::Fmod(Phase, BotTrack.GetDuration()) : 0.0f;
+		BotTrackCursor = 0;
+		BotTrackYaw = GetControlRotation().Yaw;
+	}
+
+	float Side = FMath::Sin(GetWorld()->GetTimeSeconds() * 2.8f + Phase) >= 0.0f ? 1.0f : -1.0f;
+	float TurnRate = Side * 90.0f * DeltaTime;
+	if (CVarBotStrafe.GetValueOnGameThread() == 2 && BotTrack.Samples.Num() > 0) {
+		BotTrackTime += DeltaTime;
+		if (BotTrackTime >= BotTrack.GetDuration()) {
+			BotTrackTime = 0.0f;
+			BotTrackCursor = 0;
+		}
+		FVector Location;
+		FRotator Rotation;
+		BotTrack.Evaluate(BotTrackTime, BotTrackCursor, Location, Rotation);
+
+		//Turns like the recorded run did and strafes into the turn, where it points doesn't matter
+		TurnRate = FRotator::NormalizeAxis(Rotation.Yaw - BotTrackYaw);
+		BotTrackYaw = Rotation.Yaw;
+		Side = TurnRate >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	PendingInput.ForwardMove = bInAir ? 0.0f : 1.0f;
+	PendingInput.SideMove = Side;
+	Turn(true, TurnRate);
+	if (!bInAir) {
+		Jump();
+	}
+}
+#endif
+
+/// <summary>
+/// Run time comes from the server's run clock of the movement. Zones are only tested on the server,
+/// which puts the run on the leaderboard of the map and movement style.
+/// Runs the move validator flagged are refused, noclip, teleports and respawns already cancelled theirs.
+/// </summary>
+/// <param name="RunTime"></param>
+void ASurferCharacter::RunFinished(double RunTime)
+{
+	const APlayerState* State = GetPlayerState();
+	const FString PlayerName = State ? State->GetPlayerName() : GetName();
+
+	USurferLeaderboardSubsystem* Leaderboards = GetGameInstance() ? GetGameInstance()->GetSubsystem<USurferLeaderboardSubsystem>() : nullptr;
+	if (!HasAuthority() || Leaderboards == nullptr || MovementPointer == nullptr)
+	{
+		UE_LOG(LogSurfer, Log, TEXT("%s finished in %.6f s, %d checkpoints"), *PlayerName, RunTime, RunState.Splits.Num());
+		return;
+	}
+
+	const FString Board = GetRunBoardName();
+	if (RunState.bInvalidated) {
+		UE_LOG(LogSurfer, Warning, TEXT("%s finished %s in %.6f s, not ranked: the move validator flagged the run"), *PlayerName, *Board, RunTime);
+		return;
+	}
+
+	const FString PlayerId = State && State->GetUniqueId().IsValid() ? State->GetUniqueId().ToString() : PlayerName;
+	const uint64 Rank = Leaderboards->SubmitRun(Board, FSurferRunRecord::Make(RunTime, PlayerName, PlayerId));
+	const FSurferLeaderboardStore* Store = Leaderboards->GetBoard(Board);
+
+	if (Rank == 1 && GhostRecording.RunStartTime == RunState.StartTime) {
+		GhostRecording.Record(RunTime, GetActorLocation(), GetBaseAimRotation());
+		GhostRecording.SaveToFile(FSurferGhostTrack::GetBoardGhostPath(Board));
+	}
+	//Rank 0 is a run slower than the player's best, only the best is ranked
+	UE_LOG(LogSurfer, Log, TEXT("%s finished %s in %.6f s, %d checkpoints, rank %llu of %llu%s"),
+		*PlayerName, *Board, RunTime, RunState.Splits.Num(), Rank, Store ? Store->Num() : 0, Rank == 0 ? TEXT(" (not a personal best)") : TEXT(""));
+}
+
+FString ASurferCharacter::GetRunBoardName() const
+{
+	return UWorld::RemovePIEPrefix(GetWorld()->GetMapName()) + TEXT("_") + (MovementPointer ? MovementPointer->GetMovementStyleName() : FString());
+}
+
+//Well under the 64 KB an RPC can take, and few partial bunches each
+constexpr int32 GhostChunkSize = 8 * 1024;
+//The longest track compresses to less than this
+constexpr int32 MaxGhostTransferSize = 2 * 1024 * 1024;
+
+void ASurferCharacter::ServerRequestGhost_Implementation(const FString& Board)
+{
+	//One transfer at a time
+	if (GhostSendOffset < GhostSendBuffer.Num()) {
+		return;
+	}
+
+	const FString BoardName = Board.IsEmpty() ? GetRunBoardName() : Board;
+	FSurferGhostTrack Track;
+	GhostSendBuffer.Reset();
+	GhostSendOffset = 0;
+	//Board names are file names, nothing that leaves the leaderboard folder
+	if (BoardName.Contains(TEXT("..")) || !Track.LoadFromFile(FSurferGhostTrack::GetBoardGhostPath(BoardName)) || Track.Samples.Num() == 0
+		|| !Track.Compress(GhostSendBuffer) || GhostSendBuffer.Num() > MaxGhostTransferSize) {
+		GhostSendBuffer.Reset();
+		ClientGhostChunk(0, TArray<uint8>());
+		return;
+	}
+	SendGhostChunk();
+}
+
+void ASurferCharacter::ServerAckGhostChunk_Implementation()
+{
+	SendGhostChunk();
+}
+
+void ASurferCharacter::SendGhostChunk()
+{
+	if (GhostSendOffset >= GhostSendBuffer.Num()) {
+		return;
+	}
+
+	const int32 Size = FMath::Min(GhostChunkSize, GhostSendBuffer.Num() - GhostSendOffset);
+	ClientGhostChunk(GhostSendBuffer.Num(), TArray<uint8>(GhostSendBuffer.GetData() + GhostSendOffset, Size));
+	GhostSendOffset += Size;
+	if (GhostSendOffset >= GhostSendBuffer.Num()) {
+		GhostSendBuffer.Empty();
+		GhostSendOffset = 0;
+	}
+}
+
+void ASurferCharacter::ClientGhostChunk_Implementation(int32 TotalSize, const TArray<uint8>& Chunk)
+{
+	if (TotalSize <= 0 || TotalSize > MaxGhostTransferSize || GhostReceiveBuffer.Num() + Chunk.Num() > TotalSize) {
+		if (TotalSize <= 0) {
+			UE_LOG(LogSurfer, Warning, TEXT("The server has no ghost for this board"));
+		}
+		GhostReceiveBuffer.Empty();
+		return;
+	}
+
+	GhostReceiveBuffer.Append(Chunk);
+	if (GhostReceiveBuffer.Num() < TotalSize) {
+		ServerAckGhostChunk();
+		return;
+	}
+
+	FSurferGhostTrack Track;
+	if (Track.Decompress(GhostReceiveBuffer) && Track.Samples.Num() > 0) {
+		ASurferGhost::SpawnWithTrack(GetWorld(), MoveTemp(Track));
+	}
+	else {
+		UE_LOG(LogSurfer, Warning, TEXT("Ghost from the server could not be read"));
+	}
+	GhostReceiveBuffer.Empty();
+}
+
+void ASurferCharacter::CancelRun()
+{
+	if (HasAuthority()) {
+		RunState = FSurferRunState();
+	}
+}
+
+void ASurferCharacter::InvalidateRun()
+{
+	if (HasAuthority() && RunState.bRunning) {
+		RunState.bInvalidated = true;
+	}
+}
+
+void ASurferCharacter::PossessedBy(AController* NewController)
+{
+	Super::PossessedBy(NewController);
+	CancelRun();
+}
+
+void ASurferCharacter::TeleportSucceeded(bool bIsATest)
+{
+	Super::TeleportSucceeded(bIsATest);
+	if (!bIsATest) {
+		CancelRun();
+	}
+}
+
+void ASurferCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(ASurferCharacter, RunState, COND_OwnerOnly);
 }
 
 /*bool ASurferCharacter::CanCrouch() const
@@ -108,6 +488,36 @@ void ASurferCharacter::Tick(float DeltaTime)
 		Super::StopJumping();
 	}
 
+	//Ghost of the run, a new start throws the old recording away
+	if (RunState.bRunning && HasAuthority() && MovementPointer) {
+		if (GhostRecording.RunStartTime != RunState.StartTime) {
+			GhostRecording.Reset(RunState.StartTime);
+		}
+		GhostRecording.Record(MovementPointer->GetRunClock() - RunState.StartTime, GetActorLocation(), GetBaseAimRotation());
+	}
+
+}
+
+float ASurferCharacter::GetNetPriority(const FVector& ViewPos, const FVector& ViewDir, AActor* Viewer, AActor* ViewTarget, UActorChannel* InChannel, float Time, bool bLowBandwidth)
+{
+	const float Priority = Super::GetNetPriority(ViewPos, ViewDir, Viewer, ViewTarget, InChannel, Time, bLowBandwidth);
+	//Own pawn is always full priority for its owner
+	if (Viewer == GetController() || ViewTarget == this) {
+		return Priority;
+	}
+	return Priority * USurferNetPolicy::GetViewerPriorityScale(this, ViewPos);
+}
+
+//Only called for locally controlled pawns, so servers never get the modifier
+void ASurferCharacter::PawnClientRestart()
+{
+	Super::PawnClientRestart();
+
+	APlayerController* PlayerController = Cast<APlayerController>(GetController());
+	if (PlayerController && PlayerController->PlayerCameraManager
+		&& !PlayerController->PlayerCameraManager->FindCameraModifierByClass(USurferCameraRollModifier::StaticClass())) {
+		PlayerController->PlayerCameraManager->AddNewCameraModifier(USurferCameraRollModifier::StaticClass());
+	}
 }
 
 // Called to bind functionality to input
@@ -115,6 +525,25 @@ void ASurferCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputCom
 {
 	Super::SetupPlayerInputComponent(PlayerInputComponent);
 
+	PlayerInputComponent->BindAction("NoClip", IE_Pressed, this, &ASurferCharacter::ToggleNoClip);
+
+	if (bBindNativeInput) {
+		PlayerInputComponent->BindAction("Jump", IE_Pressed, this, &ASurferCharacter::Jump);
+		PlayerInputComponent->BindAction("Jump", IE_Released, this, &ASurferCharacter::StopJumping);
+
+		PlayerInputComponent->BindAxis("Move Forward / Backward", this, &ASurferCharacter::InputMoveForward);
+		PlayerInputComponent->BindAxis("Move Right / Left", this, &ASurferCharacter::InputMoveRight);
+		PlayerInputComponent->BindAxis("Turn Right / Left Mouse", this, &ASurferCharacter::InputTurn);
+		PlayerInputComponent->BindAxis("Turn Right / Left Gamepad", this, &ASurferCharacter::InputTurnAtRate);
+		PlayerInputComponent->BindAxis("Look Up / Down Mouse", this, &ASurferCharacter::InputLookUp);
+		PlayerInputComponent->BindAxis("Look Up / Down Gamepad", this, &ASurferCharacter::InputLookUpAtRate);
+	}
+
+}
+
+bool ASurferCharacter::WantsAutoBunnyhop() const
+{
+	return CVarAutoBHop.GetValueOnGameThread() != 0 || bAutoBunnyhop;
 }
 
 /// <summary>
@@ -124,7 +553,7 @@ void ASurferCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputCom
 void ASurferCharacter::ClearJumpInput(float DeltaTime)
 {
 	//In case of turned on bhop keep cleared the queue and just keep jumping
-	if (CVarAutoBHop.GetValueOnGameThread() != 0 || bAutoBunnyhop || GetCharacterMovement()->bCheatFlying || bDeferJumpStop)
+	if (WantsAutoBunnyhop() || GetCharacterMovement()->bCheatFlying || bDeferJumpStop)
 	{
 		return;
 	}
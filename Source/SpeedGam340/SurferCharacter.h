@@ -9,6 +9,10 @@
 
 #include "Runtime/Launch/Resources/Version.h"
 
+#include "SurferInputCmd.h"
+#include "SurferGhostTrack.h"
+#include "SurferZone.h"
+
 #include "SurferCharacter.generated.h"
 
 /* Surfer Character will contain entire values and function that handle the behavior
@@ -59,6 +63,16 @@ public:
 	// Called to bind functionality to input
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
+	//Local player took control, adds the view roll to its camera
+	virtual void PawnClientRestart() override;
+
+	//Respawns and teleports end the current run
+	virtual void PossessedBy(AController* NewController) override;
+	virtual void TeleportSucceeded(bool bIsATest) override;
+
+	//Fast surfers close to the viewer first, see USurferNetPolicy
+	virtual float GetNetPriority(const FVector& ViewPos, const FVector& ViewDir, AActor* Viewer, AActor* ViewTarget, UActorChannel* InChannel, float Time, bool bLowBandwidth) override;
+
 	//Jump functions to override
 	//Update jump input state after having checked input.
 	virtual void ClearJumpInput(float DeltaTime) override;//
@@ -123,6 +137,8 @@ public:
 	{
 		bAutoBunnyhop = val;
 	};
+	//Auto bhop from the character or the move.Jumping console variable
+	bool WantsAutoBunnyhop() const;
 	//pointer to movement to keep track 
 	UFUNCTION(Category = "Get Surfer Stats", BlueprintPure) FORCEINLINE USurferMovementComponent* GetMovementPtr() const//
 	{
@@ -141,11 +157,33 @@ public:
 		return bWantsToWalk;
 	}
 
+	//Setters notify the movement so it can recompute its cached max speed
+	UFUNCTION(BlueprintCallable, Category = "Movement")
+		void SetSprinting(bool bNewSprinting);
+
+	UFUNCTION(BlueprintCallable, Category = "Movement")
+		void SetWantsToWalk(bool bNewWantsToWalk);
+
+	//Crouch changes max speed as well
+	virtual void OnStartCrouch(float HalfHeightAdjust, float ScaledHalfHeightAdjust) override;
+	virtual void OnEndCrouch(float HalfHeightAdjust, float ScaledHalfHeightAdjust) override;
+
 	float GetDefaultBaseEyeHeight() const { return DefaultBaseEyeHeight; }//
 
 	UFUNCTION()
 		void ToggleNoClip();//
 
+	//Server has to agree on noclip, otherwise every move gets corrected
+	UFUNCTION(Server, Reliable)
+		void ServerSetNoClip(bool bNoClip);
+
+	//Server refused the noclip
+	UFUNCTION(Client, Reliable)
+		void ClientSetNoClip(bool bNoClip);
+
+	//Server side, cheats or move.AllowNoClip
+	bool CanUseNoClip() const;
+
 	UFUNCTION(BlueprintPure, Category = "Movement")
 		float GetMinSpeedForFallDamage() const { return MinSpeedForFallDamage; }
 
@@ -153,6 +191,7 @@ public:
 #pragma endregion Modificators
 
 	//These function will hold the logic for executing movement
+	//They only fill the input command, the movement takes it once per frame
 	UFUNCTION()
 		void Move(FVector Direction, float Value);// move 
 
@@ -163,6 +202,44 @@ public:
 	UFUNCTION()
 		void LookUp(bool bIsPure, float Rate);// Y axis
 
+	//Hands this frame's input over to the movement and starts a new command
+	FSurferInputCmd ConsumeInputCmd();
+
+	//Turns the controller by the view deltas of the command that it has not had yet
+	void ApplyViewInput();
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	//Timed run through the map zones, advanced by USurferZoneSubsystem on the server
+	FSurferRunState& GetRunState() {
+		return RunState;
+	}
+
+	//Reached the end zone after all checkpoints
+	virtual void RunFinished(double RunTime);
+
+	//Drops the current run, it has to be started again from the start zone. Server only
+	void CancelRun();
+
+	//Lets the current run finish but keeps it off the leaderboard. Server only
+	void InvalidateRun();
+
+	//Leaderboard of the current map and movement style
+	FString GetRunBoardName() const;
+
+	//Owner wants to watch the best run of the board, empty for the current one. Ghost files are only on the server,
+	//the track goes back compressed in chunks and the client spawns the ghost
+	UFUNCTION(Server, Reliable)
+		void ServerRequestGhost(const FString& Board);
+
+	//Owner got a chunk, the next one goes out only then so a long track doesn't fill the reliable buffer
+	UFUNCTION(Server, Reliable)
+		void ServerAckGhostChunk();
+
+	//Part of the compressed track, TotalSize 0 when the board has no ghost
+	UFUNCTION(Client, Reliable)
+		void ClientGhostChunk(int32 TotalSize, const TArray<uint8>& Chunk);
+
 	//good morning i dont understand custom crouch functions so i got rid of them
 	//virtual bool CanCrouch() const override;//
 private:
@@ -214,6 +291,51 @@ private:
 		//
 		bool bDeferJumpStop;//
 
+		//Input of the current frame, filled by Turn/LookUp, the native bindings and the bot
+		FSurferInputCmd PendingInput;
+		//Part of PendingInput's view deltas already given to the controller
+		FRotator AppliedViewInput;
+
+		//Current run, the server's. Only the owner needs it for the timer
+		UPROPERTY(Replicated)
+			FSurferRunState RunState;
+
+		//Server recording of the current run, saved as the board's ghost when it is the best
+		FSurferGhostTrack GhostRecording;
+
+		//Compressed ghost going out to the owner and how much of it was sent, server side
+		TArray<uint8> GhostSendBuffer;
+		int32 GhostSendOffset;
+		void SendGhostChunk();
+
+		//Compressed ghost coming in from the server, owner side
+		TArray<uint8> GhostReceiveBuffer;
+
+		//Bind the axes straight to the command in C++ instead of going through Blueprint input events.
+		//Only turn it on for Blueprints that no longer bind the same mappings, or the view turns twice
+		UPROPERTY(EditDefaultsOnly, Category = "Surfing", meta = (AllowPrivateAccess = "true"))
+			bool bBindNativeInput;
+
+#if !UE_BUILD_SHIPPING
+		//Strafe and hop like a player for headless bot clients, move.BotStrafe
+		void AddBotStrafeInput(float DeltaTime);
+
+		//Recorded run whose turns a bot replays with move.BotStrafe 2
+		FSurferGhostTrack BotTrack;
+		float BotTrackTime;
+		int32 BotTrackCursor;
+		float BotTrackYaw;
+		bool bBotTrackLoaded;
+#endif
+
+		//Native axis handlers, no reflection
+		void InputMoveForward(float Value);
+		void InputMoveRight(float Value);
+		void InputTurn(float Value);
+		void InputTurnAtRate(float Value);
+		void InputLookUp(float Value);
+		void InputLookUpAtRate(float Value);
+
 		//virtual void ApplyDamageMomentum(float DamageTaken, FDamageEvent const& DamageEvent, APawn* PawnInsitgator, AActor* DamageCauser) override;//
 
 
@@ -0,0 +1,165 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferMovementComponent.h"
+
+#include "Components/CapsuleComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectIterator.h"
+
+#include "SpeedGam340.h"
+#include "SurferMovementBudget.h"
+
+/* Remote surfers between network updates.
+* The engine moves simulated proxies on in a straight line with the last replicated velocity, which cuts every curve
+* of a surfer sliding down a ramp. Here the proxy keeps accelerating with gravity, and on a surf ramp with gravity
+* along the ramp plane, so the path curves the way the owner's does. The ramp is found with one sweep per update.
+* Every update also measures how far off the prediction was, and how far off linear extrapolation would have been,
+* so lowering move.NetRateFast can be weighed against the error it costs (move.ProxyReport).
+* The ramp and the velocity are only known at the update, so reckoning stops after a couple of update intervals
+* or as soon as the proxy runs into something, the engine's straight line takes over until the next update.
+*/
+
+static TAutoConsoleVariable<int32> CVarDeadReckoning(TEXT("move.DeadReckoning"), 1, TEXT("Simulated surfers follow gravity and surf ramps between updates instead of a straight line\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarDeadReckoningMaxTime(TEXT("move.DeadReckoningMaxTime"), 0.25f, TEXT("Most seconds after an update a proxy keeps accelerating, after that it goes straight\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarDeadReckoningUpdates(TEXT("move.DeadReckoningUpdates"), 2.0f, TEXT("Measured update intervals of the proxy it keeps accelerating for, capped by move.DeadReckoningMaxTime\n"), ECVF_Default);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Surfer proxy updates"), STAT_SurferProxyUpdates, STATGROUP_Character);
+
+//Error of every remote surfer, e.g. "move.ProxyReport"
+static void ProxyReportForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	for (TObjectIterator<USurferMovementComponent> It; It; ++It)
+	{
+		if (It->GetWorld() == World && !It->IsTemplate() && It->GetCharacterOwner()
+			&& It->GetCharacterOwner()->GetLocalRole() == ROLE_SimulatedProxy)
+		{
+			It->LogProxyReport();
+		}
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdProxyReport(
+	TEXT("move.ProxyReport"),
+	TEXT("Log the update rate and prediction error of every remote surfer, against linear extrapolation\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&ProxyReportForWorld));
+
+/// <summary>
+/// Off with move.DeadReckoning 0, and while the movement budget is throttling: proxies are only for show,
+/// so they are the first to go back to the engine's straight line.
+/// </summary>
+bool USurferMovementComponent::IsDeadReckoningAllowed() const
+{
+	return CVarDeadReckoning.GetValueOnGameThread() != 0 && (MovementBudget == nullptr || MovementBudget->AllowDeadReckoning());
+}
+
+/// <summary>
+/// OldLocation is where the prediction had the proxy when the update came in, so the distance to NewLocation is its error.
+/// The linear error is what the straight line from the last update would have given.
+/// </summary>
+void USurferMovementComponent::SmoothCorrection(const FVector& OldLocation, const FQuat& OldRotation, const FVector& NewLocation, const FQuat& NewRotation)
+{
+	Super::SmoothCorrection(OldLocation, OldRotation, NewLocation, NewRotation);
+
+	if (!HasValidData() || CharacterOwner->GetLocalRole() != ROLE_SimulatedProxy)
+	{
+		return;
+	}
+
+	const double Now = GetWorld()->GetTimeSeconds();
+	if (bHasReckoningUpdate)
+	{
+		const float Interval = float(Now - ReckoningUpdateTime);
+		const float Error = FVector::Dist(OldLocation, NewLocation);
+		const float LinearError = FVector::Dist(ReckoningLocation + ReckoningLinearVelocity * Interval, NewLocation);
+		++ProxyUpdates;
+		ProxyUpdateIntervalSum += Interval;
+		ProxyErrorSum += Error;
+		ProxyErrorMax = FMath::Max(ProxyErrorMax, Error);
+		ProxyLinearErrorSum += LinearError;
+		ProxyLinearErrorMax = FMath::Max(ProxyLinearErrorMax, LinearError);
+	}
+	INC_DWORD_STAT(STAT_SurferProxyUpdates);
+
+	ReckoningLocation = NewLocation;
+	ReckoningLinearVelocity = CharacterOwner->GetReplicatedMovement().LinearVelocity;
+	ReckoningVelocity = ReckoningLinearVelocity;
+	ReckoningUpdateTime = Now;
+	bHasReckoningUpdate = true;
+	bReckoningBlocked = false;
+
+	//Ramp under the proxy, too steep to walk on but not a wall
+	ReckoningSurfNormal = FVector::ZeroVector;
+	if (IsDeadReckoningAllowed() && MovementMode == MOVE_Falling)
+	{
+		const UCapsuleComponent* Capsule = CharacterOwner->GetCapsuleComponent();
+		const FCollisionShape Shape = FCollisionShape::MakeCapsule(Capsule->GetScaledCapsuleRadius() * 0.9f, Capsule->GetScaledCapsuleHalfHeight() * 0.9f);
+		FCollisionQueryParams Params(SCENE_QUERY_STAT(SurferProxyRamp), false, CharacterOwner);
+		FHitResult Hit;
+		const FVector SweepEnd = NewLocation - FVector(0.0f, 0.0f, Capsule->GetScaledCapsuleHalfHeight() * 0.1f + 10.0f);
+		if (GetWorld()->SweepSingleByChannel(Hit, NewLocation, SweepEnd, FQuat::Identity, UpdatedComponent->GetCollisionObjectType(), Shape, Params)
+			&& Hit.ImpactNormal.Z > 0.05f && !IsWalkable(Hit))
+		{
+			ReckoningSurfNormal = Hit.ImpactNormal;
+			//Going into the ramp is not possible, keep the velocity in its plane
+			ReckoningVelocity -= FMath::Min(ReckoningVelocity | ReckoningSurfNormal, 0.0f) * ReckoningSurfNormal;
+		}
+	}
+}
+
+/// <summary>
+/// Only for simulated proxies in the air: gravity, along the ramp plane when on one, integrated from the last update.
+/// Sweeping and sliding stays with the engine, it only gets the curved velocity. The sweep that blocks tells
+/// the ramp or the velocity from the update are no good any more.
+/// </summary>
+void USurferMovementComponent::MoveSmooth(const FVector& InVelocity, const float DeltaSeconds, FStepDownResult* OutStepDownResult)
+{
+	//Longer than the next update should take is guessing, about two intervals covers a late or lost one
+	const float UpdateInterval = ProxyUpdates > 0 ? float(ProxyUpdateIntervalSum / ProxyUpdates) : CVarDeadReckoningMaxTime.GetValueOnGameThread();
+	const float Horizon = FMath::Min(CVarDeadReckoningMaxTime.GetValueOnGameThread(), UpdateInterval * CVarDeadReckoningUpdates.GetValueOnGameThread());
+	const bool bReckon = IsDeadReckoningAllowed() && bHasReckoningUpdate && !bReckoningBlocked && MovementMode == MOVE_Falling
+		&& CharacterOwner && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy
+		&& GetWorld()->GetTimeSeconds() - ReckoningUpdateTime < Horizon;
+	if (!bReckon)
+	{
+		Super::MoveSmooth(InVelocity, DeltaSeconds, OutStepDownResult);
+		return;
+	}
+
+	FVector Gravity(0.0f, 0.0f, GetGravityZ());
+	if (!ReckoningSurfNormal.IsZero())
+	{
+		Gravity -= (Gravity | ReckoningSurfNormal) * ReckoningSurfNormal;
+	}
+
+	const FVector OldVelocity = ReckoningVelocity;
+	ReckoningVelocity = NewFallVelocity(ReckoningVelocity, Gravity, DeltaSeconds);
+	Velocity = ReckoningVelocity;
+	const FVector Start = UpdatedComponent->GetComponentLocation();
+	const FVector Intended = 0.5f * (OldVelocity + ReckoningVelocity) * DeltaSeconds;
+	Super::MoveSmooth(0.5f * (OldVelocity + ReckoningVelocity), DeltaSeconds, OutStepDownResult);
+
+	//Slid or stopped against something, going on accelerating would push into it
+	const FVector Moved = UpdatedComponent->GetComponentLocation() - Start;
+	if ((Moved | Intended) < 0.9f * Intended.SizeSquared())
+	{
+		bReckoningBlocked = true;
+		ReckoningVelocity = Moved / FMath::Max(DeltaSeconds, KINDA_SMALL_NUMBER);
+		Velocity = ReckoningVelocity;
+	}
+}
+
+void USurferMovementComponent::LogProxyReport() const
+{
+	const ACharacter* Character = GetCharacterOwner();
+	const APlayerState* PlayerState = Character ? Character->GetPlayerState() : nullptr;
+	const int32 Updates = FMath::Max(ProxyUpdates, 1);
+	UE_LOG(LogSurfer, Display, TEXT("ProxyReport %s: %.1f updates/s, %s error %.1f avg %.1f max, linear %.1f avg %.1f max over %d updates"),
+		PlayerState ? *PlayerState->GetPlayerName() : *GetNameSafe(Character),
+		ProxyUpdateIntervalSum > 0.0 ? ProxyUpdates / ProxyUpdateIntervalSum : 0.0,
+		CVarDeadReckoning.GetValueOnGameThread() != 0 ? TEXT("dead reckoning") : TEXT("engine"),
+		ProxyErrorSum / Updates, ProxyErrorMax, ProxyLinearErrorSum / Updates, ProxyLinearErrorMax, ProxyUpdates);
+}
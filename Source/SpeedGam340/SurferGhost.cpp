@@ -0,0 +1,279 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferGhost.h"
+
+#include "Components/StaticMeshComponent.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/ConstructorHelpers.h"
+
+#include "SpeedGam340.h"
+#include "SurferCharacter.h"
+#include "SurferMovementComponent.h"
+
+DECLARE_CYCLE_STAT(TEXT("Surfer ghost playback"), STAT_SurferGhostPlayback, STATGROUP_Character);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Surfer ghost updates"), STAT_SurferGhostUpdates, STATGROUP_Character);
+
+//e.g. "move.BenchGhosts 32 600", count and frames are optional
+static void BenchGhostsForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 Count = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 32;
+	const int32 Frames = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 600;
+	ASurferGhost::Benchmark(World, Count, Frames);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdBenchGhosts(
+	TEXT("move.BenchGhosts"),
+	TEXT("Time ghost playback against full surfers simulating the same number of frames, optional count and frames\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchGhostsForWorld));
+
+//e.g. "move.SpawnGhost", or "move.SpawnGhost surf_map_HalfLife2" for another board.
+//Clients of a server ask it for the track, the files are only on the server
+static void SpawnGhostForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	if (World == nullptr || World->GetNetMode() == NM_DedicatedServer)
+	{
+		return;
+	}
+
+	const APlayerController* PlayerController = World->GetFirstPlayerController();
+	ASurferCharacter* Surfer = PlayerController ? Cast<ASurferCharacter>(PlayerController->GetPawn()) : nullptr;
+	FString Board = Args.Num() > 0 ? Args[0] : FString();
+	if (World->GetNetMode() == NM_Client)
+	{
+		if (Surfer)
+		{
+			Surfer->ServerRequestGhost(Board);
+		}
+		return;
+	}
+
+	if (Board.IsEmpty())
+	{
+		if (Surfer == nullptr || Surfer->GetMovementPtr() == nullptr)
+		{
+			return;
+		}
+		Board = Surfer->GetRunBoardName();
+	}
+
+	FSurferGhostTrack Track;
+	if (!Track.LoadFromFile(FSurferGhostTrack::GetBoardGhostPath(Board)) || Track.Samples.Num() == 0)
+	{
+		UE_LOG(LogSurfer, Warning, TEXT("No ghost recorded for %s"), *Board);
+		return;
+	}
+	ASurferGhost::SpawnWithTrack(World, MoveTemp(Track));
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdSpawnGhost(
+	TEXT("move.SpawnGhost"),
+	TEXT("Play the best run of the current map and style, or of the given board, as a ghost\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&SpawnGhostForWorld));
+
+ASurferGhost::ASurferGhost()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = true;
+	bReplicates = false;
+	SetCanBeDamaged(false);
+
+	Mesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("Mesh"));
+	Mesh->SetCollisionProfileName(UCollisionProfile::NoCollision_ProfileName);
+	Mesh->SetGenerateOverlapEvents(false);
+	Mesh->SetCanEverAffectNavigation(false);
+	Mesh->CastShadow = false;
+	Mesh->PrimaryComponentTick.bCanEverTick = false;
+	RootComponent = Mesh;
+
+	static ConstructorHelpers::FObjectFinder<UStaticMesh> GhostMesh(TEXT("/Engine/BasicShapes/Cylinder.Cylinder"));
+	if (GhostMesh.Succeeded())
+	{
+		Mesh->SetStaticMesh(GhostMesh.Object);
+		Mesh->SetRelativeScale3D(FVector(0.68f, 0.68f, 1.76f));
+	}
+
+	bLoop = true;
+	PlaybackTime = 0.0f;
+	Cursor = 0;
+}
+
+void ASurferGhost::BeginPlay()
+{
+	Super::BeginPlay();
+
+	//Nobody to watch it
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		SetActorTickEnabled(false);
+		SetActorHiddenInGame(true);
+	}
+}
+
+void ASurferGhost::SetTrack(FSurferGhostTrack&& InTrack)
+{
+	Track = MoveTemp(InTrack);
+	PlaybackTime = 0.0f;
+	Cursor = 0;
+	AdvancePlayback(0.0f);
+}
+
+ASurferGhost* ASurferGhost::SpawnWithTrack(UWorld* World, FSurferGhostTrack&& InTrack)
+{
+	if (World == nullptr)
+	{
+		return nullptr;
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.ObjectFlags |= RF_Transient;
+	ASurferGhost* Ghost = World->SpawnActor<ASurferGhost>(ASurferGhost::StaticClass(), FTransform::Identity, SpawnParams);
+	if (Ghost)
+	{
+		Ghost->SetTrack(MoveTemp(InTrack));
+	}
+	return Ghost;
+}
+
+bool ASurferGhost::LoadBoardTrack(const FString& BoardName)
+{
+	FSurferGhostTrack Loaded;
+	if (!Loaded.LoadFromFile(FSurferGhostTrack::GetBoardGhostPath(BoardName)) || Loaded.Samples.Num() == 0)
+	{
+		return false;
+	}
+	SetTrack(MoveTemp(Loaded));
+	return true;
+}
+
+void ASurferGhost::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	AdvancePlayback(DeltaTime);
+}
+
+void ASurferGhost::AdvancePlayback(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SurferGhostPlayback);
+	INC_DWORD_STAT(STAT_SurferGhostUpdates);
+
+	if (Track.Samples.Num() == 0)
+	{
+		return;
+	}
+
+	PlaybackTime += DeltaTime;
+	const float Duration = Track.GetDuration();
+	if (PlaybackTime > Duration)
+	{
+		PlaybackTime = bLoop && Duration > 0.0f ? FMath::Fmod(PlaybackTime, Duration) : Duration;
+	}
+
+	FVector Location;
+	FRotator Rotation;
+	Track.Evaluate(PlaybackTime, Cursor, Location, Rotation);
+	//No sweep and no overlaps, the mesh has no collision anyway
+	RootComponent->SetWorldLocationAndRotation(Location, FRotator(0.0f, Rotation.Yaw, 0.0f), false, nullptr, ETeleportType::TeleportPhysics);
+}
+
+/// <summary>
+/// Same number of ghosts and surfers, far away from the map and falling so the surfers run PhysFalling every frame.
+/// Both are driven by hand for the frames, the surfers through the character and movement component ticks.
+/// </summary>
+void ASurferGhost::Benchmark(UWorld* World, int32 Count, int32 Frames)
+{
+	if (World == nullptr)
+	{
+		return;
+	}
+
+	constexpr float FrameTime = 1.0f / 64.0f;
+	const FVector Origin(0.0f, 0.0f, 500000.0f);
+
+	//A minute of curving path
+	FSurferGhostTrack BenchTrack;
+	for (int32 Sample = 0; Sample < 60 * 30; ++Sample)
+	{
+		const float Time = Sample / 30.0f;
+		BenchTrack.Samples.Add({ Time, FVector3f(FMath::Sin(Time) * 2000.0f, Time * 1000.0f, FMath::Cos(Time * 0.5f) * 300.0f), int16(Sample * 50), 0 });
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.ObjectFlags |= RF_Transient;
+
+	TArray<ASurferGhost*> Ghosts;
+	TArray<ASurferCharacter*> Surfers;
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		const FTransform Transform(Origin + FVector(Index * 500.0f, 0.0f, 0.0f));
+		if (ASurferGhost* Ghost = World->SpawnActor<ASurferGhost>(ASurferGhost::StaticClass(), Transform, SpawnParams))
+		{
+			FSurferGhostTrack Copy = BenchTrack;
+			Ghost->SetTrack(MoveTemp(Copy));
+			Ghosts.Add(Ghost);
+		}
+		if (ASurferCharacter* Surfer = World->SpawnActor<ASurferCharacter>(ASurferCharacter::StaticClass(), Transform, SpawnParams))
+		{
+			USurferMovementComponent* Movement = Surfer->GetMovementPtr();
+			Movement->bRunPhysicsWithNoController = true;
+			Movement->SetMovementMode(MOVE_Falling);
+			Movement->Velocity = FVector(1500.0f, 300.0f, 0.0f);
+			Surfers.Add(Surfer);
+		}
+	}
+
+	double StartTime = FPlatformTime::Seconds();
+	for (int32 Frame = 0; Frame < Frames; ++Frame)
+	{
+		for (ASurferGhost* Ghost : Ghosts)
+		{
+			Ghost->Tick(FrameTime);
+		}
+	}
+	const double GhostSeconds = FPlatformTime::Seconds() - StartTime;
+
+	StartTime = FPlatformTime::Seconds();
+	for (int32 Frame = 0; Frame < Frames; ++Frame)
+	{
+		for (ASurferCharacter* Surfer : Surfers)
+		{
+			Surfer->Tick(FrameTime);
+			USurferMovementComponent* Movement = Surfer->GetMovementPtr();
+			Movement->TickComponent(FrameTime, LEVELTICK_All, &Movement->PrimaryComponentTick);
+		}
+	}
+	const double SurferSeconds = FPlatformTime::Seconds() - StartTime;
+
+	//Object sizes of the actor and its components, what every instance costs before any render state
+	auto ActorBytes = [](const AActor* Actor)
+	{
+		int64 Bytes = Actor->GetClass()->GetStructureSize();
+		for (const UActorComponent* Component : Actor->GetComponents())
+		{
+			Bytes += Component->GetClass()->GetStructureSize();
+		}
+		return Bytes;
+	};
+	const int64 GhostBytes = Ghosts.Num() > 0 ? ActorBytes(Ghosts[0]) + Ghosts[0]->Track.Samples.GetAllocatedSize() : 0;
+	const int64 SurferBytes = Surfers.Num() > 0 ? ActorBytes(Surfers[0]) : 0;
+
+	const double Updates = double(Frames) * Count;
+	UE_LOG(LogSurfer, Display, TEXT("move.BenchGhosts %d each, %d frames: ghost %.3f us/update, %lld bytes (track included) | surfer %.3f us/update, %lld bytes | %.1fx cheaper"),
+		Count, Frames, GhostSeconds * 1e6 / Updates, GhostBytes, SurferSeconds * 1e6 / Updates, SurferBytes,
+		SurferSeconds / FMath::Max(GhostSeconds, 1e-9));
+
+	for (ASurferGhost* Ghost : Ghosts)
+	{
+		Ghost->Destroy();
+	}
+	for (ASurferCharacter* Surfer : Surfers)
+	{
+		Surfer->Destroy();
+	}
+}
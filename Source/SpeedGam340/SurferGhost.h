@@ -0,0 +1,55 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+
+#include "SurferGhostTrack.h"
+
+#include "SurferGhost.generated.h"
+
+class UStaticMeshComponent;
+
+/* Playback of a recorded run.
+* Only a mesh without collision moved along the track, no movement component, no capsule, no input and
+* no replication. Each client spawns its own from the track the server sent it, dedicated servers never tick or draw them.
+*/
+UCLASS()
+class SPEEDGAM340_API ASurferGhost : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	ASurferGhost();
+
+	virtual void BeginPlay() override;
+	virtual void Tick(float DeltaTime) override;
+
+	void SetTrack(FSurferGhostTrack&& InTrack);
+
+	//Best run of the board, false if it has none
+	bool LoadBoardTrack(const FString& BoardName);
+
+	//Local ghost playing the track
+	static ASurferGhost* SpawnWithTrack(UWorld* World, FSurferGhostTrack&& InTrack);
+
+	//Moves the mesh to where the run was DeltaTime later
+	void AdvancePlayback(float DeltaTime);
+
+	//Ghost against full surfer cost, move.BenchGhosts
+	static void Benchmark(UWorld* World, int32 Count, int32 Frames);
+
+protected:
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ghost")
+		UStaticMeshComponent* Mesh;
+
+	//Starts over at the end of the run
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ghost")
+		bool bLoop;
+
+private:
+	FSurferGhostTrack Track;
+	float PlaybackTime;
+	int32 Cursor;
+};
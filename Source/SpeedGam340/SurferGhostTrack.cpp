@@ -0,0 +1,173 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferGhostTrack.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+#include "SurferLeaderboard.h"
+
+static TAutoConsoleVariable<float> CVarGhostSampleRate(TEXT("move.GhostSampleRate"), 30.0f, TEXT("Samples per second recorded for run ghosts\n"), ECVF_Default);
+
+//Half an hour at the default rate, anything longer is not a record run
+constexpr int32 MaxGhostSamples = 54000;
+
+constexpr uint32 GhostFileMagic = 0x54534847; // GHST
+constexpr uint32 GhostFileVersion = 1;
+
+static int16 QuantizeAngle(float Degrees)
+{
+	return static_cast<int16>(FMath::RoundToInt(FRotator::NormalizeAxis(Degrees) * (32768.0f / 180.0f)) & 0xFFFF);
+}
+
+static float DequantizeAngle(int16 Angle)
+{
+	return Angle * (180.0f / 32768.0f);
+}
+
+void FSurferGhostTrack::Record(float Time, const FVector& Location, const FRotator& Rotation)
+{
+	const float Interval = 1.0f / FMath::Max(CVarGhostSampleRate.GetValueOnGameThread(), 1.0f);
+	if (Samples.Num() >= MaxGhostSamples || (Samples.Num() > 0 && Time - Samples.Last().Time < Interval))
+	{
+		return;
+	}
+	Samples.Add({ Time, FVector3f(Location), QuantizeAngle(Rotation.Yaw), QuantizeAngle(Rotation.Pitch) });
+}
+
+/// <summary>
+/// Cubic between the two samples around Time with Catmull-Rom tangents, so curves along a ramp stay curves
+/// at 30 samples a second. The cursor makes finding the samples O(1) while playing forward.
+/// </summary>
+void FSurferGhostTrack::Evaluate(float Time, int32& Cursor, FVector& OutLocation, FRotator& OutRotation) const
+{
+	const int32 Num = Samples.Num();
+	if (Num == 0)
+	{
+		return;
+	}
+	if (Num == 1 || Time <= Samples[0].Time)
+	{
+		Cursor = 0;
+		OutLocation = FVector(Samples[0].Location);
+		OutRotation = FRotator(DequantizeAngle(Samples[0].Pitch), DequantizeAngle(Samples[0].Yaw), 0.0f);
+		return;
+	}
+
+	//Looped or jumped back
+	if (!Samples.IsValidIndex(Cursor) || Samples[Cursor].Time > Time)
+	{
+		Cursor = 0;
+	}
+	while (Cursor < Num - 2 && Samples[Cursor + 1].Time <= Time)
+	{
+		++Cursor;
+	}
+
+	const FSurferGhostSample& From = Samples[Cursor];
+	const FSurferGhostSample& To = Samples[Cursor + 1];
+	const FSurferGhostSample& Before = Samples[FMath::Max(Cursor - 1, 0)];
+	const FSurferGhostSample& After = Samples[FMath::Min(Cursor + 2, Num - 1)];
+
+	const float Span = FMath::Max(To.Time - From.Time, KINDA_SMALL_NUMBER);
+	const float Alpha = FMath::Clamp((Time - From.Time) / Span, 0.0f, 1.0f);
+	const FVector3f StartTangent = (To.Location - Before.Location) * (Span / FMath::Max(To.Time - Before.Time, KINDA_SMALL_NUMBER));
+	const FVector3f EndTangent = (After.Location - From.Location) * (Span / FMath::Max(After.Time - From.Time, KINDA_SMALL_NUMBER));
+	OutLocation = FVector(FMath::CubicInterp(From.Location, StartTangent, To.Location, EndTangent, Alpha));
+
+	//Shortest way round, int16 wraps for us
+	const int16 YawDelta = static_cast<int16>(To.Yaw - From.Yaw);
+	const int16 PitchDelta = static_cast<int16>(To.Pitch - From.Pitch);
+	OutRotation = FRotator(DequantizeAngle(From.Pitch) + DequantizeAngle(PitchDelta) * Alpha, DequantizeAngle(From.Yaw) + DequantizeAngle(YawDelta) * Alpha, 0.0f);
+}
+
+void FSurferGhostTrack::ToBytes(TArray<uint8>& OutBytes) const
+{
+	OutBytes.Reset(16 + Samples.Num() * sizeof(FSurferGhostSample));
+	const uint32 Header[] = { GhostFileMagic, GhostFileVersion, uint32(Samples.Num()), 0 };
+	OutBytes.Append(reinterpret_cast<const uint8*>(Header), sizeof(Header));
+	OutBytes.Append(reinterpret_cast<const uint8*>(Samples.GetData()), Samples.Num() * sizeof(FSurferGhostSample));
+}
+
+bool FSurferGhostTrack::FromBytes(const uint8* Bytes, int32 Num)
+{
+	uint32 Header[4];
+	if (Num < int32(sizeof(Header)))
+	{
+		return false;
+	}
+
+	FMemory::Memcpy(Header, Bytes, sizeof(Header));
+	if (Header[0] != GhostFileMagic || Header[1] != GhostFileVersion || Header[2] > uint32(MaxGhostSamples)
+		|| Num != int32(sizeof(Header) + Header[2] * sizeof(FSurferGhostSample)))
+	{
+		return false;
+	}
+
+	Samples.SetNumUninitialized(Header[2]);
+	FMemory::Memcpy(Samples.GetData(), Bytes + sizeof(Header), Samples.Num() * sizeof(FSurferGhostSample));
+	RunStartTime = 0.0;
+	return true;
+}
+
+bool FSurferGhostTrack::SaveToFile(const FString& Path) const
+{
+	TArray<uint8> Bytes;
+	ToBytes(Bytes);
+	return FFileHelper::SaveArrayToFile(Bytes, *Path);
+}
+
+bool FSurferGhostTrack::LoadFromFile(const FString& Path)
+{
+	TArray<uint8> Bytes;
+	return FFileHelper::LoadFileToArray(Bytes, *Path, FILEREAD_Silent) && FromBytes(Bytes.GetData(), Bytes.Num());
+}
+
+/// <summary>
+/// Uncompressed size first, then the zlib stream of the file bytes.
+/// </summary>
+bool FSurferGhostTrack::Compress(TArray<uint8>& OutBytes) const
+{
+	TArray<uint8> Raw;
+	ToBytes(Raw);
+
+	int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, Raw.Num());
+	OutBytes.SetNumUninitialized(sizeof(int32) + CompressedSize);
+	const int32 RawSize = Raw.Num();
+	FMemory::Memcpy(OutBytes.GetData(), &RawSize, sizeof(int32));
+	if (!FCompression::CompressMemory(NAME_Zlib, OutBytes.GetData() + sizeof(int32), CompressedSize, Raw.GetData(), Raw.Num()))
+	{
+		OutBytes.Reset();
+		return false;
+	}
+	OutBytes.SetNum(sizeof(int32) + CompressedSize);
+	return true;
+}
+
+bool FSurferGhostTrack::Decompress(const TArray<uint8>& Bytes)
+{
+	int32 RawSize = 0;
+	if (Bytes.Num() < int32(sizeof(int32)))
+	{
+		return false;
+	}
+	FMemory::Memcpy(&RawSize, Bytes.GetData(), sizeof(int32));
+	//Never more than the longest track, whatever the size says
+	if (RawSize < 16 || RawSize > int32(16 + MaxGhostSamples * sizeof(FSurferGhostSample)))
+	{
+		return false;
+	}
+
+	TArray<uint8> Raw;
+	Raw.SetNumUninitialized(RawSize);
+	return FCompression::UncompressMemory(NAME_Zlib, Raw.GetData(), RawSize, Bytes.GetData() + sizeof(int32), Bytes.Num() - sizeof(int32))
+		&& FromBytes(Raw.GetData(), Raw.Num());
+}
+
+FString FSurferGhostTrack::GetBoardGhostPath(const FString& BoardName)
+{
+	return FPaths::Combine(USurferLeaderboardSubsystem::GetBoardDirectory(BoardName), TEXT("Best.ghost"));
+}
@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//One recorded position of a run, 20 bytes
+struct FSurferGhostSample
+{
+	//Seconds since the run started
+	float Time;
+	FVector3f Location;
+	//Quantized to 65536 steps per turn
+	int16 Yaw;
+	int16 Pitch;
+};
+static_assert(sizeof(FSurferGhostSample) == 20, "Ghost samples are saved as they are in memory");
+
+/* Recorded run for ghosts. The server records every surfer at move.GhostSampleRate while the run is going,
+* the best run of a board is saved next to its leaderboard and played back by ASurferGhost.
+* Clients don't have the files, the server sends them the track compressed, see ASurferCharacter::ServerRequestGhost.
+*/
+struct FSurferGhostTrack
+{
+	//Movement simulation time the recorded run started at, tells a restarted run apart
+	double RunStartTime = 0.0;
+	TArray<FSurferGhostSample> Samples;
+
+	void Reset(double InRunStartTime)
+	{
+		RunStartTime = InRunStartTime;
+		Samples.Reset();
+	}
+
+	//Adds a sample if the last one is at least a sample interval old
+	void Record(float Time, const FVector& Location, const FRotator& Rotation);
+
+	float GetDuration() const {
+		return Samples.Num() > 0 ? Samples.Last().Time : 0.0f;
+	}
+
+	//Transform at Time, Cursor is the sample before it from the last call so playback only ever steps forward
+	void Evaluate(float Time, int32& Cursor, FVector& OutLocation, FRotator& OutRotation) const;
+
+	bool SaveToFile(const FString& Path) const;
+	bool LoadFromFile(const FString& Path);
+
+	//Same bytes as the file, zlib compressed for sending to clients
+	bool Compress(TArray<uint8>& OutBytes) const;
+	bool Decompress(const TArray<uint8>& Bytes);
+
+	//Best run of a leaderboard board
+	static FString GetBoardGhostPath(const FString& BoardName);
+
+private:
+	void ToBytes(TArray<uint8>& OutBytes) const;
+	bool FromBytes(const uint8* Bytes, int32 Num);
+};
@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/* One frame of player input, the same thing Source calls a usercmd.
+* The character fills it from its axis and action bindings, the movement component takes it once per frame.
+* Move values are relative to the control yaw, so the record doesn't depend on where the player was looking.
+*/
+
+//Bits of FSurferInputCmd::Buttons
+namespace ESurferInputButtons
+{
+	enum Type : uint8
+	{
+		None = 0,
+		Jump = 1 << 0,
+		Sprint = 1 << 1,
+		Walk = 1 << 2,
+		Crouch = 1 << 3,
+	};
+}
+
+struct FSurferInputCmd
+{
+	//-1..1 forward/back, summed over the frame
+	float ForwardMove = 0.0f;
+	//-1..1 right/left
+	float SideMove = 0.0f;
+	//View change this frame in controller input units
+	float YawDelta = 0.0f;
+	float PitchDelta = 0.0f;
+	//ESurferInputButtons
+	uint8 Buttons = ESurferInputButtons::None;
+
+	bool HasMove() const {
+		return ForwardMove != 0.0f || SideMove != 0.0f;
+	}
+
+	bool IsPressed(ESurferInputButtons::Type Button) const {
+		return (Buttons & Button) != 0;
+	}
+
+	void Reset() {
+		*this = FSurferInputCmd();
+	}
+};
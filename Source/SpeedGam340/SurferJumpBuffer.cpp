@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferJumpBuffer.h"
+
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+#include "SpeedGam340.h"
+#include "SurferCharacter.h"
+#include "SurferMovementComponent.h"
+
+static TAutoConsoleVariable<float> CVarJumpBufferWindow(TEXT("move.JumpBufferWindow"), 0.1f, TEXT("Seconds before landing a jump press is kept and fired on the landing substep, 0 turns the buffer off\n"), ECVF_Default);
+static TAutoConsoleVariable<int32> CVarJumpBufferTicks(TEXT("move.JumpBufferTicks"), 0, TEXT("If above 0 the jump buffer window is this many movement steps instead of seconds\n"), ECVF_Default);
+
+float FSurferJumpBuffer::GetWindowSeconds()
+{
+	return FMath::Max(0.0f, CVarJumpBufferWindow.GetValueOnGameThread());
+}
+
+int32 FSurferJumpBuffer::GetWindowTicks()
+{
+	return FMath::Max(0, CVarJumpBufferTicks.GetValueOnGameThread());
+}
+
+/// <summary>
+/// Checks the buffer at 32, 64, 128 and 256 Hz. First the window math on its own, then the local surfer
+/// is dropped onto the floor below it through the movement with real jump input, see TestJumpBufferLanding.
+/// The second part needs a standalone game with the surfer standing on a floor. "move.TestJumpBuffer"
+/// </summary>
+static void TestJumpBuffer(const TArray<FString>& Args, UWorld* World)
+{
+	const float TickRates[] = { 32.0f, 64.0f, 128.0f, 256.0f };
+	const float WindowSeconds = 0.1f;
+	const int32 WindowTicks = 6;
+	int32 Failed = 0;
+
+	for (const float TickRate : TickRates)
+	{
+		const double StepTime = 1.0 / TickRate;
+		//Press at some fraction of a step, land after a varying delay at a fraction of a later step
+		for (int32 PressStep = 0; PressStep < 4; ++PressStep)
+		{
+			for (float LandDelay = 0.0f; LandDelay <= 0.2f; LandDelay += 0.0125f)
+			{
+				const double PressTime = (PressStep + 0.3) * StepTime;
+				const double LandTime = PressTime + LandDelay;
+				const int64 LandStep = FMath::FloorToInt64(LandTime / StepTime);
+
+				FSurferJumpBuffer Buffer;
+				Buffer.Press(PressTime, PressStep);
+
+				//Seconds semantics don't depend on the tick rate at all
+				const bool bSecondsExpected = LandDelay <= WindowSeconds + KINDA_SMALL_NUMBER;
+				if (Buffer.IsInWindow(LandTime, LandStep, WindowSeconds + KINDA_SMALL_NUMBER, 0) != bSecondsExpected)
+				{
+					UE_LOG(LogSurfer, Error, TEXT("Jump buffer (seconds) wrong at %.0f Hz, delay %.4f"), TickRate, LandDelay);
+					++Failed;
+				}
+
+				//Tick semantics count whole steps
+				const bool bTicksExpected = LandStep - PressStep <= WindowTicks;
+				if (Buffer.IsInWindow(LandTime, LandStep, 0.0f, WindowTicks) != bTicksExpected)
+				{
+					UE_LOG(LogSurfer, Error, TEXT("Jump buffer (ticks) wrong at %.0f Hz, delay %.4f"), TickRate, LandDelay);
+					++Failed;
+				}
+
+				//Consumed presses never fire twice
+				Buffer.Reset();
+				if (Buffer.IsInWindow(LandTime, LandStep, WindowSeconds, WindowTicks))
+				{
+					UE_LOG(LogSurfer, Error, TEXT("Jump buffer fired after reset at %.0f Hz"), TickRate);
+					++Failed;
+				}
+			}
+		}
+
+		//Landing before the press is never a buffered hop
+		FSurferJumpBuffer Buffer;
+		Buffer.Press(1.0, 10);
+		if (Buffer.IsInWindow(1.0 - StepTime, 9, WindowSeconds, WindowTicks))
+		{
+			UE_LOG(LogSurfer, Error, TEXT("Jump buffer fired for a landing before the press at %.0f Hz"), TickRate);
+			++Failed;
+		}
+	}
+
+	//Same window through the movement, the buffer reads it from the console variables
+	const APlayerController* PlayerController = World ? World->GetFirstPlayerController() : nullptr;
+	const ASurferCharacter* Surfer = PlayerController ? Cast<ASurferCharacter>(PlayerController->GetPawn()) : nullptr;
+	USurferMovementComponent* Movement = Surfer ? Surfer->GetMovementPtr() : nullptr;
+	if (Movement == nullptr || World->GetNetMode() != NM_Standalone)
+	{
+		UE_LOG(LogSurfer, Error, TEXT("Jump buffer landing check skipped, it needs a standalone game with a local surfer"));
+		++Failed;
+	}
+	else
+	{
+		const float SavedWindow = CVarJumpBufferWindow.GetValueOnGameThread();
+		const int32 SavedTicks = CVarJumpBufferTicks.GetValueOnGameThread();
+		CVarJumpBufferWindow->Set(WindowSeconds, ECVF_SetByConsole);
+		CVarJumpBufferTicks->Set(0, ECVF_SetByConsole);
+		for (const float TickRate : TickRates)
+		{
+			Failed += Movement->TestJumpBufferLanding(TickRate, WindowSeconds);
+		}
+		CVarJumpBufferWindow->Set(SavedWindow, ECVF_SetByConsole);
+		CVarJumpBufferTicks->Set(SavedTicks, ECVF_SetByConsole);
+	}
+
+	UE_LOG(LogSurfer, Display, TEXT("Jump buffer check: %s (%d failures)"), Failed == 0 ? TEXT("passed") : TEXT("FAILED"), Failed);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdTestJumpBuffer(
+	TEXT("move.TestJumpBuffer"),
+	TEXT("Check the jump buffer window at several tick rates, then through the movement of the local surfer\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&TestJumpBuffer));
@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/* Jump buffer for perfect bunnyhops.
+* A jump pressed shortly before landing is remembered and fired in the same substep the character lands in,
+* so the hop never spends a tick on the ground and never loses speed to ground friction.
+* Times are movement simulation time, steps are movement steps, so it works the same on client and server.
+*
+* The window is either in seconds (move.JumpBufferWindow) or in movement steps (move.JumpBufferTicks),
+* the second being how Source counts it and what keeps hops frame rate independent at fixed tick rates.
+*/
+struct FSurferJumpBuffer
+{
+	//Simulation time of the press
+	double PressTime = 0.0;
+	//Movement step of the press
+	int64 PressStep = 0;
+	//Press not consumed yet
+	bool bPending = false;
+
+	void Press(double Time, int64 Step)
+	{
+		PressTime = Time;
+		PressStep = Step;
+		bPending = true;
+	}
+
+	void Reset()
+	{
+		bPending = false;
+	}
+
+	//True if a landing at LandTime/LandStep still counts for the buffered press
+	bool IsInWindow(double LandTime, int64 LandStep, float WindowSeconds, int32 WindowTicks) const
+	{
+		if (!bPending || LandTime < PressTime)
+		{
+			return false;
+		}
+		if (WindowTicks > 0)
+		{
+			return LandStep - PressStep <= WindowTicks;
+		}
+		return LandTime - PressTime <= WindowSeconds;
+	}
+
+	//Window from the console variables
+	static float GetWindowSeconds();
+	static int32 GetWindowTicks();
+};
@@ -0,0 +1,667 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferLeaderboard.h"
+
+#include "Algo/BinarySearch.h"
+#include "Algo/IsSorted.h"
+#include "Algo/Sort.h"
+#include "Async/Async.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Hash/CityHash.h"
+#include "Misc/Paths.h"
+
+#include "SpeedGam340.h"
+
+static TAutoConsoleVariable<int32> CVarLeaderboardCompactAt(TEXT("move.LeaderboardCompactAt"), 65536, TEXT("Unindexed runs a leaderboard keeps in memory before merging them into its index, grows to an eighth of the index\n"), ECVF_Default);
+
+//Entries added in place before they become a sorted run
+constexpr int32 LeaderboardDeltaSize = 4096;
+//Records buffered before they are written to the log
+constexpr int32 LeaderboardWriteBufferSize = 64 * 1024;
+
+constexpr uint32 LeaderboardIndexMagic = 0x4942534C; // LSBI
+//2: one entry per player, with its id
+constexpr uint32 LeaderboardIndexVersion = 2;
+
+struct FSurferLeaderboardIndexHeader
+{
+	uint32 Magic;
+	uint32 Version;
+	uint64 NumEntries;
+	//Log records the entries were picked from
+	uint64 NumRecords;
+};
+
+//e.g. "move.BenchLeaderboard 10000000 1000000", records and queries are optional
+static void BenchLeaderboard(const TArray<FString>& Args)
+{
+	const int32 Records = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 10000000;
+	const int32 Queries = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 1000000;
+	USurferLeaderboardSubsystem::Benchmark(Records, Queries);
+}
+
+static FAutoConsoleCommand CmdBenchLeaderboard(
+	TEXT("move.BenchLeaderboard"),
+	TEXT("Time leaderboard inserts, compaction and rank queries on a scratch board, optional record and query counts\n"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchLeaderboard));
+
+FSurferRunRecord FSurferRunRecord::Make(double RunTime, const FString& Name, const FString& UniqueId)
+{
+	FSurferRunRecord Record;
+	FMemory::Memzero(Record);
+	Record.TimeMicros = static_cast<int64>(RunTime * 1.0e6 + 0.5);
+	Record.DateTicks = FDateTime::UtcNow().GetTicks();
+
+	const FTCHARToUTF8 Id(*UniqueId);
+	Record.PlayerId = CityHash64(Id.Get(), Id.Length());
+
+	//Cut on a character boundary, not in the middle of a multi byte one
+	const FTCHARToUTF8 Utf8Name(*Name);
+	int32 Length = FMath::Min(Utf8Name.Length(), int32(UE_ARRAY_COUNT(Record.PlayerName)) - 1);
+	while (Length > 0 && Length < Utf8Name.Length() && (Utf8Name.Get()[Length] & 0xC0) == 0x80)
+	{
+		--Length;
+	}
+	FMemory::Memcpy(Record.PlayerName, Utf8Name.Get(), Length);
+	return Record;
+}
+
+FString FSurferRunRecord::GetPlayerName() const
+{
+	const FUTF8ToTCHAR Name(PlayerName, FCStringAnsi::Strnlen(PlayerName, UE_ARRAY_COUNT(PlayerName)));
+	return FString(Name.Length(), Name.Get());
+}
+
+static void MergeSorted(TArrayView<const FSurferRankEntry> A, TArrayView<const FSurferRankEntry> B, TArray<FSurferRankEntry>& Out)
+{
+	Out.Reset(A.Num() + B.Num());
+	int32 IndexA = 0;
+	int32 IndexB = 0;
+	while (IndexA < A.Num() && IndexB < B.Num())
+	{
+		Out.Add(B[IndexB] < A[IndexA] ? B[IndexB++] : A[IndexA++]);
+	}
+	Out.Append(A.GetData() + IndexA, A.Num() - IndexA);
+	Out.Append(B.GetData() + IndexB, B.Num() - IndexB);
+}
+
+/// <summary>
+/// Worker side of the compaction. Folds the runs into one, then streams the merge with the old index to a temp file
+/// which is renamed once complete, so a crash leaves either the old or the new index, never half of one.
+/// Tombstoned entries are left out, the header is written last once their number is known.
+/// </summary>
+static FString WriteMergedIndex(TArrayView<const FSurferRankEntry> OldIndex, const TArray<TArray<FSurferRankEntry>>& Runs, TArrayView<const FSurferRankEntry> Removed, const FString& Directory, uint64 NumRecords)
+{
+	TArray<FSurferRankEntry> Merged;
+	TArray<FSurferRankEntry> Scratch;
+	for (const TArray<FSurferRankEntry>& Run : Runs)
+	{
+		MergeSorted(Merged, Run, Scratch);
+		Swap(Merged, Scratch);
+	}
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	const FString Path = FPaths::Combine(Directory, FString::Printf(TEXT("Index_%llu.bin"), NumRecords));
+	const FString TempPath = Path + TEXT(".tmp");
+	{
+		TUniquePtr<IFileHandle> File(PlatformFile.OpenWrite(*TempPath));
+		if (!File)
+		{
+			return FString();
+		}
+
+		FSurferLeaderboardIndexHeader Header = { LeaderboardIndexMagic, LeaderboardIndexVersion, 0, NumRecords };
+		bool bWritten = File->Write(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+
+		constexpr int32 ChunkSize = 65536;
+		TArray<FSurferRankEntry> Chunk;
+		Chunk.Reserve(ChunkSize);
+		int32 IndexOld = 0;
+		int32 IndexNew = 0;
+		while (bWritten && (IndexOld < OldIndex.Num() || IndexNew < Merged.Num()))
+		{
+			Chunk.Reset();
+			while (Chunk.Num() < ChunkSize && (IndexOld < OldIndex.Num() || IndexNew < Merged.Num()))
+			{
+				const bool bTakeNew = IndexOld == OldIndex.Num() || (IndexNew < Merged.Num() && Merged[IndexNew] < OldIndex[IndexOld]);
+				const FSurferRankEntry& Entry = bTakeNew ? Merged[IndexNew++] : OldIndex[IndexOld++];
+				if (Algo::BinarySearch(Removed, Entry) == INDEX_NONE)
+				{
+					Chunk.Add(Entry);
+				}
+			}
+			bWritten = File->Write(reinterpret_cast<const uint8*>(Chunk.GetData()), Chunk.Num() * sizeof(FSurferRankEntry));
+			Header.NumEntries += Chunk.Num();
+		}
+		bWritten = bWritten && File->Seek(0) && File->Write(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+		if (!bWritten || !File->Flush(true))
+		{
+			File.Reset();
+			PlatformFile.DeleteFile(*TempPath);
+			return FString();
+		}
+	}
+
+	PlatformFile.DeleteFile(*Path);
+	return PlatformFile.MoveFile(*Path, *TempPath) ? Path : FString();
+}
+
+FSurferLeaderboardStore::FSurferLeaderboardStore(const FString& InDirectory)
+	: Directory(InDirectory)
+	, LogPath(FPaths::Combine(InDirectory, TEXT("Runs.log")))
+	, NumRecords(0)
+	, IndexedRecords(0)
+{
+}
+
+FSurferLeaderboardStore::~FSurferLeaderboardStore()
+{
+	TryFinishCompaction(true);
+	Flush();
+	UnmapIndex();
+}
+
+/// <summary>
+/// The biggest index that is valid and not ahead of the log wins, anything else in the folder is left over
+/// from a crash or an older compaction. Records after the index are loaded from the log into memory.
+/// </summary>
+/// <returns></returns>
+bool FSurferLeaderboardStore::Open()
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	if (!PlatformFile.CreateDirectoryTree(*Directory))
+	{
+		UE_LOG(LogSurfer, Error, TEXT("Leaderboard can't create %s"), *Directory);
+		return false;
+	}
+
+	//A torn record at the end is from a crash mid write, cut off
+	const int64 LogSize = FMath::Max<int64>(PlatformFile.FileSize(*LogPath), 0);
+	NumRecords = LogSize / sizeof(FSurferRunRecord);
+	LogWriter.Reset(PlatformFile.OpenWrite(*LogPath, true, true));
+	if (!LogWriter || (LogSize != NumRecords * sizeof(FSurferRunRecord) && !LogWriter->Truncate(NumRecords * sizeof(FSurferRunRecord))))
+	{
+		UE_LOG(LogSurfer, Error, TEXT("Leaderboard can't open %s"), *LogPath);
+		return false;
+	}
+
+	TArray<FString> IndexFiles;
+	IFileManager::Get().FindFiles(IndexFiles, *FPaths::Combine(Directory, TEXT("Index_*")), true, false);
+	IndexFiles.Sort([](const FString& A, const FString& B)
+	{
+		return FCString::Strtoui64(*A + 6, nullptr, 10) > FCString::Strtoui64(*B + 6, nullptr, 10);
+	});
+	for (const FString& IndexFile : IndexFiles)
+	{
+		const FString Path = FPaths::Combine(Directory, IndexFile);
+		const bool bUsable = IndexPath.IsEmpty() && IndexFile.EndsWith(TEXT(".bin"))
+			&& FCString::Strtoui64(*IndexFile + 6, nullptr, 10) <= NumRecords && MapIndex(Path);
+		if (!bUsable)
+		{
+			PlatformFile.DeleteFile(*Path);
+		}
+	}
+
+	for (const FSurferRankEntry& Entry : Index)
+	{
+		PlayerBests.Add(Entry.PlayerId, Entry);
+	}
+
+	//Load what the index doesn't have
+	TUniquePtr<IFileHandle> Reader(PlatformFile.OpenRead(*LogPath, true));
+	uint64 Record = IndexedRecords;
+	if (Record < NumRecords && (!Reader || !Reader->Seek(Record * sizeof(FSurferRunRecord))))
+	{
+		UE_LOG(LogSurfer, Error, TEXT("Leaderboard can't read %s"), *LogPath);
+		return false;
+	}
+
+	TArray<FSurferRunRecord> Chunk;
+	while (Record < NumRecords)
+	{
+		Chunk.SetNumUninitialized(static_cast<int32>(FMath::Min<uint64>(NumRecords - Record, 16384)));
+		if (!Reader->Read(reinterpret_cast<uint8*>(Chunk.GetData()), Chunk.Num() * sizeof(FSurferRunRecord)))
+		{
+			UE_LOG(LogSurfer, Error, TEXT("Leaderboard can't read %s"), *LogPath);
+			return false;
+		}
+		for (const FSurferRunRecord& Loaded : Chunk)
+		{
+			AddRun({ Loaded.TimeMicros, Record++, Loaded.PlayerId });
+		}
+	}
+	return true;
+}
+
+bool FSurferLeaderboardStore::MapIndex(const FString& Path)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	const int64 FileSize = PlatformFile.FileSize(*Path);
+	if (FileSize < int64(sizeof(FSurferLeaderboardIndexHeader)))
+	{
+		return false;
+	}
+
+	auto IsValidHeader = [FileSize](const FSurferLeaderboardIndexHeader& Header)
+	{
+		return Header.Magic == LeaderboardIndexMagic && Header.Version == LeaderboardIndexVersion && Header.NumEntries <= uint64(MAX_int32)
+			&& Header.NumEntries <= Header.NumRecords && FileSize == int64(sizeof(Header) + Header.NumEntries * sizeof(FSurferRankEntry));
+	};
+
+	IndexFile.Reset(PlatformFile.OpenMapped(*Path));
+	if (IndexFile)
+	{
+		IndexRegion.Reset(IndexFile->MapRegion(0, FileSize));
+	}
+	if (IndexRegion)
+	{
+		const uint8* Data = IndexRegion->GetMappedPtr();
+		const FSurferLeaderboardIndexHeader& Header = *reinterpret_cast<const FSurferLeaderboardIndexHeader*>(Data);
+		if (!IsValidHeader(Header))
+		{
+			UnmapIndex();
+			return false;
+		}
+		Index = MakeArrayView(reinterpret_cast<const FSurferRankEntry*>(Data + sizeof(Header)), static_cast<int32>(Header.NumEntries));
+		IndexedRecords = Header.NumRecords;
+		IndexPath = Path;
+		return true;
+	}
+
+	//No mapped files on this platform
+	UnmapIndex();
+	TUniquePtr<IFileHandle> File(PlatformFile.OpenRead(*Path));
+	FSurferLeaderboardIndexHeader Header;
+	if (!File || !File->Read(reinterpret_cast<uint8*>(&Header), sizeof(Header)) || !IsValidHeader(Header))
+	{
+		return false;
+	}
+	IndexFallback.SetNumUninitialized(static_cast<int32>(Header.NumEntries));
+	if (!File->Read(reinterpret_cast<uint8*>(IndexFallback.GetData()), IndexFallback.Num() * sizeof(FSurferRankEntry)))
+	{
+		IndexFallback.Empty();
+		return false;
+	}
+	Index = IndexFallback;
+	IndexedRecords = Header.NumRecords;
+	IndexPath = Path;
+	return true;
+}
+
+void FSurferLeaderboardStore::UnmapIndex()
+{
+	Index = TArrayView<const FSurferRankEntry>();
+	IndexRegion.Reset();
+	IndexFile.Reset();
+	IndexFallback.Empty();
+	IndexedRecords = 0;
+	IndexPath.Empty();
+}
+
+template<typename FunctionType>
+void FSurferLeaderboardStore::ForEachSorted(FunctionType Function) const
+{
+	Function(Index);
+	for (const TArray<FSurferRankEntry>& Run : CompactingRuns)
+	{
+		Function(TArrayView<const FSurferRankEntry>(Run));
+	}
+	for (const TArray<FSurferRankEntry>& Run : Runs)
+	{
+		Function(TArrayView<const FSurferRankEntry>(Run));
+	}
+	Function(TArrayView<const FSurferRankEntry>(Delta));
+}
+
+uint64 FSurferLeaderboardStore::GetRank(int64 TimeMicros) const
+{
+	uint64 Faster = 0;
+	ForEachSorted([&Faster, TimeMicros](TArrayView<const FSurferRankEntry> Entries)
+	{
+		Faster += Algo::LowerBoundBy(Entries, TimeMicros, &FSurferRankEntry::TimeMicros);
+	});
+	//Every tombstone is still in one of the sets above
+	Faster -= Algo::LowerBoundBy(Removed, TimeMicros, &FSurferRankEntry::TimeMicros);
+	Faster -= Algo::LowerBoundBy(CompactingRemoved, TimeMicros, &FSurferRankEntry::TimeMicros);
+	return Faster + 1;
+}
+
+bool FSurferLeaderboardStore::IsRemoved(const FSurferRankEntry& Entry) const
+{
+	return Algo::BinarySearch(Removed, Entry) != INDEX_NONE || Algo::BinarySearch(CompactingRemoved, Entry) != INDEX_NONE;
+}
+
+uint64 FSurferLeaderboardStore::Insert(const FSurferRunRecord& Record)
+{
+	TryFinishCompaction(false);
+
+	//Every run goes in the log, even one that isn't ranked
+	const uint64 RecordIndex = NumRecords++;
+	WriteBuffer.Append(reinterpret_cast<const uint8*>(&Record), sizeof(Record));
+	if (WriteBuffer.Num() >= LeaderboardWriteBufferSize)
+	{
+		Flush();
+	}
+
+	const FSurferRankEntry Entry = { Record.TimeMicros, RecordIndex, Record.PlayerId };
+	const FSurferRankEntry* Best = PlayerBests.Find(Record.PlayerId);
+	if (Best && !(Entry < *Best))
+	{
+		return 0;
+	}
+
+	//The player's old best is slower, it isn't counted
+	const uint64 Rank = GetRank(Record.TimeMicros);
+	AddRun(Entry);
+	return Rank;
+}
+
+/// <summary>
+/// A player's faster run replaces their best. The old one is tombstoned instead of taken out of the index or the runs.
+/// </summary>
+/// <param name="Entry"></param>
+/// <returns></returns>
+bool FSurferLeaderboardStore::AddRun(const FSurferRankEntry& Entry)
+{
+	FSurferRankEntry* Best = PlayerBests.Find(Entry.PlayerId);
+	if (Best)
+	{
+		if (!(Entry < *Best))
+		{
+			return false;
+		}
+		Removed.Insert(*Best, Algo::UpperBound(Removed, *Best));
+		*Best = Entry;
+	}
+	else
+	{
+		PlayerBests.Add(Entry.PlayerId, Entry);
+	}
+	AddToMemory(Entry);
+	return true;
+}
+
+/// <summary>
+/// Delta takes sorted inserts until it is full, then becomes a run. Runs are merged while the one before is
+/// not bigger than the last, like carrying in a binary counter, so there are about log2(n / DeltaSize) of them.
+/// </summary>
+/// <param name="Entry"></param>
+void FSurferLeaderboardStore::AddToMemory(const FSurferRankEntry& Entry)
+{
+	Delta.Insert(Entry, Algo::UpperBound(Delta, Entry));
+	if (Delta.Num() < LeaderboardDeltaSize)
+	{
+		return;
+	}
+
+	Runs.Add(MoveTemp(Delta));
+	Delta.Reset(LeaderboardDeltaSize);
+	while (Runs.Num() >= 2 && Runs[Runs.Num() - 2].Num() <= Runs.Last().Num())
+	{
+		TArray<FSurferRankEntry> Merged;
+		MergeSorted(Runs[Runs.Num() - 2], Runs.Last(), Merged);
+		Runs.Pop(false);
+		Runs.Last() = MoveTemp(Merged);
+	}
+
+	int64 InMemory = Removed.Num();
+	for (const TArray<FSurferRankEntry>& Run : Runs)
+	{
+		InMemory += Run.Num();
+	}
+	if (InMemory >= FMath::Max<int64>(CVarLeaderboardCompactAt.GetValueOnAnyThread(), Index.Num() / 8))
+	{
+		StartCompaction();
+	}
+}
+
+void FSurferLeaderboardStore::Flush()
+{
+	if (WriteBuffer.Num() > 0 && LogWriter)
+	{
+		if (!LogWriter->Write(WriteBuffer.GetData(), WriteBuffer.Num()) || !LogWriter->Flush())
+		{
+			UE_LOG(LogSurfer, Error, TEXT("Leaderboard failed writing %s"), *LogPath);
+		}
+		WriteBuffer.Reset();
+	}
+}
+
+void FSurferLeaderboardStore::StartCompaction()
+{
+	if (Compaction.IsValid())
+	{
+		return;
+	}
+
+	//The new index must not point at records that are only in the write buffer
+	Flush();
+
+	CompactingRuns = MoveTemp(Runs);
+	Runs.Reset();
+	if (Delta.Num() > 0)
+	{
+		CompactingRuns.Add(MoveTemp(Delta));
+		Delta.Reset(LeaderboardDeltaSize);
+	}
+	//Every tombstone so far is of an entry that is compacted now
+	CompactingRemoved = MoveTemp(Removed);
+	Removed.Reset();
+	if (CompactingRuns.Num() == 0 && CompactingRemoved.Num() == 0)
+	{
+		return;
+	}
+
+	//Index stays mapped and CompactingRuns and CompactingRemoved untouched until TryFinishCompaction
+	Compaction = Async(EAsyncExecution::ThreadPool,
+		[OldIndex = Index, SortedRuns = &CompactingRuns, Tombstones = &CompactingRemoved, Dir = Directory, Count = NumRecords]()
+		{
+			return WriteMergedIndex(OldIndex, *SortedRuns, *Tombstones, Dir, Count);
+		});
+}
+
+void FSurferLeaderboardStore::WaitForCompaction()
+{
+	TryFinishCompaction(true);
+}
+
+void FSurferLeaderboardStore::TryFinishCompaction(bool bWait)
+{
+	if (!Compaction.IsValid() || (!bWait && !Compaction.IsReady()))
+	{
+		return;
+	}
+
+	const FString NewIndexPath = Compaction.Get();
+	Compaction = TFuture<FString>();
+
+	const FString OldIndexPath = IndexPath;
+	UnmapIndex();
+	if (!NewIndexPath.IsEmpty() && MapIndex(NewIndexPath))
+	{
+		CompactingRuns.Empty();
+		CompactingRemoved.Empty();
+		if (!OldIndexPath.IsEmpty())
+		{
+			FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*OldIndexPath);
+		}
+		return;
+	}
+
+	//Keep serving from the old index and try again with the next compaction
+	UE_LOG(LogSurfer, Error, TEXT("Leaderboard failed writing the index in %s"), *Directory);
+	if (!OldIndexPath.IsEmpty())
+	{
+		MapIndex(OldIndexPath);
+	}
+	CompactingRuns.Append(MoveTemp(Runs));
+	Runs = MoveTemp(CompactingRuns);
+	CompactingRuns.Reset();
+	TArray<FSurferRankEntry> AllRemoved;
+	MergeSorted(CompactingRemoved, Removed, AllRemoved);
+	Removed = MoveTemp(AllRemoved);
+	CompactingRemoved.Reset();
+}
+
+bool FSurferLeaderboardStore::ReadRecord(uint64 Record, FSurferRunRecord& OutRecord)
+{
+	if (!LogReader)
+	{
+		LogReader.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*LogPath, true));
+	}
+	return LogReader && LogReader->Seek(Record * sizeof(FSurferRunRecord))
+		&& LogReader->Read(reinterpret_cast<uint8*>(&OutRecord), sizeof(OutRecord));
+}
+
+void FSurferLeaderboardStore::GetTop(int32 Count, TArray<FSurferRunRecord>& OutRecords)
+{
+	TryFinishCompaction(false);
+	Flush();
+
+	//Best Count of every sorted set contain the best Count overall, plus as many as could be tombstoned
+	const int32 Take = Count + Removed.Num() + CompactingRemoved.Num();
+	TArray<FSurferRankEntry> Best;
+	ForEachSorted([&Best, Take](TArrayView<const FSurferRankEntry> Entries)
+	{
+		Best.Append(Entries.GetData(), FMath::Min(Take, Entries.Num()));
+	});
+	Algo::Sort(Best);
+
+	OutRecords.Reset(FMath::Min(Count, Best.Num()));
+	for (int32 Rank = 0; Rank < Best.Num() && OutRecords.Num() < Count; ++Rank)
+	{
+		FSurferRunRecord Record;
+		if (!IsRemoved(Best[Rank]) && ReadRecord(Best[Rank].Record, Record))
+		{
+			OutRecords.Add(Record);
+		}
+	}
+}
+
+void USurferLeaderboardSubsystem::Deinitialize()
+{
+	Boards.Empty();
+	Super::Deinitialize();
+}
+
+FString USurferLeaderboardSubsystem::GetBoardDirectory(const FString& BoardName)
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Leaderboards"), FPaths::MakeValidFileName(BoardName));
+}
+
+FSurferLeaderboardStore* USurferLeaderboardSubsystem::GetBoard(const FString& BoardName)
+{
+	if (TUniquePtr<FSurferLeaderboardStore>* Found = Boards.Find(BoardName))
+	{
+		return Found->Get();
+	}
+
+	TUniquePtr<FSurferLeaderboardStore> Store = MakeUnique<FSurferLeaderboardStore>(GetBoardDirectory(BoardName));
+	if (!Store->Open())
+	{
+		//Remembered as missing, no retry on every run
+		Store.Reset();
+	}
+	return Boards.Add(BoardName, MoveTemp(Store)).Get();
+}
+
+uint64 USurferLeaderboardSubsystem::SubmitRun(const FString& BoardName, const FSurferRunRecord& Record)
+{
+	FSurferLeaderboardStore* Store = GetBoard(BoardName);
+	if (Store == nullptr)
+	{
+		return 0;
+	}
+
+	const uint64 Rank = Store->Insert(Record);
+	//Runs are rare, don't lose one to a crash
+	Store->Flush();
+	return Rank;
+}
+
+/// <summary>
+/// Scratch board in Saved/Leaderboards, deleted afterwards. Inserts include the rank of the new run and the
+/// compactions they trigger, the reopen is what a server restart with that many runs costs.
+/// Every player has four runs on average, so bests get replaced and tombstoned too.
+/// </summary>
+void USurferLeaderboardSubsystem::Benchmark(int32 Records, int32 Queries)
+{
+	const FString Directory = GetBoardDirectory(TEXT("_Bench"));
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+	FRandomStream Stream(340);
+	//Run times around a minute, most a bit slower than the best
+	auto RandomTime = [&Stream]()
+	{
+		return 45.0 + FMath::Square(Stream.FRand()) * 60.0;
+	};
+
+	const int32 Players = FMath::Max(1, Records / 4);
+	double InsertSeconds, CompactSeconds, OpenSeconds, RankSeconds, TopSeconds;
+	uint64 RankSum = 0;
+	{
+		FSurferLeaderboardStore Store(Directory);
+		if (!Store.Open())
+		{
+			return;
+		}
+
+		FSurferRunRecord Record = FSurferRunRecord::Make(0.0, TEXT("Bench"), TEXT("Bench"));
+		double StartTime = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < Records; ++Index)
+		{
+			Record.TimeMicros = static_cast<int64>(RandomTime() * 1.0e6);
+			Record.PlayerId = Index % Players;
+			RankSum += Store.Insert(Record);
+		}
+		InsertSeconds = FPlatformTime::Seconds() - StartTime;
+
+		StartTime = FPlatformTime::Seconds();
+		Store.StartCompaction();
+		Store.WaitForCompaction();
+		CompactSeconds = FPlatformTime::Seconds() - StartTime;
+	}
+
+	TArray<FSurferRunRecord> Top;
+	uint64 NumIndexed = 0;
+	uint64 NumRanked = 0;
+	bool bOpened;
+	{
+		FSurferLeaderboardStore Store(Directory);
+		double StartTime = FPlatformTime::Seconds();
+		bOpened = Store.Open();
+		OpenSeconds = FPlatformTime::Seconds() - StartTime;
+		NumIndexed = Store.GetNumIndexed();
+		NumRanked = Store.Num();
+
+		StartTime = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < Queries; ++Index)
+		{
+			RankSum += Store.GetRank(static_cast<int64>(RandomTime() * 1.0e6));
+		}
+		RankSeconds = FPlatformTime::Seconds() - StartTime;
+
+		StartTime = FPlatformTime::Seconds();
+		Store.GetTop(100, Top);
+		TopSeconds = FPlatformTime::Seconds() - StartTime;
+	}
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+	//One entry per player in the top as well
+	TSet<uint64> TopPlayers;
+	for (const FSurferRunRecord& Record : Top)
+	{
+		TopPlayers.Add(Record.PlayerId);
+	}
+	const bool bTopRight = Algo::IsSortedBy(Top, &FSurferRunRecord::TimeMicros) && TopPlayers.Num() == Top.Num()
+		&& Top.Num() == FMath::Min(Players, 100) && NumRanked == uint64(Players);
+	UE_LOG(LogSurfer, Display, TEXT("move.BenchLeaderboard %d runs of %d players: %.0f inserts/sec, final compaction %.1f ms, reopen %.1f ms (%llu indexed%s), %.0f ranks/sec, top 100 in %.3f ms%s (%llu)"),
+		Records, Players, Records / FMath::Max(InsertSeconds, 1e-9), CompactSeconds * 1000.0, OpenSeconds * 1000.0,
+		NumIndexed, bOpened ? TEXT("") : TEXT(", FAILED"),
+		Queries / FMath::Max(RankSeconds, 1e-9), TopSeconds * 1000.0,
+		bTopRight ? TEXT("") : TEXT(" WRONG"), RankSum);
+}
@@ -0,0 +1,170 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "SurferLeaderboard.generated.h"
+
+class IFileHandle;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+//One finished run as it is stored in the log, fixed size so record N is at N * sizeof
+struct FSurferRunRecord
+{
+	int64 TimeMicros;
+	//FDateTime ticks, UTC
+	int64 DateTicks;
+	//Hash of the unique net id
+	uint64 PlayerId;
+	//UTF-8, cut to fit
+	ANSICHAR PlayerName[40];
+
+	static FSurferRunRecord Make(double RunTime, const FString& Name, const FString& UniqueId);
+
+	FString GetPlayerName() const;
+	double GetTime() const {
+		return TimeMicros / 1.0e6;
+	}
+};
+static_assert(sizeof(FSurferRunRecord) == 64, "Run records are read from the log by offset");
+
+//Rank order of a record, by time and then by record so the earlier of two equal runs is ahead
+struct FSurferRankEntry
+{
+	int64 TimeMicros;
+	uint64 Record;
+	//Same as the record's, so the best of every player is known without reading the log
+	uint64 PlayerId;
+
+	bool operator<(const FSurferRankEntry& Other) const {
+		return TimeMicros != Other.TimeMicros ? TimeMicros < Other.TimeMicros : Record < Other.Record;
+	}
+};
+
+/* Leaderboard of one map and style, no database needed.
+* Runs.log is the append only list of run records, nothing in it is ever rewritten.
+* Only the best run of every player is ranked, the others stay in the log as history.
+* Index_<N>.bin is the sorted rank order of the ranked runs among the first N records and is memory mapped, a rank is a binary search in it.
+* Newer records wait in memory in a few sorted runs (merged like a binary counter so there are only log(n) of them),
+* once they grow past move.LeaderboardCompactAt or an eighth of the index they are merged into the next index file
+* on a worker thread. A player's old best that a new one replaces stays where it is with a sorted tombstone,
+* ranks subtract the tombstones and the next compaction leaves them out.
+* Only the new records are merged in, and the log is the truth: a lost index is rebuilt from it.
+*/
+class SPEEDGAM340_API FSurferLeaderboardStore
+{
+public:
+	explicit FSurferLeaderboardStore(const FString& InDirectory);
+	~FSurferLeaderboardStore();
+
+	//Opens or creates the files, loads the records the index doesn't have yet
+	bool Open();
+
+	//Appends the run and returns its rank, 1 is the best. 0 if the player already has a run at least as fast
+	uint64 Insert(const FSurferRunRecord& Record);
+
+	//1 + ranked runs strictly faster than TimeMicros
+	uint64 GetRank(int64 TimeMicros) const;
+
+	//Best Count players, best first
+	void GetTop(int32 Count, TArray<FSurferRunRecord>& OutRecords);
+
+	//Ranked runs, one per player
+	uint64 Num() const {
+		return PlayerBests.Num();
+	}
+
+	//Every run in the log
+	uint64 GetNumRuns() const {
+		return NumRecords;
+	}
+
+	uint64 GetNumIndexed() const {
+		return Index.Num();
+	}
+
+	//Writes buffered records to the log
+	void Flush();
+
+	//Merges everything not indexed yet into a new index, on a worker thread
+	void StartCompaction();
+	//Blocks until a running compaction is done and its index is in use
+	void WaitForCompaction();
+
+private:
+	//Ranks the run if it is the best of its player, returns false if it isn't
+	bool AddRun(const FSurferRankEntry& Entry);
+	void AddToMemory(const FSurferRankEntry& Entry);
+	bool IsRemoved(const FSurferRankEntry& Entry) const;
+	void TryFinishCompaction(bool bWait);
+	bool MapIndex(const FString& Path);
+	void UnmapIndex();
+	bool ReadRecord(uint64 Record, FSurferRunRecord& OutRecord);
+
+	//Calls Function with every sorted set of entries: index, compacting, in memory
+	template<typename FunctionType>
+	void ForEachSorted(FunctionType Function) const;
+
+	FString Directory;
+	FString LogPath;
+	FString IndexPath;
+
+	TUniquePtr<IFileHandle> LogWriter;
+	TUniquePtr<IFileHandle> LogReader;
+	TArray<uint8> WriteBuffer;
+	uint64 NumRecords;
+
+	//Region has to go before the file
+	TUniquePtr<IMappedFileHandle> IndexFile;
+	TUniquePtr<IMappedFileRegion> IndexRegion;
+	//Platforms without mapped files read the index in
+	TArray<FSurferRankEntry> IndexFallback;
+	TArrayView<const FSurferRankEntry> Index;
+	//Records the index was built from, the ones after it are loaded from the log
+	uint64 IndexedRecords;
+
+	//Best run of every player, by the hash of the unique net id
+	TMap<uint64, FSurferRankEntry> PlayerBests;
+	//Sorted tombstones of replaced bests, and the ones the running compaction leaves out
+	TArray<FSurferRankEntry> Removed;
+	TArray<FSurferRankEntry> CompactingRemoved;
+
+	//Newest records, small so sorted inserts are cheap
+	TArray<FSurferRankEntry> Delta;
+	//Sorted runs of older records, biggest first
+	TArray<TArray<FSurferRankEntry>> Runs;
+	//Runs being merged into the next index, read only until it is done
+	TArray<TArray<FSurferRankEntry>> CompactingRuns;
+	//Path of the new index, empty if writing it failed
+	TFuture<FString> Compaction;
+};
+
+/* Run leaderboards of the server, one store per map and style, opened on first use.
+* Files are in Saved/Leaderboards/<Board>.
+*/
+UCLASS()
+class SPEEDGAM340_API USurferLeaderboardSubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	//Store of the board, nullptr if its files can't be opened
+	FSurferLeaderboardStore* GetBoard(const FString& BoardName);
+
+	//Adds the run to the board and writes it out, returns its rank.
+	//0 if the board isn't available or the player already has a run at least as fast on it
+	uint64 SubmitRun(const FString& BoardName, const FSurferRunRecord& Record);
+
+	static FString GetBoardDirectory(const FString& BoardName);
+
+	//Times inserts and rank queries, move.BenchLeaderboard
+	static void Benchmark(int32 Records, int32 Queries);
+
+private:
+	TMap<FString, TUniquePtr<FSurferLeaderboardStore>> Boards;
+};
@@ -0,0 +1,190 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferMoveValidator.h"
+
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectIterator.h"
+
+#include "SpeedGam340.h"
+#include "SurferMovementComponent.h"
+
+static TAutoConsoleVariable<int32> CVarAntiCheat(TEXT("move.AntiCheat"), 1, TEXT("Server checks client moves for impossible air acceleration, perfect strafes and a fast clock\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarAntiCheatTolerance(TEXT("move.AntiCheatTolerance"), 0.25f, TEXT("Part of the maximum air gain a move may go over before it is flagged\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarAntiCheatSlack(TEXT("move.AntiCheatSlack"), 5000.0f, TEXT("Energy (u^2/s^2) every move may gain on top, for float error and depenetration\n"), ECVF_Default);
+static TAutoConsoleVariable<int32> CVarAntiCheatStrafeWindow(TEXT("move.AntiCheatStrafeWindow"), 2048, TEXT("Air strafe ticks the strafe averages cover, and how many are needed before flagging\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarAntiCheatSync(TEXT("move.AntiCheatSync"), 0.98f, TEXT("Average turn and strafe sync above which strafing counts as scripted\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarAntiCheatWindow(TEXT("move.AntiCheatWindow"), 10.0f, TEXT("Seconds of server time the client move time is compared over\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarAntiCheatClock(TEXT("move.AntiCheatClock"), 0.05f, TEXT("Part the client clock may run ahead of the server over a window\n"), ECVF_Default);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Surfer moves validated"), STAT_SurferMovesValidated, STATGROUP_Character);
+
+static FString GetPlayerName(const USurferMovementComponent& Movement)
+{
+	const ACharacter* Character = Movement.GetCharacterOwner();
+	const APlayerState* PlayerState = Character ? Character->GetPlayerState() : nullptr;
+	return PlayerState ? PlayerState->GetPlayerName() : GetNameSafe(Character);
+}
+
+//Checked players of the world, e.g. "move.AntiCheatReport"
+static void AntiCheatReportForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	for (TObjectIterator<USurferMovementComponent> It; It; ++It)
+	{
+		if (It->GetWorld() == World && !It->IsTemplate())
+		{
+			It->GetMoveValidator().LogReport(GetPlayerName(**It));
+		}
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdAntiCheatReport(
+	TEXT("move.AntiCheatReport"),
+	TEXT("Log the move validation numbers of every player\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&AntiCheatReportForWorld));
+
+bool FSurferMoveValidator::ShouldValidate(const USurferMovementComponent& Movement)
+{
+	const ACharacter* Character = Movement.GetCharacterOwner();
+	return CVarAntiCheat.GetValueOnGameThread() != 0 && Character
+		&& Character->GetLocalRole() == ROLE_Authority && Character->GetRemoteRole() == ROLE_AutonomousProxy;
+}
+
+float FSurferMoveValidator::GetMaxAirSpeedSquaredGain(float AirSpeedCap, float Acceleration, float AccelerationMultiplier, float DeltaTime, int32 Substeps)
+{
+	Substeps = FMath::Max(Substeps, 1);
+	const float Added = FMath::Min(Acceleration * AccelerationMultiplier * DeltaTime / Substeps, AirSpeedCap);
+	return Substeps * (2.0f * AirSpeedCap * Added - Added * Added);
+}
+
+static double GetEnergy(const USurferMovementComponent& Movement)
+{
+	return 0.5 * Movement.Velocity.SizeSquared() - double(Movement.GetGravityZ()) * Movement.GetActorFeetLocation().Z;
+}
+
+void FSurferMoveValidator::BeginMove(const USurferMovementComponent& Movement, float DeltaTime, bool bSkipEnergy)
+{
+	bCheckEnergy = !bSkipEnergy && Movement.MovementMode == MOVE_Falling;
+	StartEnergy = GetEnergy(Movement);
+	StartLocation = Movement.GetActorFeetLocation();
+	StartSpeed = Movement.Velocity.Size();
+}
+
+/// <summary>
+/// Only falling to falling moves are judged, landing, walking and jumping have their own speed sources.
+/// Moves that went further than their velocity explains were teleports.
+/// </summary>
+void FSurferMoveValidator::EndMove(const USurferMovementComponent& Movement, float DeltaTime, bool bTouchedSurface)
+{
+	INC_DWORD_STAT(STAT_SurferMovesValidated);
+	CheckClock(Movement, DeltaTime);
+
+	if (!bCheckEnergy || Movement.MovementMode != MOVE_Falling || DeltaTime <= 0.0f)
+	{
+		return;
+	}
+
+	const FVector EndLocation = Movement.GetActorFeetLocation();
+	const float MaxDistance = (StartSpeed + Movement.Velocity.Size()) * DeltaTime + 100.0f;
+	if (FVector::DistSquared(StartLocation, EndLocation) > FMath::Square(MaxDistance))
+	{
+		return;
+	}
+
+	//The substeps the movement was allowed for this move
+	const FSurferMovementTuning& Tuning = Movement.GetMovementTuning();
+	const int32 Substeps = FMath::CeilToInt(DeltaTime / FMath::Max(Movement.MaxSimulationTimeStep, UCharacterMovementComponent::MIN_TICK_TIME));
+	const float Acceleration = FMath::Min(Movement.GetMaxAcceleration(), Movement.GetMaxSpeed());
+	const double MaxGain = 0.5 * GetMaxAirSpeedSquaredGain(Tuning.AirSpeedCap, Acceleration, Tuning.AirAccelerationMultiplier, DeltaTime, Substeps);
+	const double Gain = GetEnergy(Movement) - StartEnergy;
+
+	++MovesChecked;
+	const float Ratio = MaxGain > 0.0 ? float(Gain / MaxGain) : 0.0f;
+	if (Gain > MaxGain * (1.0f + CVarAntiCheatTolerance.GetValueOnGameThread()) + CVarAntiCheatSlack.GetValueOnGameThread())
+	{
+		//Every violation counts, the log only gets the first and then every 100th
+		if (EnergyViolations++ % 100 == 0)
+		{
+			UE_LOG(LogSurfer, Warning, TEXT("AntiCheat %s: air move gained %.0f energy, at most %.0f possible (%d violations in %d moves)"),
+				*GetPlayerName(Movement), Gain, MaxGain, EnergyViolations, MovesChecked);
+		}
+		WorstEnergyRatio = FMath::Max(WorstEnergyRatio, Ratio);
+	}
+
+	//Strafing in free air, turning one way and accelerating sideways
+	const FVector CurrentAcceleration = Movement.GetCurrentAcceleration();
+	const ACharacter* Character = Movement.GetCharacterOwner();
+	const float Yaw = Character->GetControlRotation().Yaw;
+	const float YawDelta = bHasLastYaw ? FRotator::NormalizeAxis(Yaw - LastYaw) : 0.0f;
+	LastYaw = Yaw;
+	bHasLastYaw = true;
+
+	const float Side = CurrentAcceleration | FRotationMatrix(FRotator(0.0f, Yaw, 0.0f)).GetUnitAxis(EAxis::Y);
+	if (bTouchedSurface || MaxGain <= 0.0 || FMath::Abs(YawDelta) < 0.01f || FMath::Abs(Side) < KINDA_SMALL_NUMBER)
+	{
+		return;
+	}
+
+	const int32 Window = FMath::Max(CVarAntiCheatStrafeWindow.GetValueOnGameThread(), 16);
+	const float Alpha = 1.0f / FMath::Min(StrafeSamples + 1, Window);
+	const float Efficiency = FMath::Clamp(Ratio, -1.0f, 1.0f);
+	++StrafeSamples;
+	SyncAverage += (((YawDelta > 0.0f) == (Side > 0.0f) ? 1.0f : 0.0f) - SyncAverage) * Alpha;
+	EfficiencyAverage += (Efficiency - EfficiencyAverage) * Alpha;
+	EfficiencySquaredAverage += (Efficiency * Efficiency - EfficiencySquaredAverage) * Alpha;
+
+	const float Deviation = FMath::Sqrt(FMath::Max(EfficiencySquaredAverage - EfficiencyAverage * EfficiencyAverage, 0.0f));
+	const bool bScripted = StrafeSamples >= Window && SyncAverage >= CVarAntiCheatSync.GetValueOnGameThread()
+		&& EfficiencyAverage > 0.9f && Deviation < 0.03f;
+	if (bScripted && !bStrafeFlagged)
+	{
+		UE_LOG(LogSurfer, Warning, TEXT("AntiCheat %s: strafes look scripted, sync %.1f%%, gain %.1f%% +- %.1f%% of the maximum over %d ticks"),
+			*GetPlayerName(Movement), SyncAverage * 100.0f, EfficiencyAverage * 100.0f, Deviation * 100.0f, StrafeSamples);
+	}
+	bStrafeFlagged = bScripted;
+}
+
+/// <summary>
+/// Moves carry the client's delta time, a sped up client sends more of it than the server sees go by.
+/// Hitches and packet bunching even out over the window.
+/// </summary>
+void FSurferMoveValidator::CheckClock(const USurferMovementComponent& Movement, float DeltaTime)
+{
+	const double Now = Movement.GetWorld()->GetRealTimeSeconds();
+	if (WindowStart < 0.0)
+	{
+		WindowStart = Now;
+		ClientTime = 0.0;
+		return;
+	}
+
+	ClientTime += DeltaTime;
+	const double Elapsed = Now - WindowStart;
+	if (Elapsed < CVarAntiCheatWindow.GetValueOnGameThread())
+	{
+		return;
+	}
+
+	const float Ratio = float(ClientTime / Elapsed);
+	if (Ratio > 1.0f + CVarAntiCheatClock.GetValueOnGameThread())
+	{
+		++ClockViolations;
+		WorstClockRatio = FMath::Max(WorstClockRatio, Ratio);
+		UE_LOG(LogSurfer, Warning, TEXT("AntiCheat %s: client clock ran at %.1f%% of the server over %.1f s"),
+			*GetPlayerName(Movement), Ratio * 100.0f, Elapsed);
+	}
+	WindowStart = Now;
+	ClientTime = 0.0;
+}
+
+void FSurferMoveValidator::LogReport(const FString& PlayerName) const
+{
+	const float Deviation = FMath::Sqrt(FMath::Max(EfficiencySquaredAverage - EfficiencyAverage * EfficiencyAverage, 0.0f));
+	UE_LOG(LogSurfer, Display, TEXT("AntiCheat %s: %d air moves, %d over the limit (worst %.2fx) | strafe sync %.1f%%, gain %.1f%% +- %.1f%% over %d ticks%s | clock %d windows ahead (worst %.1f%%)"),
+		*PlayerName, MovesChecked, EnergyViolations, WorstEnergyRatio,
+		SyncAverage * 100.0f, EfficiencyAverage * 100.0f, Deviation * 100.0f, StrafeSamples, bStrafeFlagged ? TEXT(" FLAGGED") : TEXT(""),
+		ClockViolations, WorstClockRatio * 100.0f);
+}
@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class USurferMovementComponent;
+
+/* Server side checks of the moves a client sends, a few dozen bytes per player whatever the play time.
+*
+* Energy: in the air, with gravity in the energy, only air acceleration can add speed. CalcVelocity adds at most
+* k = min(AddSpeed, |Accel| * AirAccelerationMulitplier * dt) along the wish direction with AddSpeed = AirSpeedCap - v.wishdir,
+* so |v|^2 grows by at most 2 * AirSpeedCap * k - k^2 per substep, however the client turns. Moves gaining more are flagged.
+*
+* Strafe sync: how much of that maximum a move actually got and whether turning and strafing go the same way are
+* kept as exponential averages. Humans wobble, scripts sit at the maximum with perfect sync for thousands of ticks.
+*
+* Clock: client move time summed against server time over move.AntiCheatWindow, speedhacks run ahead of it.
+*/
+struct FSurferMoveValidator
+{
+	//Server running a move of a remote client with move.AntiCheat on
+	static bool ShouldValidate(const USurferMovementComponent& Movement);
+
+	//Before the move, bSkipEnergy for moves with a launch or noclip
+	void BeginMove(const USurferMovementComponent& Movement, float DeltaTime, bool bSkipEnergy);
+	//After the move, bTouchedSurface if it hit anything
+	void EndMove(const USurferMovementComponent& Movement, float DeltaTime, bool bTouchedSurface);
+
+	void LogReport(const FString& PlayerName) const;
+
+	//Moves over the energy limit and clock windows ahead so far
+	int32 GetNumViolations() const {
+		return EnergyViolations + ClockViolations;
+	}
+
+	//Strafing looks scripted right now
+	bool IsStrafeFlagged() const {
+		return bStrafeFlagged;
+	}
+
+	//Most |v|^2 the air acceleration can add in DeltaTime split into Substeps
+	static float GetMaxAirSpeedSquaredGain(float AirSpeedCap, float Acceleration, float AccelerationMultiplier, float DeltaTime, int32 Substeps);
+
+private:
+	void CheckClock(const USurferMovementComponent& Movement, float DeltaTime);
+
+	//State before the move
+	double StartEnergy = 0.0;
+	FVector StartLocation = FVector::ZeroVector;
+	float StartSpeed = 0.0f;
+	bool bCheckEnergy = false;
+
+	float LastYaw = 0.0f;
+	bool bHasLastYaw = false;
+
+	//Energy
+	int32 MovesChecked = 0;
+	int32 EnergyViolations = 0;
+	float WorstEnergyRatio = 0.0f;
+
+	//Strafing, exponential averages over about move.AntiCheatStrafeWindow samples
+	int32 StrafeSamples = 0;
+	float SyncAverage = 0.0f;
+	float EfficiencyAverage = 0.0f;
+	float EfficiencySquaredAverage = 0.0f;
+	bool bStrafeFlagged = false;
+
+	//Clock
+	double ClientTime = 0.0;
+	double WindowStart = -1.0;
+	int32 ClockViolations = 0;
+	float WorstClockRatio = 0.0f;
+};
@@ -0,0 +1,174 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferMovementBudget.h"
+
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/IConsoleManager.h"
+
+#include "SpeedGam340.h"
+
+static TAutoConsoleVariable<float> CVarMovementFrameBudget(TEXT("move.FrameBudgetMs"), 2.0f, TEXT("Milliseconds all surfer movement may take per frame before the governor steps in, 0 for no budget\n"), ECVF_Default);
+static TAutoConsoleVariable<int32> CVarGovernor(TEXT("move.Governor"), 1, TEXT("Throttle surfer substeps, proxy extrapolation, replication rates and debug output when over the frame budgets\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarTickBudget(TEXT("move.TickBudgetMs"), 0.0f, TEXT("Game thread milliseconds per server frame before the governor steps in, 0 for 90% of the NetServerMaxTickRate frame\n"), ECVF_Default);
+static TAutoConsoleVariable<int32> CVarGovernorRaiseFrames(TEXT("move.GovernorRaiseFrames"), 2, TEXT("Frames in a row over budget before the throttle level goes up, one slow frame is a hitch\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarGovernorCooldown(TEXT("move.GovernorCooldown"), 2.0f, TEXT("Seconds clearly under budget before the throttle level goes down again\n"), ECVF_Default);
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Surfer movement throttle level"), STAT_SurferThrottleLevel, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Surfers throttled"), STAT_SurferThrottled, STATGROUP_Character);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Surfer movement ms"), STAT_SurferMovementMs, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Surfer falling iterations"), STAT_SurferFallingIterations, STATGROUP_Character);
+
+//Who got throttled and how often, e.g. "move.BudgetReport"
+static void BudgetReportForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	if (const USurferMovementBudget* Budget = World ? World->GetSubsystem<USurferMovementBudget>() : nullptr)
+	{
+		Budget->LogReport();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdBudgetReport(
+	TEXT("move.BudgetReport"),
+	TEXT("Log the governor state and the surfers that had their replication rate throttled\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BudgetReportForWorld));
+
+TStatId USurferMovementBudget::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USurferMovementBudget, STATGROUP_Tickables);
+}
+
+void USurferMovementBudget::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+	LogoutHandle = FGameModeEvents::GameModeLogoutEvent.AddUObject(this, &USurferMovementBudget::HandleLogout);
+}
+
+void USurferMovementBudget::Deinitialize()
+{
+	FGameModeEvents::GameModeLogoutEvent.Remove(LogoutHandle);
+	ThrottledFrames.Empty();
+	Super::Deinitialize();
+}
+
+void USurferMovementBudget::HandleLogout(AGameModeBase* GameMode, AController* Exiting)
+{
+	ThrottledFrames.Remove(Exiting);
+}
+
+void USurferMovementBudget::ReportThrottled(const APawn* Pawn)
+{
+	++ThrottledThisFrame;
+	//Keyed by controller, so a player keeps its count across respawns and it goes away on logout
+	AController* Controller = Pawn ? Pawn->GetController() : nullptr;
+	if (Controller == nullptr)
+	{
+		return;
+	}
+
+	ThrottledFrames.FindOrAdd(Controller)++;
+}
+
+float USurferMovementBudget::GetTickBudgetMs() const
+{
+	const float TickBudgetMs = CVarTickBudget.GetValueOnGameThread();
+	if (TickBudgetMs != 0.0f)
+	{
+		return TickBudgetMs;
+	}
+
+	//Clients and standalone have no fixed tick rate, only the movement budget applies there
+	const UWorld* World = GetWorld();
+	const UNetDriver* NetDriver = World && World->GetNetMode() != NM_Client ? World->GetNetDriver() : nullptr;
+	return NetDriver && NetDriver->NetServerMaxTickRate > 0 ? 900.0f / NetDriver->NetServerMaxTickRate : 0.0f;
+}
+
+/// <summary>
+/// Runs after all actors ticked, so FrameCycles is the whole frame of movement.
+/// GGameThreadTime is the last finished game thread frame, the sleep of the tick rate cap is not in it.
+/// Up after a few frames over, down only after a while clearly under so it doesn't flip every frame.
+/// </summary>
+/// <param name="DeltaTime"></param>
+void USurferMovementBudget::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	const float BudgetMs = CVarMovementFrameBudget.GetValueOnGameThread();
+	const float TickBudgetMs = GetTickBudgetMs();
+	const double UsedMs = FPlatformTime::ToMilliseconds64(FrameCycles);
+	const float GameThreadMs = FPlatformTime::ToMilliseconds(GGameThreadTime);
+	const int32 OldThrottleLevel = ThrottleLevel;
+
+	const bool bMovementOver = BudgetMs > 0.0f && UsedMs > BudgetMs;
+	const bool bTickOver = TickBudgetMs > 0.0f && GameThreadMs > TickBudgetMs;
+	const bool bUnder = (BudgetMs <= 0.0f || UsedMs < BudgetMs * 0.5) && (TickBudgetMs <= 0.0f || GameThreadMs < TickBudgetMs * 0.7f);
+	OverFrames = bMovementOver || bTickOver ? OverFrames + 1 : 0;
+	UnderTime = bUnder ? UnderTime + DeltaTime : 0.0f;
+
+	if (CVarGovernor.GetValueOnGameThread() == 0 || (BudgetMs <= 0.0f && TickBudgetMs <= 0.0f))
+	{
+		ThrottleLevel = 0;
+	}
+	else if (OverFrames >= FMath::Max(CVarGovernorRaiseFrames.GetValueOnGameThread(), 1))
+	{
+		ThrottleLevel = FMath::Min(ThrottleLevel + 1, MaxThrottleLevel);
+		OverFrames = 0;
+	}
+	else if (UnderTime >= CVarGovernorCooldown.GetValueOnGameThread())
+	{
+		ThrottleLevel = FMath::Max(ThrottleLevel - 1, 0);
+		UnderTime = 0.0f;
+	}
+
+	if (ThrottleLevel != OldThrottleLevel)
+	{
+		++LevelChanges;
+		UE_LOG(LogSurfer, Log, TEXT("Governor level %d -> %d (%s): movement %.2f of %.2f ms, game thread %.2f of %.2f ms, %d falling iterations. Substeps 1/%d, dead reckoning %s, fast net rate x%.2f, debug %s"),
+			OldThrottleLevel, ThrottleLevel,
+			ThrottleLevel > OldThrottleLevel ? (bMovementOver ? TEXT("movement over") : TEXT("frame over")) : TEXT("under budget"),
+			UsedMs, BudgetMs, GameThreadMs, TickBudgetMs, FallingIterations,
+			1 << ThrottleLevel, AllowDeadReckoning() ? TEXT("on") : TEXT("off"), GetNetRateScale(), AllowDebugFeatures() ? TEXT("on") : TEXT("off"));
+	}
+
+	SET_DWORD_STAT(STAT_SurferThrottleLevel, ThrottleLevel);
+	SET_DWORD_STAT(STAT_SurferThrottled, ThrottledThisFrame);
+	SET_FLOAT_STAT(STAT_SurferMovementMs, UsedMs);
+	SET_DWORD_STAT(STAT_SurferFallingIterations, FallingIterations);
+
+	//Booked on the level the frame ran at, before this tick changed it
+	++LevelFrames[OldThrottleLevel];
+	LevelFallingIterations[OldThrottleLevel] += FallingIterations;
+	LevelMovementMs[OldThrottleLevel] += UsedMs;
+	TotalFallingIterations += FallingIterations;
+
+	FrameCycles = 0;
+	FallingIterations = 0;
+	ThrottledThisFrame = 0;
+}
+
+void USurferMovementBudget::LogReport() const
+{
+	UE_LOG(LogSurfer, Display, TEXT("Surfer movement budget %.2f ms, tick budget %.2f ms, throttle level %d after %d changes, %d players throttled so far"),
+		CVarMovementFrameBudget.GetValueOnGameThread(), GetTickBudgetMs(), ThrottleLevel, LevelChanges, ThrottledFrames.Num());
+	for (int32 Level = 0; Level <= MaxThrottleLevel; ++Level)
+	{
+		if (LevelFrames[Level] > 0)
+		{
+			UE_LOG(LogSurfer, Display, TEXT("  level %d: %d frames, %.1f falling iterations and %.3f movement ms per frame"),
+				Level, LevelFrames[Level], double(LevelFallingIterations[Level]) / LevelFrames[Level], LevelMovementMs[Level] / LevelFrames[Level]);
+		}
+	}
+	for (const TPair<TWeakObjectPtr<AController>, int32>& Entry : ThrottledFrames)
+	{
+		const AController* Controller = Entry.Key.Get();
+		if (Controller != nullptr)
+		{
+			UE_LOG(LogSurfer, Display, TEXT("  %s: %d frames"), Controller->PlayerState ? *Controller->PlayerState->GetPlayerName() : *Controller->GetName(), Entry.Value);
+		}
+	}
+}
@@ -0,0 +1,112 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SurferMovementBudget.generated.h"
+
+class AController;
+class AGameModeBase;
+class APawn;
+
+/* Frame budget governor for surfer movement.
+* Every surfer adds the time its PerformMovement took and the PhysFalling iterations it ran, at the end of the frame
+* the movement time is compared to move.FrameBudgetMs and the game thread time to the server tick budget.
+* Over either for a couple of frames raises the throttle level, clearly under both for move.GovernorCooldown seconds
+* lowers it again, so a slow frame doesn't make the next one slower with more substeps. The substeps are predicted:
+* every surfer replicates the level to its owner (SimulationThrottle) and both sides cut them the same way. Per level:
+* 1: half the substeps, no movement debug display, simulated proxies go back to the engine's straight line (no dead reckoning)
+* 2: quarter substeps, replication rates of fast surfers halved (USurferNetPolicy)
+* 3: eighth substeps, replication rates quartered
+* Every change is logged with what caused it. Throttled players are counted so we can see who paid for a hitch,
+* and every level keeps the falling iterations and movement time of its frames (move.BudgetReport).
+*/
+UCLASS()
+class SPEEDGAM340_API USurferMovementBudget : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//Time spent in one PerformMovement
+	void AddMovementTime(uint64 Cycles) {
+		FrameCycles += Cycles;
+	}
+
+	//One PhysFalling iteration ran
+	void AddFallingIteration() {
+		++FallingIterations;
+	}
+
+	//0 is no throttling, every level halves the substeps a surfer may take
+	int32 GetThrottleLevel() const {
+		return ThrottleLevel;
+	}
+
+	//Multiplier for the replication rate of fast surfers
+	float GetNetRateScale() const {
+		return ThrottleLevel >= 2 ? 1.0f / (1 << (ThrottleLevel - 1)) : 1.0f;
+	}
+
+	//On screen movement debug output
+	bool AllowDebugFeatures() const {
+		return ThrottleLevel == 0;
+	}
+
+	//Curved extrapolation of simulated proxies, with its ramp sweep per update
+	bool AllowDeadReckoning() const {
+		return ThrottleLevel == 0;
+	}
+
+	//Throttle level changes so far, for the soak report
+	int32 GetLevelChanges() const {
+		return LevelChanges;
+	}
+
+	//PhysFalling iterations of all finished frames so far, for the soak report
+	uint64 GetTotalFallingIterations() const {
+		return TotalFallingIterations;
+	}
+
+	//Surfer got replicated less often than its speed asked for
+	void ReportThrottled(const APawn* Pawn);
+
+	//Logs throttled players and how often, move.BudgetReport
+	void LogReport() const;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	static constexpr int32 MaxThrottleLevel = 3;
+
+private:
+	//Tick budget of the server in ms, move.TickBudgetMs or from the net driver tick rate
+	float GetTickBudgetMs() const;
+
+	//Player left, its throttle count goes with it
+	void HandleLogout(AGameModeBase* GameMode, AController* Exiting);
+
+	uint64 FrameCycles = 0;
+	int32 FallingIterations = 0;
+	uint64 TotalFallingIterations = 0;
+	int32 ThrottleLevel = 0;
+	int32 ThrottledThisFrame = 0;
+	int32 LevelChanges = 0;
+	//Frames over budget in a row, and seconds under it
+	int32 OverFrames = 0;
+	float UnderTime = 0.0f;
+
+	//Frames run at each throttle level, with their falling iterations and movement time
+	int32 LevelFrames[MaxThrottleLevel + 1] = {};
+	uint64 LevelFallingIterations[MaxThrottleLevel + 1] = {};
+	double LevelMovementMs[MaxThrottleLevel + 1] = {};
+
+	//Player -> frames throttled, removed on logout
+	TMap<TWeakObjectPtr<AController>, int32> ThrottledFrames;
+	FDelegateHandle LogoutHandle;
+};
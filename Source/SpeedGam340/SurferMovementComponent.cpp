@@ -7,18 +7,45 @@
 #include "Components/CapsuleComponent.h"
 #include "Engine/Engine.h"
 #include "Engine/World.h"
+#include "EngineUtils.h"
 #include "GameFramework/Character.h"
 #include "HAL/IConsoleManager.h"
 #include "Kismet/GameplayStatics.h"
+#include "Net/UnrealNetwork.h"
 #include "PhysicalMaterials/PhysicalMaterial.h"
 #include "PhysicsEngine/PhysicsSettings.h"
+#include "Serialization/ArchiveCountMem.h"
 #include "Sound/SoundCue.h"
+#include "UObject/UObjectIterator.h"
 
+#include "SpeedGam340.h"
 #include "SurferCharacter.h"
+#include "SurferMovementBudget.h"
+#include "SurferSoakStats.h"
+#include "SurferZoneSubsystem.h"
 
 //Debug stuff
 //static TAutoConsoleVariable<int32> CVarShowPos(TEXT("cl.ShowPos"), 0, TEXT("Show position and movement information.\n"), ECVF_Default);
 
+//Forces the generic CalcVelocity, for comparing against the specialized paths
+static TAutoConsoleVariable<int32> CVarGenericCalcVelocity(TEXT("move.GenericCalcVelocity"), 0, TEXT("Always run the generic velocity update instead of the one specialized for the preset\n"), ECVF_Default);
+
+//Substep size follows speed and surroundings instead of the fixed engine defaults
+static TAutoConsoleVariable<int32> CVarAdaptiveSimulation(TEXT("move.AdaptiveSimulation"), 1, TEXT("Pick substep size and count per surfer from speed, nearby surfaces and the governor level\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarMaxStepDistance(TEXT("move.MaxStepDistance"), 100.0f, TEXT("Longest distance a surfer may sweep in one substep near surfaces\n"), ECVF_Default);
+
+//Apex handling. 0 is the analytic apex, which keeps the substep whole and only sends the apex notification.
+//1 goes back to the engine's split, which cuts the substep at the apex and simulates the rest in an extra iteration
+static TAutoConsoleVariable<int32> CVarApexSubstep(TEXT("move.ApexSubstep"), 0, TEXT("1 splits falling substeps at the jump apex like the engine does (one extra move per jump), 0 for the analytic apex\n"), ECVF_Default);
+
+#if !UE_BUILD_SHIPPING
+//Overload for governor soak tests, every falling iteration costs this much more, like slow sweeps in a heavy map would
+static TAutoConsoleVariable<float> CVarSimulatedFallingCost(TEXT("move.SimulatedFallingCostUs"), 0.0f, TEXT("Busy wait this many microseconds in every PhysFalling iteration, for overload tests\n"), ECVF_Cheat);
+#endif
+
+//Floor sweeps for surface friction go through the world's async trace queue, so all surfers are swept in one batch at the end of the frame
+static TAutoConsoleVariable<int32> CVarAsyncFloorTrace(TEXT("move.AsyncFloorTrace"), 1, TEXT("Batch surface friction floor traces of all surfers into one async trace pass\n"), ECVF_Default);
+
 
 //Here comes tons of links to documentation about various componennts and functons
 /*
@@ -37,48 +64,216 @@
 
 */
 
+//Switching movement style for the whole server, e.g. "move.Preset CounterStrike16" or "move.Preset /Game/Presets/Surf64.Surf64"
+static void SetMovementPresetForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	if (Args.Num() == 0 || World == nullptr)
+	{
+		return;
+	}
+
+	const int64 StyleValue = StaticEnum<ESurferMovementStyle>()->GetValueByNameString(Args[0]);
+	USurferMovementPreset* Preset = nullptr;
+	if (StyleValue == INDEX_NONE)
+	{
+		Preset = LoadObject<USurferMovementPreset>(nullptr, *Args[0]);
+		if (Preset == nullptr)
+		{
+			return;
+		}
+	}
+
+	for (TObjectIterator<USurferMovementComponent> It; It; ++It)
+	{
+		if (It->GetWorld() != World || It->IsTemplate() || It->GetOwnerRole() != ROLE_Authority)
+		{
+			continue;
+		}
+		if (Preset)
+		{
+			It->SetMovementPreset(Preset);
+		}
+		else
+		{
+			It->SetMovementStyle(static_cast<ESurferMovementStyle>(StyleValue));
+		}
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdMovementPreset(
+	TEXT("move.Preset"),
+	TEXT("Switch all surfers to a style (Custom, HalfLife2, CounterStrike16, CounterStrikeGO, TeamFortress2) or a preset asset path\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&SetMovementPresetForWorld));
+
+//Comparing the generic and specialized velocity update on the first surfer in the world, e.g. "move.BenchCalcVelocity 100000"
+static void BenchCalcVelocityForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 Iterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100000;
+	for (TObjectIterator<USurferMovementComponent> It; It; ++It)
+	{
+		if (It->GetWorld() == World && !It->IsTemplate())
+		{
+			It->BenchmarkCalcVelocity(Iterations);
+			return;
+		}
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdBenchCalcVelocity(
+	TEXT("move.BenchCalcVelocity"),
+	TEXT("Time generic vs specialized CalcVelocity on a surfer, optional iteration count\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchCalcVelocityForWorld));
+
+//Camera roll cost on the first surfer in the world, e.g. "move.BenchCameraRoll 1000000"
+static void BenchCameraRollForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 Iterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1000000;
+	for (TObjectIterator<USurferMovementComponent> It; It; ++It)
+	{
+		if (It->GetWorld() == World && !It->IsTemplate())
+		{
+			It->BenchmarkCameraRoll(Iterations);
+			return;
+		}
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdBenchCameraRoll(
+	TEXT("move.BenchCameraRoll"),
+	TEXT("Time the old and the cached view roll computation on a surfer, optional iteration count\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchCameraRollForWorld));
+
+//Bytes per player, e.g. "move.MemoryReport"
+static void MemoryReportForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	USurferMovementComponent::LogMemoryReport(World);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdMemoryReport(
+	TEXT("move.MemoryReport"),
+	TEXT("Log the bytes of movement state per player, the shared tunings and the whole surfer actor per player\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&MemoryReportForWorld));
+
+//The 13 tuning values that were Blueprint properties on the component, in their old declaration order.
+//FSurferTuningOverride::Field indexes this
+static float FSurferMovementTuning::* const TuningOverrideFields[] =
+{
+	&FSurferMovementTuning::GroundAccelerationMultiplier,
+	&FSurferMovementTuning::AirAccelerationMultiplier,
+	&FSurferMovementTuning::AirSpeedCap,
+	&FSurferMovementTuning::MinStepHeight,
+	&FSurferMovementTuning::WalkSpeed,
+	&FSurferMovementTuning::RunSpeed,
+	&FSurferMovementTuning::SprintSpeed,
+	&FSurferMovementTuning::RollAngle,
+	&FSurferMovementTuning::RollSpeed,
+	&FSurferMovementTuning::MinimalSpeedMultiplier,
+	&FSurferMovementTuning::MaximalSpeedMultiplier,
+	&FSurferMovementTuning::CameraShakeMultiplier,
+	&FSurferMovementTuning::AxisSpeedLimit,
+};
+
+//Sets the value for Field, or adds it
+static void SetTuningOverride(TArray<FSurferTuningOverride>& Overrides, uint8 Field, float Value)
+{
+	for (FSurferTuningOverride& Override : Overrides)
+	{
+		if (Override.Field == Field)
+		{
+			Override.Value = Value;
+			return;
+		}
+	}
+	FSurferTuningOverride& Override = Overrides.AddDefaulted_GetRef();
+	Override.Field = Field;
+	Override.Value = Value;
+}
+
+//Writes the overrides into Tuning, unknown fields are skipped
+static void ApplyTuningOverrideValues(const TArray<FSurferTuningOverride>& Overrides, FSurferMovementTuning& Tuning)
+{
+	for (const FSurferTuningOverride& Override : Overrides)
+	{
+		if (Override.Field < UE_ARRAY_COUNT(TuningOverrideFields))
+		{
+			Tuning.*TuningOverrideFields[Override.Field] = Override.Value;
+		}
+	}
+}
+
+//Moves per jump with the engine apex split vs the analytic apex, through PerformMovement on the first surfer in the world.
+//e.g. "move.BenchApex 1000"
+static void BenchApexForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 Jumps = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1000;
+	for (TObjectIterator<USurferMovementComponent> It; It; ++It)
+	{
+		if (It->GetWorld() == World && !It->IsTemplate())
+		{
+			const float TickRates[] = { 32.0f, 64.0f, 100.0f, 128.0f, 144.0f };
+			for (const float TickRate : TickRates)
+			{
+				It->BenchmarkApex(Jumps, TickRate);
+			}
+			return;
+		}
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdBenchApex(
+	TEXT("move.BenchApex"),
+	TEXT("Jump a surfer standing on a floor through PerformMovement with the split and the analytic apex, log falling moves per jump, optional jump count\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchApexForWorld));
+
 //Declares a cycle counter stat
 DECLARE_CYCLE_STAT(TEXT("Surfer Beginning"), STAT_CharStepUp, STATGROUP_Character);
 DECLARE_CYCLE_STAT(TEXT("Surfer Falling physics"), STAT_CharPhysFalling, STATGROUP_Character);
+DECLARE_CYCLE_STAT(TEXT("Surfer NoClip physics"), STAT_CharPhysNoClip, STATGROUP_Character);
+//Reads vs recalculations of the cached max speed, the difference is what the cache saves per frame
+DECLARE_DWORD_COUNTER_STAT(TEXT("Surfer max speed reads"), STAT_SurferMaxSpeedCacheReads, STATGROUP_Character);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Surfer max speed recalcs"), STAT_SurferMaxSpeedRecalcs, STATGROUP_Character);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Surfer sync floor traces"), STAT_SurferSyncFloorTraces, STATGROUP_Character);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Surfer falling moves"), STAT_SurferFallingMoves, STATGROUP_Character);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Surfer async floor traces"), STAT_SurferAsyncFloorTraces, STATGROUP_Character);
 
 //Setting the velocity the same as in source engine
 constexpr float JumpVelocity = 266.7f;
+//sv_noclipaccelerate, how fast noclip velocity eases towards the wish velocity
+constexpr float NoClipAccelerate = 5.0f;
+//Substep bounds for the adaptive policy, the max is the engine's default MaxSimulationTimeStep
+constexpr float MinSimulationTimeStep = 1.0f / 250.0f;
+constexpr float MaxAdaptiveTimeStep = 0.05f;
+constexpr int32 MaxAdaptiveIterations = 16;
 //Max value between defecting step
 const float MAX_STEP_SIDE_Z = 0.09f;
 //Setting minimal value of vertical limit
 const float VerticalSlop = 0.001f;
-//Setting gravity the same as in source engine
-constexpr float DesiredGravity = -1143.0f;
 
 USurferMovementComponent::USurferMovementComponent()
 {
 
 	//Values that needs overriding:
 	//These are based on the real commands and values in games such as Halflife or Counter Strike
+	//The numbers live in FSurferMovementTuning (HL2 style), presets can swap them at runtime
+	const FSurferMovementTuning SourceDefaults = FSurferMovementTuning::ForStyle(ESurferMovementStyle::HalfLife2);
 
 	//cl_speed = 450 HU     There is a ratio between Unit in UE = 1.905 Unit in Source
-	MaxAcceleration = 857.25f;
+	MaxAcceleration = SourceDefaults.MaxAcceleration;
 
-	WalkSpeed = 285.75f;
-	RunSpeed = 361.9f;
-	MaxWalkSpeed = RunSpeed;
+	MaxWalkSpeed = SourceDefaults.RunSpeed;
 
 	AirControl = 1.0f;
 
 	AirControlBoostMultiplier = 0.0f;
 	AirControlBoostVelocityThreshold = 0.0f;
 
-	//30 air speed cap 
-	AirSpeedCap = 57.15f;
-	
-	//sv_accelerate and sv_airaccelerate
-	GroundAccelerationMultiplier = 10.0f;
-	AirAccelerationMulitplier = 10.0f;
+	//Air speed cap, sv_accelerate and sv_airaccelerate are read from the shared tuning
+	ActiveTuning = FSurferMovementTuning::Share(SourceDefaults);
 
 
 	//sv_friction
-	GroundFriction = 4.0f;
-	BrakingFriction = 4.0f;
+	GroundFriction = SourceDefaults.GroundFriction;
+	BrakingFriction = SourceDefaults.GroundFriction;
 	SurfaceFriction = 1.0f;
 	bUseSeparateBrakingFriction = false;
 	//Slowing facter
@@ -95,17 +290,15 @@ USurferMovementComponent::USurferMovementComponent()
 	BrakingDecelerationFalling = 0.0f;
 	BrakingDecelerationFlying = 190.5f;
 
-	BrakingDecelerationWalking = 190.5f;
+	BrakingDecelerationWalking = SourceDefaults.BrakingDecelerationWalking;
 
 	// HL2 step height
-	MaxStepHeight = 34.29f;
+	MaxStepHeight = SourceDefaults.MaxStepHeight;
 	DefaultStepHeight = MaxStepHeight;
-	
-	MinStepHeight = 10.0f;
 
 	
 	// 21Hu jump height
-	JumpZVelocity = 304.8f;
+	JumpZVelocity = SourceDefaults.JumpZVelocity;
 	// Don't bounce off characters
 	JumpOffJumpZFactor = 0.0f;
 	// Default show pos to false
@@ -114,18 +307,65 @@ USurferMovementComponent::USurferMovementComponent()
 	//bOnLadder = false;
 	
 	//LadderSpeed = 381.0f;
-	// Speed multiplier bounds
-	MinimalSpeedMultiplier = SprintSpeed * 1.7f;
-	MaximalSpeedMultiplier = SprintSpeed * 2.5f;
 
 	// Start out braking/slowing
 	bFrameForBraking = true;
+	// Noclip off at spawn
+	bNoClip = false;
+	bReplicatedNoClip = false;
+	SimulationThrottle = 0;
+	SimulationTime = 0.0;
+	SimulationStep = 0;
+	FallingMoves = 0;
+	StepStartTime = 0.0;
+	StepDeltaTime = 0.0f;
+	bLastPressedJump = false;
+	bBufferedHopThisStep = false;
+	MovementBudget = nullptr;
+	ZoneSubsystem = nullptr;
+	SoakStats = nullptr;
+	CustomTuning = nullptr;
+#if WITH_EDITORONLY_DATA
+	//Defaults of the old properties, a saved value that differs is what a designer set
+	const FSurferMovementTuning LegacyDefaults;
+	GroundAccelerationMultiplier_DEPRECATED = LegacyDefaults.GroundAccelerationMultiplier;
+	AirAccelerationMulitplier_DEPRECATED = LegacyDefaults.AirAccelerationMultiplier;
+	AirSpeedCap_DEPRECATED = LegacyDefaults.AirSpeedCap;
+	MinStepHeight_DEPRECATED = LegacyDefaults.MinStepHeight;
+	WalkSpeed_DEPRECATED = LegacyDefaults.WalkSpeed;
+	RunSpeed_DEPRECATED = LegacyDefaults.RunSpeed;
+	SprintSpeed_DEPRECATED = LegacyDefaults.SprintSpeed;
+	RollAngle_DEPRECATED = LegacyDefaults.RollAngle;
+	RollSpeed_DEPRECATED = LegacyDefaults.RollSpeed;
+	MinimalSpeedMultiplier_DEPRECATED = LegacyDefaults.MinimalSpeedMultiplier;
+	MaximalSpeedMultiplier_DEPRECATED = LegacyDefaults.MaximalSpeedMultiplier;
+	CameraShakeMultiplier_DEPRECATED = LegacyDefaults.CameraShakeMultiplier;
+	AxisSpeedLimit_DEPRECATED = LegacyDefaults.AxisSpeedLimit;
+#endif
+	FloorTraceFrame = 0;
+	FloorTraceLocation = FVector::ZeroVector;
+	bTrackZoneMoves = false;
+	bInStepUp = false;
+	RunClock = 0.0;
+	ReckoningLocation = FVector::ZeroVector;
+	ReckoningVelocity = FVector::ZeroVector;
+	ReckoningLinearVelocity = FVector::ZeroVector;
+	ReckoningSurfNormal = FVector::ZeroVector;
+	ReckoningUpdateTime = 0.0;
+	bHasReckoningUpdate = false;
+	bReckoningBlocked = false;
+	ProxyUpdates = 0;
+	ProxyUpdateIntervalSum = 0.0;
+	ProxyErrorSum = 0.0;
+	ProxyErrorMax = 0.0f;
+	ProxyLinearErrorSum = 0.0;
+	ProxyLinearErrorMax = 0.0f;
+	bTouchedSurface = false;
 
 
 	// Max slope in source is 45.57
 	SetWalkableFloorZ(0.5f);
 	DefaultWalkableFloorZ = GetWalkableFloorZ();
-	AxisSpeedLimit = 6667.5f;
 	// Tune physics interactions
 	StandingDownwardForceScale = 1.0f;
 
@@ -138,10 +378,12 @@ USurferMovementComponent::USurferMovementComponent()
 	bUseFlatBaseForFloorChecks = true;
 	
 	// Make sure gravity is correct for player movement
-	GravityScale = DesiredGravity / UPhysicsSettings::Get()->DefaultGravityZ;
+	GravityScale = SourceDefaults.GravityZ / UPhysicsSettings::Get()->DefaultGravityZ;
 	// Make sure ramp movement in correct
 	bMaintainHorizontalGroundVelocity = true;
 
+	SelectCalcVelocityPath();
+	CachedMaxSpeed = SourceDefaults.RunSpeed;
 }
 
 
@@ -170,6 +412,280 @@ void USurferMovementComponent::InitializeComponent()
 
 	Super::InitializeComponent();
 	SurferCharacter = Cast<ASurferCharacter>(GetOwner());
+	MovementBudget = GetWorld() ? GetWorld()->GetSubsystem<USurferMovementBudget>() : nullptr;
+	ZoneSubsystem = GetWorld() ? GetWorld()->GetSubsystem<USurferZoneSubsystem>() : nullptr;
+	SoakStats = GetWorld() ? GetWorld()->GetSubsystem<USurferSoakStats>() : nullptr;
+
+	//Engine properties still hold the constructor or blueprint values here, nothing has applied a style yet
+	CaptureCustomTuning();
+	RefreshMovementTuning();
+	USurferMovementPreset::OnPresetChanged.AddUObject(this, &USurferMovementComponent::HandlePresetChanged);
+}
+
+void USurferMovementComponent::UninitializeComponent()
+{
+	USurferMovementPreset::OnPresetChanged.RemoveAll(this);
+	Super::UninitializeComponent();
+}
+
+void USurferMovementComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(USurferMovementComponent, MovementPreset);
+	DOREPLIFETIME(USurferMovementComponent, MovementStyle);
+	DOREPLIFETIME(USurferMovementComponent, PresetState);
+	DOREPLIFETIME(USurferMovementComponent, TuningOverrides);
+	DOREPLIFETIME_CONDITION(USurferMovementComponent, bReplicatedNoClip, COND_SimulatedOnly);
+	DOREPLIFETIME_CONDITION(USurferMovementComponent, SimulationThrottle, COND_OwnerOnly);
+}
+
+/// <summary>
+/// Blueprints and levels saved while the tuning was still properties on the component load those values into the
+/// _DEPRECATED copies. They move into CustomTuningValues here, which is saved from then on, and Custom picks them up.
+/// </summary>
+void USurferMovementComponent::PostLoad()
+{
+	Super::PostLoad();
+
+#if WITH_EDITORONLY_DATA
+	const FSurferMovementTuning LegacyDefaults;
+	float* const LegacyValues[] =
+	{
+		&GroundAccelerationMultiplier_DEPRECATED,
+		&AirAccelerationMulitplier_DEPRECATED,
+		&AirSpeedCap_DEPRECATED,
+		&MinStepHeight_DEPRECATED,
+		&WalkSpeed_DEPRECATED,
+		&RunSpeed_DEPRECATED,
+		&SprintSpeed_DEPRECATED,
+		&RollAngle_DEPRECATED,
+		&RollSpeed_DEPRECATED,
+		&MinimalSpeedMultiplier_DEPRECATED,
+		&MaximalSpeedMultiplier_DEPRECATED,
+		&CameraShakeMultiplier_DEPRECATED,
+		&AxisSpeedLimit_DEPRECATED,
+	};
+	static_assert(UE_ARRAY_COUNT(LegacyValues) == UE_ARRAY_COUNT(TuningOverrideFields), "Every old tuning property needs its field");
+
+	for (uint8 Field = 0; Field < UE_ARRAY_COUNT(LegacyValues); ++Field)
+	{
+		const float Default = LegacyDefaults.*TuningOverrideFields[Field];
+		if (*LegacyValues[Field] != Default)
+		{
+			SetTuningOverride(CustomTuningValues, Field, *LegacyValues[Field]);
+			*LegacyValues[Field] = Default;
+		}
+	}
+#endif
+}
+
+#if WITH_EDITOR
+/// <summary>
+/// Tweaking values on a running component should show up straight away
+/// </summary>
+/// <param name="PropertyChangedEvent"></param>
+void USurferMovementComponent::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	if (!IsTemplate())
+	{
+		//Edits on a Custom component are the designer's values, with a style or preset they get overwritten anyway
+		if (MovementPreset == nullptr && MovementStyle == ESurferMovementStyle::Custom)
+		{
+			CaptureCustomTuning();
+		}
+		RefreshMovementTuning();
+	}
+}
+#endif
+
+/// <summary>
+/// Setting preset asset for this surfer
+/// </summary>
+/// <param name="NewPreset"></param>
+void USurferMovementComponent::SetMovementPreset(USurferMovementPreset* NewPreset)
+{
+	MovementPreset = NewPreset;
+	TuningOverrides.Reset();
+	RefreshMovementTuning();
+}
+
+/// <summary>
+/// Setting one of the built in styles for this surfer
+/// </summary>
+/// <param name="NewStyle"></param>
+void USurferMovementComponent::SetMovementStyle(ESurferMovementStyle NewStyle)
+{
+	MovementPreset = nullptr;
+	MovementStyle = NewStyle;
+	TuningOverrides.Reset();
+	RefreshMovementTuning();
+}
+
+FString USurferMovementComponent::GetMovementStyleName() const
+{
+	if (MovementPreset)
+	{
+		return MovementPreset->GetName();
+	}
+	return StaticEnum<ESurferMovementStyle>()->GetNameStringByValue(static_cast<int64>(MovementStyle));
+}
+
+void USurferMovementComponent::OnRep_MovementPreset()
+{
+	RefreshMovementTuning();
+}
+
+void USurferMovementComponent::OnRep_PresetState()
+{
+	//Components on the preset refresh from the OnPresetChanged this fires, this one included
+	if (PresetState.Preset != nullptr)
+	{
+		PresetState.Preset->ApplyRuntimeState(PresetState);
+	}
+}
+
+void USurferMovementComponent::OnRep_TuningOverrides()
+{
+	RefreshMovementTuning();
+}
+
+void USurferMovementComponent::OnRep_NoClip()
+{
+	SetNoClip(bReplicatedNoClip);
+}
+
+/// <summary>
+/// Resolving which tuning is active. Preset asset first, then built in style,
+/// otherwise the engine movement values that are set on the component with the HL2 surf values.
+/// Values set by the deprecated Blueprint setters go on top of whichever it is.
+/// </summary>
+void USurferMovementComponent::RefreshMovementTuning()
+{
+	//The server hands its edits of the preset to the clients along with it
+	if (GetOwner() != nullptr && GetOwner()->HasAuthority())
+	{
+		PresetState = MovementPreset ? MovementPreset->GetRuntimeState() : FSurferPresetState();
+	}
+
+	if (MovementPreset)
+	{
+		ApplyMovementTuning(MovementPreset->ToTuning());
+	}
+	else if (MovementStyle != ESurferMovementStyle::Custom)
+	{
+		ApplyMovementTuning(FSurferMovementTuning::ForStyle(MovementStyle));
+	}
+	else
+	{
+		//Applying a style overwrote the engine properties, so Custom has to come from the values captured before that
+		if (CustomTuning == nullptr)
+		{
+			CaptureCustomTuning();
+		}
+		ApplyMovementTuning(*CustomTuning);
+	}
+	ApplyTuningOverrides();
+}
+
+void USurferMovementComponent::CaptureCustomTuning()
+{
+	FSurferMovementTuning Tuning;
+	Tuning.MaxAcceleration = MaxAcceleration;
+	Tuning.GroundFriction = GroundFriction;
+	Tuning.BrakingDecelerationWalking = BrakingDecelerationWalking;
+	Tuning.RunSpeed = MaxWalkSpeed;
+	Tuning.JumpZVelocity = JumpZVelocity;
+	Tuning.GravityZ = GravityScale * UPhysicsSettings::Get()->DefaultGravityZ;
+	Tuning.MaxStepHeight = DefaultStepHeight;
+	ApplyTuningOverrideValues(CustomTuningValues, Tuning);
+	CustomTuning = FSurferMovementTuning::Share(Tuning);
+}
+
+/// <summary>
+/// Pointing at the shared copy of the tuning and copying it into the properties that the base CharacterMovementComponent reads itself.
+/// </summary>
+/// <param name="NewTuning"></param>
+void USurferMovementComponent::ApplyMovementTuning(const FSurferMovementTuning& NewTuning)
+{
+	ActiveTuning = FSurferMovementTuning::Share(NewTuning);
+	ApplyActiveTuning();
+}
+
+void USurferMovementComponent::ApplyActiveTuning()
+{
+	//Engine side
+	MaxAcceleration = ActiveTuning->MaxAcceleration;
+	GroundFriction = ActiveTuning->GroundFriction;
+	BrakingFriction = ActiveTuning->GroundFriction;
+	BrakingDecelerationWalking = ActiveTuning->BrakingDecelerationWalking;
+	MaxWalkSpeed = ActiveTuning->RunSpeed;
+	JumpZVelocity = ActiveTuning->JumpZVelocity;
+	GravityScale = ActiveTuning->GravityZ / UPhysicsSettings::Get()->DefaultGravityZ;
+	MaxStepHeight = ActiveTuning->MaxStepHeight;
+	DefaultStepHeight = ActiveTuning->MaxStepHeight;
+
+	SelectCalcVelocityPath();
+	UpdateMaxSpeedCache();
+}
+
+/// <summary>
+/// Old Blueprint writes to a tuning property. Only the server's count, a client changing its own copy would just predict
+/// differently and get corrected. The value goes into the replicated TuningOverrides, the owner and the proxies apply it in OnRep.
+/// </summary>
+/// <param name="Field"></param>
+/// <param name="Value"></param>
+void USurferMovementComponent::SetTuningValue(float FSurferMovementTuning::* Field, float Value)
+{
+	if (GetOwner() == nullptr || !GetOwner()->HasAuthority())
+	{
+		return;
+	}
+
+	for (uint8 Index = 0; Index < UE_ARRAY_COUNT(TuningOverrideFields); ++Index)
+	{
+		if (TuningOverrideFields[Index] == Field)
+		{
+			SetTuningOverride(TuningOverrides, Index, Value);
+			RefreshMovementTuning();
+			return;
+		}
+	}
+}
+
+/// <summary>
+/// Overrides live in a copy owned by this component instead of the shared tunings. Those are kept until exit and searched
+/// on every share, a Blueprint setting a value every frame would fill them.
+/// </summary>
+void USurferMovementComponent::ApplyTuningOverrides()
+{
+	if (TuningOverrides.Num() == 0)
+	{
+		return;
+	}
+
+	if (!OverrideTuning.IsValid())
+	{
+		OverrideTuning = MakeUnique<FSurferMovementTuning>();
+	}
+	//ActiveTuning is the shared one RefreshMovementTuning just picked, never the copy itself
+	*OverrideTuning = *ActiveTuning;
+	ApplyTuningOverrideValues(TuningOverrides, *OverrideTuning);
+	ActiveTuning = OverrideTuning.Get();
+	ApplyActiveTuning();
+}
+
+/// <summary>
+/// Preset asset got edited, reapply if its ours. On the server that also replicates the edit
+/// </summary>
+/// <param name="ChangedPreset"></param>
+void USurferMovementComponent::HandlePresetChanged(const USurferMovementPreset* ChangedPreset)
+{
+	if (ChangedPreset != nullptr && ChangedPreset == MovementPreset && ActiveTuning->Version != ChangedPreset->Version)
+	{
+		RefreshMovementTuning();
+	}
 }
 
 /// <summary>
@@ -198,33 +714,69 @@ void USurferMovementComponent::OnRegister()
 /// <param name="BrakingDeceleration"></param>
 void USurferMovementComponent::CalcVelocity(float DeltaTime, float Friction, bool bFluid, float BrakingDeceleration)
 {
-
 	// Do not update velocity when using root motion or when SimulatedProxy and not simulating root motion - SimulatedProxy are repped their Velocity
 	if (!HasValidData() || HasAnimRootMotion() || DeltaTime < MIN_TICK_TIME || (CharacterOwner && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy && !bWasSimulatingRootMotion))
 	{
 		return;
 	}
+
+	//Path following, swimming/flying and noclip need the full version, everything else runs the one picked with the preset
+	if (bForceMaxAccel || bFluid || bCheatFlying || CVarGenericCalcVelocity.GetValueOnGameThread() != 0)
+	{
+		CalcVelocityPath<true, true>(DeltaTime, Friction, bFluid, BrakingDeceleration);
+	}
+	else
+	{
+		(this->*SelectedCalcVelocityPath)(DeltaTime, Friction, bFluid, BrakingDeceleration);
+	}
+}
+
+/// <summary>
+/// Picking the specialized velocity update once, whenever the tuning changes.
+/// With no sprint/walk/crouch the max speed is just RunSpeed.
+/// </summary>
+void USurferMovementComponent::SelectCalcVelocityPath()
+{
+	SelectedCalcVelocityPath = ActiveTuning->HasSpeedModes()
+		? &USurferMovementComponent::CalcVelocityPath<false, true>
+		: &USurferMovementComponent::CalcVelocityPath<false, false>;
+}
+
+/// <summary>
+/// Actual velocity update. bSpecialCases handles bForceMaxAccel and fluid friction,
+/// bSpeedModes reads the cached sprint/walk/crouch max speed. Both get compiled out of the specialized versions.
+/// </summary>
+/// <param name="DeltaTime"></param>
+/// <param name="Friction"></param>
+/// <param name="bFluid"></param>
+/// <param name="BrakingDeceleration"></param>
+template<bool bSpecialCases, bool bSpeedModes>
+void USurferMovementComponent::CalcVelocityPath(float DeltaTime, float Friction, bool bFluid, float BrakingDeceleration)
+{
 	//ITs mostly coping from the charactermovementcomponent.cpp
 	Friction = FMath::Max(0.0f, Friction);
-	const float MaxAccel = GetMaxAcceleration();
-	float MaxSpeed = GetMaxSpeed();
+	const float MaxSpeed = bSpeedModes ? CachedMaxSpeed : ActiveTuning->RunSpeed;
 
 
 	//
-	if (bForceMaxAccel)
+	if constexpr (bSpecialCases)
 	{
-		// Force acceleration at full speed.
-		// In consideration order for direction: Acceleration, then Velocity, then Pawn's rotation.
-		if (Acceleration.SizeSquared() > SMALL_NUMBER)
-		{
-			Acceleration = Acceleration.GetSafeNormal() * MaxAccel;
-		}
-		else
+		if (bForceMaxAccel)
 		{
-			Acceleration = MaxAccel * (Velocity.SizeSquared() < SMALL_NUMBER ? UpdatedComponent->GetForwardVector() : Velocity.GetSafeNormal());
-		}
+			const float MaxAccel = GetMaxAcceleration();
+			// Force acceleration at full speed.
+			// In consideration order for direction: Acceleration, then Velocity, then Pawn's rotation.
+			if (Acceleration.SizeSquared() > SMALL_NUMBER)
+			{
+				Acceleration = Acceleration.GetSafeNormal() * MaxAccel;
+			}
+			else
+			{
+				Acceleration = MaxAccel * (Velocity.SizeSquared() < SMALL_NUMBER ? UpdatedComponent->GetForwardVector() : Velocity.GetSafeNormal());
+			}
 
-		AnalogInputModifier = 1.0f;
+			AnalogInputModifier = 1.0f;
+		}
 	}
 
 
@@ -250,14 +802,17 @@ void USurferMovementComponent::CalcVelocity(float DeltaTime, float Friction, boo
 	}
 
 	// Apply fluid friction
-	if (bFluid)
+	if constexpr (bSpecialCases)
 	{
-		Velocity = Velocity * (1.0f - FMath::Min(Friction * DeltaTime, 1.0f));
+		if (bFluid)
+		{
+			Velocity = Velocity * (1.0f - FMath::Min(Friction * DeltaTime, 1.0f));
+		}
 	}
 
 	// Limit before switching acceleration
-	Velocity.X = FMath::Clamp(Velocity.X, -AxisSpeedLimit, AxisSpeedLimit);
-	Velocity.Y = FMath::Clamp(Velocity.Y, -AxisSpeedLimit, AxisSpeedLimit);
+	Velocity.X = FMath::Clamp(Velocity.X, -ActiveTuning->AxisSpeedLimit, ActiveTuning->AxisSpeedLimit);
+	Velocity.Y = FMath::Clamp(Velocity.Y, -ActiveTuning->AxisSpeedLimit, ActiveTuning->AxisSpeedLimit);
 
 
 	
@@ -273,14 +828,14 @@ void USurferMovementComponent::CalcVelocity(float DeltaTime, float Friction, boo
 		const FVector AccelDir = Acceleration.GetSafeNormal2D();
 		const float VelocityDirection = Velocity.X * AccelDir.X + Velocity.Y * AccelDir.Y;
 		///Adding speed in air
-		const float AddSpeed = (bIsGroundMove ? Acceleration : Acceleration.GetClampedToMaxSize2D(AirSpeedCap)).Size2D() - VelocityDirection;
+		const float AddSpeed = (bIsGroundMove ? Acceleration : Acceleration.GetClampedToMaxSize2D(ActiveTuning->AirSpeedCap)).Size2D() - VelocityDirection;
 		
 		//Whenever player is gaining speed
 		if (AddSpeed > 0.0f)
 		{
 			// Apply acceleration
 			//getting the percenatage of a ground and air http://adrianb.io/2015/02/14/bunnyhop.html according to this 
-			const float AccelerationMultiplier = bIsGroundMove ? GroundAccelerationMultiplier : AirAccelerationMulitplier;
+			const float AccelerationMultiplier = bIsGroundMove ? ActiveTuning->GroundAccelerationMultiplier : ActiveTuning->AirAccelerationMultiplier;
 			FVector CurrentAcceleration = Acceleration * AccelerationMultiplier * SurfaceFriction * DeltaTime;
 			CurrentAcceleration = CurrentAcceleration.GetClampedToMaxSize2D(AddSpeed);
 			Velocity += CurrentAcceleration;
@@ -290,8 +845,8 @@ void USurferMovementComponent::CalcVelocity(float DeltaTime, float Friction, boo
 
 
 	// Limit after switching acceleration
-	Velocity.X = FMath::Clamp(Velocity.X, -AxisSpeedLimit, AxisSpeedLimit);
-	Velocity.Y = FMath::Clamp(Velocity.Y, -AxisSpeedLimit, AxisSpeedLimit);
+	Velocity.X = FMath::Clamp(Velocity.X, -ActiveTuning->AxisSpeedLimit, ActiveTuning->AxisSpeedLimit);
+	Velocity.Y = FMath::Clamp(Velocity.Y, -ActiveTuning->AxisSpeedLimit, ActiveTuning->AxisSpeedLimit);
 
 	const float SpeedSq = Velocity.SizeSquared2D();
 
@@ -309,7 +864,7 @@ void USurferMovementComponent::CalcVelocity(float DeltaTime, float Friction, boo
 		////Meaning that the faster we go the more " steps " we complete and that can cause problems
 		// that s why I want to clamp it 
 		float Speed = FMath::Sqrt(SpeedSq);
-		float SpeedScale = (Speed - MinimalSpeedMultiplier) / (MaximalSpeedMultiplier - MinimalSpeedMultiplier);
+		float SpeedScale = (Speed - ActiveTuning->MinimalSpeedMultiplier) / (ActiveTuning->MaximalSpeedMultiplier - ActiveTuning->MinimalSpeedMultiplier);
 		float SpeedMultiplier = FMath::Clamp(SpeedScale, 0.0f, 1.0f);
 		SpeedMultiplier *= SpeedMultiplier;
 		if (!IsFalling())
@@ -318,7 +873,7 @@ void USurferMovementComponent::CalcVelocity(float DeltaTime, float Friction, boo
 			SpeedMultiplier = FMath::Max((1.0f - SurfaceFriction) * SpeedMultiplier, 0.0f);
 		}
 		//Adjusting floor to and camera
-		MaxStepHeight = FMath::Lerp(DefaultStepHeight, MinStepHeight, SpeedMultiplier);
+		MaxStepHeight = FMath::Lerp(DefaultStepHeight, ActiveTuning->MinStepHeight, SpeedMultiplier);
 		SetWalkableFloorZ(FMath::Lerp(DefaultWalkableFloorZ, 0.9848f, SpeedMultiplier));
 	}
 
@@ -327,6 +882,209 @@ void USurferMovementComponent::CalcVelocity(float DeltaTime, float Friction, boo
 }
 
 
+/// <summary>
+/// Runs every velocity update variant on copies of the current state and logs the cost per call.
+/// Movement state is restored afterwards so it can be run in a live game.
+/// </summary>
+/// <param name="Iterations"></param>
+void USurferMovementComponent::BenchmarkCalcVelocity(int32 Iterations)
+{
+	if (!HasValidData())
+	{
+		return;
+	}
+
+	TGuardValue<FVector> RestoreVelocity(Velocity, Velocity);
+	TGuardValue<FVector> RestoreAcceleration(Acceleration, Acceleration);
+	TGuardValue<float> RestoreStepHeight(MaxStepHeight, MaxStepHeight);
+	const float SavedWalkableFloorZ = GetWalkableFloorZ();
+
+	//Strafing at surf speed, the common case on a server
+	const FVector StartVelocity(1200.0f, 300.0f, 0.0f);
+	const FVector StartAcceleration(0.0f, MaxAcceleration, 0.0f);
+	const float DeltaTime = 1.0f / 64.0f;
+
+	auto TimePath = [&](FCalcVelocityPath Path)
+	{
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		for (int32 Index = 0; Index < Iterations; ++Index)
+		{
+			Velocity = StartVelocity;
+			Acceleration = StartAcceleration;
+			(this->*Path)(DeltaTime, GroundFriction, false, BrakingDecelerationWalking);
+		}
+		return FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles) * 1000000.0 / Iterations;
+	};
+
+	const double GenericNs = TimePath(&USurferMovementComponent::CalcVelocityPath<true, true>);
+	const double SpeedModesNs = TimePath(&USurferMovementComponent::CalcVelocityPath<false, true>);
+	const double NoModesNs = TimePath(&USurferMovementComponent::CalcVelocityPath<false, false>);
+
+	SetWalkableFloorZ(SavedWalkableFloorZ);
+
+	UE_LOG(LogSurfer, Log, TEXT("CalcVelocity x%d: generic %.1f ns, specialized %.1f ns, specialized no speed modes %.1f ns (selected: %s)"),
+		Iterations, GenericNs, SpeedModesNs, NoModesNs, ActiveTuning->HasSpeedModes() ? TEXT("speed modes") : TEXT("no speed modes"));
+}
+
+/// <summary>
+/// Jumps straight up from the floor and runs PerformMovement at the tick rate until the landing, once per apex mode.
+/// The falling moves are the ones the "Surfer falling moves" stat counts, the apex notifications are what bNotifyApex
+/// listeners get. Each jump starts a little higher so the apex lands at different spots of the substep.
+/// The surfer is put back on the floor afterwards.
+/// </summary>
+/// <param name="Jumps"></param>
+/// <param name="TickRate"></param>
+void USurferMovementComponent::BenchmarkApex(int32 Jumps, float TickRate)
+{
+	if (!HasValidData() || !IsMovingOnGround())
+	{
+		UE_LOG(LogSurfer, Error, TEXT("Apex benchmark needs the surfer standing on a floor"));
+		return;
+	}
+
+	const float DeltaTime = 1.0f / TickRate;
+	const int32 MaxSteps = FMath::CeilToInt(4.0f / DeltaTime);
+	const FVector FloorLocation = UpdatedComponent->GetComponentLocation();
+	const FQuat Rotation = UpdatedComponent->GetComponentQuat();
+	const int32 SavedApexSubstep = CVarApexSubstep.GetValueOnGameThread();
+	const bool bSavedNotifyApex = bNotifyApex;
+
+	for (int32 ApexSubstep = 1; ApexSubstep >= 0; --ApexSubstep)
+	{
+		CVarApexSubstep->Set(ApexSubstep, ECVF_SetByCode);
+		const uint64 StartMoves = FallingMoves;
+		int32 Notifications = 0;
+		int32 Landings = 0;
+		float PeakSum = 0.0f;
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		for (int32 Jump = 0; Jump < Jumps; ++Jump)
+		{
+			UpdatedComponent->SetWorldLocationAndRotation(FloorLocation + FVector(0.0f, 0.0f, (Jump % 97) * 0.01f), Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+			Velocity = FVector(0.0f, 0.0f, JumpZVelocity);
+			Acceleration = FVector::ZeroVector;
+			CharacterOwner->bPressedJump = false;
+			SetMovementMode(MOVE_Falling);
+			bNotifyApex = true;
+			float Peak = 0.0f;
+			for (int32 Step = 0; Step < MaxSteps && !IsMovingOnGround(); ++Step)
+			{
+				PerformMovement(DeltaTime);
+				Peak = FMath::Max(Peak, static_cast<float>(UpdatedComponent->GetComponentLocation().Z - FloorLocation.Z));
+			}
+			Notifications += bNotifyApex ? 0 : 1;
+			Landings += IsMovingOnGround() ? 1 : 0;
+			PeakSum += Peak;
+		}
+		const double Elapsed = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+		UE_LOG(LogSurfer, Display, TEXT("Apex %s @ %.0f Hz: %.3f falling moves per jump, peak %.3f, %d/%d apex notifications, %d/%d landed, %.2f ms"),
+			ApexSubstep ? TEXT("split   ") : TEXT("analytic"), TickRate, double(FallingMoves - StartMoves) / Jumps, PeakSum / Jumps,
+			Notifications, Jumps, Landings, Jumps, Elapsed);
+	}
+
+	CVarApexSubstep->Set(SavedApexSubstep, ECVF_SetByCode);
+	bNotifyApex = bSavedNotifyApex;
+	UpdatedComponent->SetWorldLocationAndRotation(FloorLocation, Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	Velocity = FVector::ZeroVector;
+	SetMovementMode(MOVE_Walking);
+}
+
+/// <summary>
+/// Real input through the real movement. A drop without a press finds the step the surfer lands in,
+/// then the same drop is repeated with jump pressed for one step at every step before it.
+/// Only presses that are surely inside or surely outside the window are checked, where exactly in its step
+/// the surfer lands decides the ones in between. The surfer is put back on the floor afterwards.
+/// </summary>
+/// <param name="TickRate"></param>
+/// <param name="WindowSeconds"></param>
+/// <returns></returns>
+int32 USurferMovementComponent::TestJumpBufferLanding(float TickRate, float WindowSeconds)
+{
+	if (!HasValidData() || !IsMovingOnGround())
+	{
+		UE_LOG(LogSurfer, Error, TEXT("Jump buffer landing check needs the surfer standing on a floor"));
+		return 1;
+	}
+
+	const float DeltaTime = 1.0f / TickRate;
+	const int32 MaxSteps = FMath::CeilToInt(2.0f / DeltaTime);
+	const FVector FloorLocation = UpdatedComponent->GetComponentLocation();
+	const FVector DropLocation = FloorLocation + FVector(0.0f, 0.0f, 150.0f);
+	const FQuat Rotation = UpdatedComponent->GetComponentQuat();
+
+	auto ResetJump = [this]()
+	{
+		Velocity = FVector::ZeroVector;
+		Acceleration = FVector::ZeroVector;
+		JumpBuffer.Reset();
+		bLastPressedJump = false;
+		CharacterOwner->bPressedJump = false;
+		CharacterOwner->bWasJumping = false;
+		CharacterOwner->JumpCurrentCount = 0;
+	};
+
+	//Jump held during PressStep only, INDEX_NONE for no press. Returns the step it landed in
+	auto Drop = [&](int32 PressStep, bool& bOutHopped)
+	{
+		UpdatedComponent->SetWorldLocationAndRotation(DropLocation, Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+		ResetJump();
+		SetMovementMode(MOVE_Falling);
+		bOutHopped = false;
+		for (int32 Step = 0; Step < MaxSteps; ++Step)
+		{
+			CharacterOwner->bPressedJump = Step == PressStep;
+			PerformMovement(DeltaTime);
+			if (bBufferedHopThisStep || IsMovingOnGround())
+			{
+				bOutHopped = bBufferedHopThisStep;
+				return Step;
+			}
+		}
+		return static_cast<int32>(INDEX_NONE);
+	};
+
+	int32 Failures = 0;
+	int32 Checked = 0;
+	bool bHopped = false;
+	const int32 LandStep = Drop(INDEX_NONE, bHopped);
+	if (LandStep == INDEX_NONE || bHopped)
+	{
+		UE_LOG(LogSurfer, Error, TEXT("Jump buffer at %.0f Hz: the drop without a press %s"), TickRate, bHopped ? TEXT("hopped") : TEXT("never landed"));
+		++Failures;
+	}
+	else
+	{
+		const int32 FirstPressStep = FMath::Max(0, LandStep - FMath::CeilToInt(WindowSeconds / DeltaTime) - 2);
+		for (int32 PressStep = FirstPressStep; PressStep <= LandStep; ++PressStep)
+		{
+			//Landing happens somewhere in [LandStep, LandStep + 1) steps after the drop started
+			const bool bSurelyInside = (LandStep + 1 - PressStep) * DeltaTime <= WindowSeconds;
+			const bool bSurelyOutside = (LandStep - PressStep) * DeltaTime > WindowSeconds;
+			if (!bSurelyInside && !bSurelyOutside)
+			{
+				continue;
+			}
+
+			++Checked;
+			Drop(PressStep, bHopped);
+			if (bHopped != bSurelyInside)
+			{
+				UE_LOG(LogSurfer, Error, TEXT("Jump buffer at %.0f Hz: press %d steps before landing %s"),
+					TickRate, LandStep - PressStep, bHopped ? TEXT("hopped outside the window") : TEXT("did not hop inside the window"));
+				++Failures;
+			}
+		}
+	}
+
+	UpdatedComponent->SetWorldLocationAndRotation(FloorLocation, Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	ResetJump();
+	SetMovementMode(MOVE_Walking);
+
+	UE_LOG(LogSurfer, Display, TEXT("Jump buffer at %.0f Hz: landed in step %d, %d presses checked through PerformMovement, %d failures"),
+		TickRate, LandStep, Checked, Failures);
+	return Failures;
+}
+
+
 /// <summary>
 /// Braking allows to control how much friction is being applied whenever surfer is moving across the surface.
 /// It essentially is supposed to apply velocity in the oposing direction.
@@ -337,8 +1095,8 @@ void USurferMovementComponent::CalcVelocity(float DeltaTime, float Friction, boo
 /// <param name="BrakingDeceleration"></param>
 void USurferMovementComponent::ApplyVelocityBraking(float DeltaTime, float Friction, float BrakingDecelarion)
 {
-	//Initializing check if correct stuff is assigned
-	if (Velocity.IsNearlyZero(0.1f) || !HasValidData() || HasAnimRootMotion() || DeltaTime < MIN_TICK_TIME)
+	//Initializing check if correct stuff is assigned, a buffered hop never touches the ground friction
+	if (bBufferedHopThisStep || Velocity.IsNearlyZero(0.1f) || !HasValidData() || HasAnimRootMotion() || DeltaTime < MIN_TICK_TIME)
 	{
 		return;
 	}
@@ -421,6 +1179,21 @@ void USurferMovementComponent::PhysFalling(float deltaTime, int32 Iterations)
 	while ((remainingTime >= MIN_TICK_TIME) && (Iterations < MaxSimulationIterations))
 	{
 		Iterations++;
+		//The stat is compiled out of shipping servers, the governor counts iterations itself
+		if (MovementBudget)
+		{
+			MovementBudget->AddFallingIteration();
+		}
+#if !UE_BUILD_SHIPPING
+		const float SimulatedCostUs = CVarSimulatedFallingCost.GetValueOnGameThread();
+		if (SimulatedCostUs > 0.0f)
+		{
+			const double WaitUntil = FPlatformTime::Seconds() + SimulatedCostUs * 1.0e-6;
+			while (FPlatformTime::Seconds() < WaitUntil)
+			{
+			}
+		}
+#endif
 		float timeTick = GetSimulationTimeStep(remainingTime, Iterations);
 		remainingTime -= timeTick;
 
@@ -476,11 +1249,23 @@ void USurferMovementComponent::PhysFalling(float deltaTime, int32 Iterations)
 		
 		//DecayFormerBaseVelocity(timeTick);
 		
+		//Apex straight from OldVelocity.Z and gravity, before the move.
+		//Midpoint integration is exact for constant gravity, so the substep doesn't have to be cut at the apex
+		//and rolled back, the apex only needs its notification. The engine split is still there with move.ApexSubstep 1
+		const bool bSplitApex = CVarApexSubstep.GetValueOnGameThread() != 0;
+		const bool bReachesApex = OldVelocity.Z > 0.f && Gravity.Z < 0.f
+			&& (timeTick - GravityTime) + OldVelocity.Z / -Gravity.Z < timeTick;
+		if (bReachesApex && bNotifyApex)
+		{
+			bNotifyApex = false;
+			NotifyJumpApex();
+		}
+
 		// See if we need to sub-step to exactly reach the apex. This is important for avoiding "cutting off the top" of the trajectory as framerate varies.
 		//Whats intresting that it does not recognize NumJumpApexAttempts that in original movement. Thus I had to comment it outm, but it doesnt change anything
 		//Also I overrived the values with mine
 		//That way I do take velocitiez into considerations not the rootmotion velocity or forcejump.
-		if (OldVelocity.Z > 0.f && Velocity.Z <= 0.f /* && NumJumpApexAttempts < MaxJumpApexAttemptsPerSimulation*/)
+		if (bSplitApex && OldVelocity.Z > 0.f && Velocity.Z <= 0.f /* && NumJumpApexAttempts < MaxJumpApexAttemptsPerSimulation*/)
 		{
 			const FVector DerivedAccel = (Velocity - OldVelocity) / timeTick;
 			if (!FMath::IsNearlyZero(DerivedAccel.Z))
@@ -525,6 +1310,8 @@ void USurferMovementComponent::PhysFalling(float deltaTime, int32 Iterations)
 		// Move
 		FHitResult Hit(1.f);
 		SafeMoveUpdatedComponent(Adjusted, PawnRotation, true, Hit);
+		INC_DWORD_STAT(STAT_SurferFallingMoves);
+		++FallingMoves;
 
 		if (!HasValidData())
 		{
@@ -714,6 +1501,55 @@ void USurferMovementComponent::PhysFalling(float deltaTime, int32 Iterations)
 
 }
 
+/// <summary>
+/// Flying is only used for noclip, other flying (e.g. the fly cheat) keeps the engine version.
+/// </summary>
+/// <param name="deltaTime"></param>
+/// <param name="Iterations"></param>
+void USurferMovementComponent::PhysFlying(float deltaTime, int32 Iterations)
+{
+	if (bNoClip)
+	{
+		PhysNoClip(deltaTime);
+		return;
+	}
+	Super::PhysFlying(deltaTime, Iterations);
+}
+
+/// <summary>
+/// Minimal integrator for noclip and spectators. Input is turned to the view direction,
+/// velocity eases towards it and the capsule is moved without sweeping, so there is no collision work at all.
+/// </summary>
+/// <param name="deltaTime"></param>
+void USurferMovementComponent::PhysNoClip(float deltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CharPhysNoClip);
+
+	if (deltaTime < MIN_TICK_TIME)
+	{
+		return;
+	}
+
+	const FQuat PawnRotation = UpdatedComponent->GetComponentQuat();
+
+	//Acceleration is input * MaxAcceleration, bring it back to 0..1 and look where the camera looks
+	FVector WishDirection = Acceleration / FMath::Max(GetMaxAcceleration(), KINDA_SMALL_NUMBER);
+	if (CharacterOwner->Controller)
+	{
+		WishDirection = CharacterOwner->GetControlRotation().Quaternion().RotateVector(PawnRotation.UnrotateVector(WishDirection));
+	}
+	const FVector WishVelocity = WishDirection * CachedMaxSpeed;
+
+	Velocity += (WishVelocity - Velocity) * FMath::Min(NoClipAccelerate * deltaTime, 1.0f);
+	if (Velocity.SizeSquared() <= KINDA_SMALL_NUMBER)
+	{
+		Velocity = FVector::ZeroVector;
+		return;
+	}
+
+	MoveUpdatedComponent(Velocity * deltaTime, PawnRotation, false);
+}
+
 /// <summary>
 /// Simple check for restricting movement in air
 /// </summary>
@@ -736,7 +1572,7 @@ FVector USurferMovementComponent::NewFallVelocity(const FVector& InitialVelocity
 	//Here I assign the falling velocity depending on the provided function
 	FVector FallVel = Super::NewFallVelocity(InitialVelocity, Gravity, DeltaTime);
 	//Here its simply clamped based on axis
-	FallVel.Z = FMath::Clamp(FallVel.Z, -AxisSpeedLimit, AxisSpeedLimit);
+	FallVel.Z = FMath::Clamp(FallVel.Z, -ActiveTuning->AxisSpeedLimit, ActiveTuning->AxisSpeedLimit);
 	//return
 	return FallVel;
 }
@@ -750,8 +1586,29 @@ FVector USurferMovementComponent::NewFallVelocity(const FVector& InitialVelocity
 void USurferMovementComponent::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
 {
 	Super::UpdateCharacterStateBeforeMovement(DeltaSeconds);
-	Velocity.Z = FMath::Clamp(Velocity.Z, -AxisSpeedLimit, AxisSpeedLimit);
+	Velocity.Z = FMath::Clamp(Velocity.Z, -ActiveTuning->AxisSpeedLimit, ActiveTuning->AxisSpeedLimit);
 	//UpdateCrouching(DeltaSeconds);
+
+	//Advance the jump buffer clock
+	StepStartTime = SimulationTime;
+	StepDeltaTime = DeltaSeconds;
+	SimulationTime += DeltaSeconds;
+	++SimulationStep;
+	bBufferedHopThisStep = false;
+
+	//A new press that CheckJumpInput couldn't use (we're in the air) goes into the buffer
+	const bool bPressedJump = CharacterOwner && CharacterOwner->bPressedJump;
+	if (bPressedJump && !bLastPressedJump && !CharacterOwner->bWasJumping && IsFalling())
+	{
+		JumpBuffer.Press(StepStartTime, SimulationStep);
+	}
+	bLastPressedJump = bPressedJump;
+
+	//Too old to count
+	if (JumpBuffer.bPending && !JumpBuffer.IsInWindow(StepStartTime, SimulationStep, FSurferJumpBuffer::GetWindowSeconds(), FSurferJumpBuffer::GetWindowTicks()))
+	{
+		JumpBuffer.Reset();
+	}
 }
 
 /// <summary>
@@ -762,7 +1619,7 @@ void USurferMovementComponent::UpdateCharacterStateBeforeMovement(float DeltaSec
 void USurferMovementComponent::UpdateCharacterStateAfterMovement(float DeltaSeconds)
 {
 	Super::UpdateCharacterStateAfterMovement(DeltaSeconds);
-	Velocity.Z = FMath::Clamp(Velocity.Z, -AxisSpeedLimit, AxisSpeedLimit);
+	Velocity.Z = FMath::Clamp(Velocity.Z, -ActiveTuning->AxisSpeedLimit, ActiveTuning->AxisSpeedLimit);
 	UpdateSurfaceFriction();
 	//UpdateCrouching(DeltaSeconds, true);
 }
@@ -774,14 +1631,53 @@ void USurferMovementComponent::UpdateCharacterStateAfterMovement(float DeltaSeco
 /// <param name="bIsSliding"></param>
 void USurferMovementComponent::UpdateSurfaceFriction(bool bIsSliding)
 {
+	//Nothing to trace against in noclip
+	if (bNoClip)
+	{
+		SurfaceFriction = 1.0f;
+		return;
+	}
+
 	//Check for mode of walking and if on floor
 	if (!IsFalling() && CurrentFloor.IsWalkableFloor())
 	{
-		//If it results in hit the floor,
-		//just apply friciton 
-		FHitResult Hit;
-		TraceCharacterFloor(Hit);
-		SurfaceFriction = SurfaceFrictionHit(Hit);
+		if (CVarAsyncFloorTrace.GetValueOnGameThread() != 0)
+		{
+			//Several moves in one frame (server catching up on client moves) share the sweep queued by the first one,
+			//a second request would overwrite the handle and the result of the first would be lost
+			if (FloorTraceFrame == GFrameCounter)
+			{
+				return;
+			}
+
+			//Take the sweep queued last frame when it was queued close to here, otherwise the result is stale and
+			//the floor gets swept right away. Then queue the sweep for the next frame
+			const FVector Location = UpdatedComponent->GetComponentLocation();
+			FTraceDatum FloorDatum;
+			if (FloorTraceFrame + 1 == GFrameCounter
+				&& FVector::DistSquared(FloorTraceLocation, Location) < FMath::Square(GetPawnCapsuleCollisionShape(SHRINK_None).GetCapsuleRadius())
+				&& GetWorld()->QueryTraceData(FloorTraceHandle, FloorDatum))
+			{
+				SurfaceFriction = FloorDatum.OutHits.Num() > 0 ? SurfaceFrictionHit(FloorDatum.OutHits[0]) : 1.0f;
+			}
+			else
+			{
+				FHitResult Hit;
+				TraceCharacterFloor(Hit);
+				SurfaceFriction = SurfaceFrictionHit(Hit);
+			}
+			FloorTraceHandle = RequestCharacterFloorTrace();
+			FloorTraceFrame = GFrameCounter;
+			FloorTraceLocation = Location;
+		}
+		else
+		{
+			//If it results in hit the floor,
+			//just apply friciton 
+			FHitResult Hit;
+			TraceCharacterFloor(Hit);
+			SurfaceFriction = SurfaceFrictionHit(Hit);
+		}
 	}
 	else
 	{//Otherwise just make so its a sliding movmeent 
@@ -873,6 +1769,7 @@ bool USurferMovementComponent::DoJump(bool bClientSimulation)
 			{
 				Velocity.Z += JumpZVelocity;
 			}
+			JumpBuffer.Reset();
 			//Lastly after jump change mode of movement to falling
 			SetMovementMode(MOVE_Falling);
 			return true;
@@ -955,7 +1852,7 @@ FVector USurferMovementComponent::HandleSlopeBoosting(const FVector& SlideResult
 	}
 	//Camera behacior on the slopes 
 	// probably useless
-	const float BounceCoefficient = 1.0f + CameraShakeMultiplier * (1.0f - SurfaceFriction);
+	const float BounceCoefficient = 1.0f + ActiveTuning->CameraShakeMultiplier * (1.0f - SurfaceFriction);
 	return (Delta - BounceCoefficient * Delta.ProjectOnToNormal(ImpactNormal)) * Time;
 }
 
@@ -971,8 +1868,15 @@ FVector USurferMovementComponent::HandleSlopeBoosting(const FVector& SlideResult
 /// <returns></returns>
 bool USurferMovementComponent::ShouldCatchAir(const FFindFloorResult& OldFloor, const FFindFloorResult& NewFloor)
 {
+	//Standing still never surfs, and would divide by zero below (move.Fuzz)
+	const float Speed2D = Velocity.Size2D();
+	if (Speed2D < KINDA_SMALL_NUMBER)
+	{
+		return Super::ShouldCatchAir(OldFloor, NewFloor);
+	}
+
 	//Scaling speed with friction
-	const float SpeedMultiplier = MaximalSpeedMultiplier / Velocity.Size2D();
+	const float SpeedMultiplier = ActiveTuning->MaximalSpeedMultiplier / Speed2D;
 	// Get surface friction
 	const float CurrentSurfaceFriction = SurfaceFrictionHit(OldFloor.HitResult);
 	//check for trying to surf
@@ -1131,28 +2035,69 @@ void USurferMovementComponent::TraceCharacterFloor(FHitResult& OutHit)
 {
 	FCollisionQueryParams CapsuleParams(SCENE_QUERY_STAT(CharacterFloorTrace), false, CharacterOwner);
 	FCollisionResponseParams ResponseParam;
-	InitCollisionParams(CapsuleParams, ResponseParam);
-	// must trace complex to get mesh phys materials
-	CapsuleParams.bTraceComplex = true;
-	// must get materials
-	CapsuleParams.bReturnPhysicalMaterial = true;
+	FVector PawnLocation;
+	FVector StandingLocation;
+	GetFloorTraceParams(CapsuleParams, ResponseParam, PawnLocation, StandingLocation);
 
-	const FCollisionShape StandingCapsuleShape = GetPawnCapsuleCollisionShape(SHRINK_None);
-	const ECollisionChannel CollisionChannel = UpdatedComponent->GetCollisionObjectType();
-	const FVector PawnLocation = UpdatedComponent->GetComponentLocation();
-	FVector StandingLocation = PawnLocation;
-	StandingLocation.Z -= MAX_FLOOR_DIST * 10.0f;
+	INC_DWORD_STAT(STAT_SurferSyncFloorTraces);
 	GetWorld()->SweepSingleByChannel(
 		OutHit,
 		PawnLocation,
 		StandingLocation,
 		FQuat::Identity,
-		CollisionChannel,
-		StandingCapsuleShape,
+		UpdatedComponent->GetCollisionObjectType(),
+		GetPawnCapsuleCollisionShape(SHRINK_None),
+		CapsuleParams,
+		ResponseParam
+	);
+
+}
+
+/// <summary>
+/// Queues the floor sweep into the async trace buffer of the world instead of running it right away.
+/// Engine runs every queued trace of the frame together at the end of the frame, so the scene lock and broad-phase setup
+/// is paid once for all surfers. The result can be picked up next frame with QueryTraceData.
+/// </summary>
+/// <returns></returns>
+FTraceHandle USurferMovementComponent::RequestCharacterFloorTrace()
+{
+	FCollisionQueryParams CapsuleParams(SCENE_QUERY_STAT(CharacterFloorTrace), false, CharacterOwner);
+	FCollisionResponseParams ResponseParam;
+	FVector PawnLocation;
+	FVector StandingLocation;
+	GetFloorTraceParams(CapsuleParams, ResponseParam, PawnLocation, StandingLocation);
+
+	INC_DWORD_STAT(STAT_SurferAsyncFloorTraces);
+	return GetWorld()->AsyncSweepByChannel(
+		EAsyncTraceType::Single,
+		PawnLocation,
+		StandingLocation,
+		FQuat::Identity,
+		UpdatedComponent->GetCollisionObjectType(),
+		GetPawnCapsuleCollisionShape(SHRINK_None),
 		CapsuleParams,
 		ResponseParam
 	);
+}
+
+/// <summary>
+/// Filling the query params and the start/end of the floor sweep.
+/// </summary>
+/// <param name="OutParams"></param>
+/// <param name="OutResponseParam"></param>
+/// <param name="OutStart"></param>
+/// <param name="OutEnd"></param>
+void USurferMovementComponent::GetFloorTraceParams(FCollisionQueryParams& OutParams, FCollisionResponseParams& OutResponseParam, FVector& OutStart, FVector& OutEnd) const
+{
+	InitCollisionParams(OutParams, OutResponseParam);
+	// must trace complex to get mesh phys materials
+	OutParams.bTraceComplex = true;
+	// must get materials
+	OutParams.bReturnPhysicalMaterial = true;
 
+	OutStart = UpdatedComponent->GetComponentLocation();
+	OutEnd = OutStart;
+	OutEnd.Z -= MAX_FLOOR_DIST * 10.0f;
 }
 
 /// <summary>
@@ -1166,22 +2111,11 @@ void USurferMovementComponent::OnMovementModeChanged(EMovementMode PreviousMovem
 	// So i want to make change mode only whenever full step is done
 	StepSide = false;
 
-	//jump or land
-	bool bJumped = false;
-
-	//Taking previous mode 
-	if (PreviousMovementMode == MOVE_Walking && MovementMode == MOVE_Falling)
-	{
-		bJumped = true;
-	}
-
-	////tracing floor
-	FHitResult Hit;
-	TraceCharacterFloor(Hit);
-	//PlayJumpSound(Hit, bJumped);
-
 	Super::OnMovementModeChanged(PreviousMovementMode, PreviousCustomMode);
 
+	//Cheat fly/walk flip bCheatFlying together with the mode
+	UpdateMaxSpeedCache();
+
 }
 
 
@@ -1189,8 +2123,10 @@ void USurferMovementComponent::OnMovementModeChanged(EMovementMode PreviousMovem
 /// This hanldes the logic for moving camera in differnt dimensions that will match player velocity.
 /// </summary>
 /// <returns></returns>
-float USurferMovementComponent::CameraBehaviour()
+float USurferMovementComponent::CameraBehaviour(const FVector& ViewRight) const
 {
+	const float RollSpeed = ActiveTuning->RollSpeed;
+	const float RollAngle = ActiveTuning->RollAngle;
 	//if no movement just do nothing
 	if (RollSpeed == 0.0f || RollAngle == 0.0f)
 	{
@@ -1198,7 +2134,7 @@ float USurferMovementComponent::CameraBehaviour()
 	}
 	//assigning values to velocity or roation of the character owner.
 	//this is a value that will detect and recalculate velocity and matrix(3-dimensional) rotation
-	float LookAround = Velocity | FRotationMatrix(GetCharacterOwner()->GetControlRotation()).GetScaledAxis(EAxis::Y);
+	float LookAround = Velocity | ViewRight;
 	//Calculate it to Sign(float, returns - 1 if A < 0, 0 if A is zero, and +1 if A > 0) I use it as detector when velocity of camera changes
 	const float Sign = FMath::Sign(LookAround);
 	//Take the absolute value
@@ -1215,16 +2151,202 @@ float USurferMovementComponent::CameraBehaviour()
 	return LookAround * Sign;
 }
 
-void USurferMovementComponent::SetNoClip(bool bNoClip)
+//Tuning part of the component before the tuning was shared, only here so move.MemoryReport measures it instead of guessing.
+//The 13 Blueprint tuning properties of the original component in declaration order
+struct FSurferTuningLayoutBefore
+{
+	float GroundAccelerationMultiplier;
+	float AirAccelerationMulitplier;
+	float AirSpeedCap;
+	float MinStepHeight;
+	float WalkSpeed;
+	float RunSpeed;
+	float SprintSpeed;
+	float RollAngle;
+	float RollSpeed;
+	float MinimalSpeedMultiplier;
+	float MaximalSpeedMultiplier;
+	float CameraShakeMultiplier;
+	float AxisSpeedLimit;
+};
+
+static_assert(sizeof(FSurferTuningLayoutBefore) == UE_ARRAY_COUNT(TuningOverrideFields) * sizeof(float), "Old tuning layout is the 13 properties and nothing else");
+
+/// <summary>
+/// Per player is the surfer actor with all its components, native size plus what their containers allocated (like obj list).
+/// Before the tuning was shared every component carried the 13 tuning properties. Now it has the pointer to the shared tuning,
+/// the private copy and the arrays for Blueprint overrides and saved Custom values (empty on most surfers).
+/// Editor builds also have the 13 _DEPRECATED properties for loading old assets, they are not in the numbers.
+/// </summary>
+/// <param name="World"></param>
+void USurferMovementComponent::LogMemoryReport(UWorld* World)
+{
+	constexpr int32 TuningBytesBefore = sizeof(FSurferTuningLayoutBefore);
+	constexpr int32 TuningBytesNow = sizeof(const FSurferMovementTuning*) + sizeof(TUniquePtr<FSurferMovementTuning>) + 2 * sizeof(TArray<FSurferTuningOverride>);
+	constexpr int32 SurferBytes = sizeof(USurferMovementComponent) - sizeof(UCharacterMovementComponent);
+
+	UE_LOG(LogSurfer, Display, TEXT("MemoryReport movement component %d bytes, %d of them surfer state (engine part %d)"),
+		(int32)sizeof(USurferMovementComponent), SurferBytes, (int32)sizeof(UCharacterMovementComponent));
+	UE_LOG(LogSurfer, Display, TEXT("MemoryReport tuning per player %d bytes, was %d; %d shared tunings of %d bytes"),
+		TuningBytesNow, TuningBytesBefore, FSurferMovementTuning::GetNumShared(), (int32)sizeof(FSurferMovementTuning));
+	UE_LOG(LogSurfer, Display, TEXT("MemoryReport validator %d, jump buffer %d, input command %d bytes"),
+		(int32)sizeof(FSurferMoveValidator), (int32)sizeof(FSurferJumpBuffer), (int32)sizeof(FSurferInputCmd));
+
+	int32 Players = 0;
+	int32 PrivateTunings = 0;
+	int64 ActorBytes = 0;
+	for (TActorIterator<ASurferCharacter> It(World); It; ++It)
+	{
+		++Players;
+		const USurferMovementComponent* Movement = It->GetMovementPtr();
+		PrivateTunings += Movement && Movement->OverrideTuning.IsValid() ? 1 : 0;
+		TArray<UObject*> Objects;
+		Objects.Add(*It);
+		for (UActorComponent* Component : It->GetComponents())
+		{
+			Objects.Add(Component);
+		}
+		for (UObject* Object : Objects)
+		{
+			FArchiveCountMem Count(Object);
+			ActorBytes += Object->GetClass()->GetStructureSize() + Count.GetMax();
+		}
+	}
+	if (Players > 0)
+	{
+		UE_LOG(LogSurfer, Display, TEXT("MemoryReport %d surfers, %lld bytes per surfer actor with components, %d with a private tuning copy of %d bytes"),
+			Players, ActorBytes / Players, PrivateTunings, (int32)sizeof(FSurferMovementTuning));
+	}
+}
+
+/// <summary>
+/// Old path built a rotation matrix from the control rotation and wrote the roll back into the controller every tick,
+/// new one reuses the right vector while the yaw stays the same. The controller write isn't repeated here,
+/// the new path doesn't do it at all.
+/// Both are warmed up first, then timed in repeated runs that swap which one goes first, and the medians are compared
+/// so cache warmth and clock ramp up don't favour whichever ran second.
+/// </summary>
+/// <param name="Iterations"></param>
+void USurferMovementComponent::BenchmarkCameraRoll(int32 Iterations) const
 {
+	if (CharacterOwner == nullptr)
+	{
+		return;
+	}
+
+	const FRotator ControlRotation = CharacterOwner->GetControlRotation();
+	const int32 Runs = 9;
+	float Sink = 0.0f;
+
+	auto TimeMatrix = [&](int32 Count)
+	{
+		const double Start = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < Count; ++Index)
+		{
+			Sink += CameraBehaviour(FRotationMatrix(ControlRotation).GetScaledAxis(EAxis::Y));
+		}
+		return FPlatformTime::Seconds() - Start;
+	};
+
+	auto TimeCached = [&](int32 Count)
+	{
+		//Every run starts with a stale cache, like the first tick after turning
+		float CachedYaw = ControlRotation.Yaw + 1.0f;
+		FVector CachedRight = FVector::RightVector;
+		const double Start = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < Count; ++Index)
+		{
+			if (ControlRotation.Yaw != CachedYaw)
+			{
+				CachedYaw = ControlRotation.Yaw;
+				float Sin, Cos;
+				FMath::SinCos(&Sin, &Cos, FMath::DegreesToRadians(CachedYaw));
+				CachedRight = FVector(-Sin, Cos, 0.0f);
+			}
+			Sink += CameraBehaviour(CachedRight);
+		}
+		return FPlatformTime::Seconds() - Start;
+	};
+
+	const int32 WarmupIterations = FMath::Max(Iterations / 10, 1);
+	TimeMatrix(WarmupIterations);
+	TimeCached(WarmupIterations);
 
+	TArray<double, TInlineAllocator<Runs>> MatrixTimes;
+	TArray<double, TInlineAllocator<Runs>> CachedTimes;
+	for (int32 Run = 0; Run < Runs; ++Run)
+	{
+		if (Run % 2 == 0)
+		{
+			MatrixTimes.Add(TimeMatrix(Iterations));
+			CachedTimes.Add(TimeCached(Iterations));
+		}
+		else
+		{
+			CachedTimes.Add(TimeCached(Iterations));
+			MatrixTimes.Add(TimeMatrix(Iterations));
+		}
+	}
+	MatrixTimes.Sort();
+	CachedTimes.Sort();
+	const double MatrixTime = MatrixTimes[Runs / 2];
+	const double CachedTime = CachedTimes[Runs / 2];
+
+	UE_LOG(LogSurfer, Display, TEXT("Camera roll x%d, median of %d alternating runs: matrix %.3f ms (%.3f-%.3f), cached right %.3f ms (%.3f-%.3f) (%.2fx) [%f]"),
+		Iterations, Runs, MatrixTime * 1000.0, MatrixTimes[0] * 1000.0, MatrixTimes.Last() * 1000.0,
+		CachedTime * 1000.0, CachedTimes[0] * 1000.0, CachedTimes.Last() * 1000.0, MatrixTime / FMath::Max(CachedTime, 1e-9), Sink);
+}
 
+/// <summary>
+/// Noclip like in source. Collision on the actor goes off and we fly, PhysFlying then runs the cheap free fly.
+/// </summary>
+/// <param name="bInNoClip"></param>
+void USurferMovementComponent::SetNoClip(bool bInNoClip)
+{
+	if (bNoClip == bInNoClip || !HasValidData())
+	{
+		return;
+	}
 
+	bNoClip = bInNoClip;
+	if (CharacterOwner->HasAuthority())
+	{
+		bReplicatedNoClip = bInNoClip;
+		//Flying past the zones doesn't count, the run has to start over
+		if (SurferCharacter)
+		{
+			SurferCharacter->CancelRun();
+		}
+	}
+	bCheatFlying = bInNoClip;
+	CharacterOwner->SetActorEnableCollision(!bInNoClip);
+	//Mode change refreshes the cached max speed as well
+	SetMovementMode(bInNoClip ? MOVE_Flying : MOVE_Falling);
 }
 
 void USurferMovementComponent::ToggleNoClip()
 {
-	
+	SetNoClip(!bNoClip);
+}
+
+/// <summary>
+/// Max speed is read several times per tick by CalcVelocity, IsExceedingMaxSpeed and the engine,
+/// but only changes when sprint/walk/crouch/noclip or the tuning changes. So its just a cached field.
+/// </summary>
+/// <returns></returns>
+float USurferMovementComponent::GetMaxSpeed() const
+{
+	INC_DWORD_STAT(STAT_SurferMaxSpeedCacheReads);
+	return CachedMaxSpeed;
+}
+
+/// <summary>
+/// Called by the character whenever sprint/walk/crouch change, and from here on noclip, mode and tuning changes.
+/// </summary>
+void USurferMovementComponent::UpdateMaxSpeedCache()
+{
+	INC_DWORD_STAT(STAT_SurferMaxSpeedRecalcs);
+	CachedMaxSpeed = ComputeMaxSpeed();
 }
 
 /// <summary>
@@ -1232,17 +2354,25 @@ void USurferMovementComponent::ToggleNoClip()
 /// Also it restricts it and return the values
 /// </summary>
 /// <returns></returns>
-float USurferMovementComponent::GetMaxSpeed() const
-{//if flying ignore not implemented though
+float USurferMovementComponent::ComputeMaxSpeed() const
+{
+	const bool bIsSprinting = SurferCharacter && SurferCharacter->IsSprinting();
+	const bool bWantsToWalk = SurferCharacter && SurferCharacter->DoesWantToWalk();
+
+	//noclip flies at walk speed or sprint speed, times 1.5
 	if (bCheatFlying)
 	{
-		return (SurferCharacter->IsSprinting() ? SprintSpeed : WalkSpeed) * 1.5f;
+		return (bIsSprinting ? ActiveTuning->SprintSpeed : ActiveTuning->WalkSpeed) * 1.5f;
 	}
 
 	// get speed and check on modes and correctly adjst depending on the mode
 	//Its kind of changed version of the case logic in the original CharacterMovemtnComponent.cpp
 	float Speed;
-	if (SurferCharacter->IsSprinting())
+	if (!ActiveTuning->HasSpeedModes())
+	{
+		Speed = ActiveTuning->RunSpeed;
+	}
+	else if (ActiveTuning->bAllowSprint && bIsSprinting)
 	{
 		if (IsCrouching() )
 		{
@@ -1250,20 +2380,20 @@ float USurferMovementComponent::GetMaxSpeed() const
 		}
 		else
 		{
-			Speed = SprintSpeed;
+			Speed = ActiveTuning->SprintSpeed;
 		}
 	}
-	else if (SurferCharacter->DoesWantToWalk())
+	else if (ActiveTuning->bAllowWalk && bWantsToWalk)
 	{
-		Speed = WalkSpeed;
+		Speed = ActiveTuning->WalkSpeed;
 	}
-	else if (IsCrouching() )
+	else if (ActiveTuning->bAllowCrouch && IsCrouching())
 	{
 		Speed = MaxWalkSpeedCrouched;
 	}
 	else
 	{
-		Speed = RunSpeed;
+		Speed = ActiveTuning->RunSpeed;
 	}
 
 	return Speed;
@@ -1282,7 +2412,17 @@ float USurferMovementComponent::GetMaxSpeed() const
 /// <param name="ThisTickFunction"></param>
 void USurferMovementComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
+	//Server picks the level, the owner predicts with the replicated copy
+	if (MovementBudget && CharacterOwner && CharacterOwner->HasAuthority())
+	{
+		SimulationThrottle = static_cast<uint8>(MovementBudget->GetThrottleLevel());
+	}
 
+	//One input command per frame, before Super consumes the input vector
+	if (SurferCharacter && SurferCharacter->IsLocallyControlled())
+	{
+		ApplyInputCmd(SurferCharacter->ConsumeInputCmd());
+	}
 
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
@@ -1297,19 +2437,324 @@ void USurferMovementComponent::TickComponent(float DeltaTime, ELevelTick TickTyp
 	}
 
 	
-	//Displaying data
-	GEngine->AddOnScreenDebugMessage(1, 1.0f, FColor::Red, FString::Printf(TEXT("position: %s"), *UpdatedComponent->GetComponentLocation().ToCompactString()));
-	GEngine->AddOnScreenDebugMessage(2, 1.0f, FColor::Blue, FString::Printf(TEXT("angle: %s"), *CharacterOwner->GetControlRotation().ToCompactString()));
-	GEngine->AddOnScreenDebugMessage(3, 1.0f, FColor::Yellow, FString::Printf(TEXT("velocity: %f"), Velocity.Size()));
-	
-	//Keep control of the rotation and camera when in move
-	if (RollAngle != 0 && RollSpeed != 0) {
-		FRotator ControlRotation = SurferCharacter->GetController()->GetControlRotation();
-		ControlRotation.Roll = CameraBehaviour();
-		SurferCharacter->GetController()->SetControlRotation(ControlRotation);
+	//Displaying data, the first thing to go when the server is over budget
+	if (MovementBudget == nullptr || MovementBudget->AllowDebugFeatures()) {
+		GEngine->AddOnScreenDebugMessage(1, 1.0f, FColor::Red, FString::Printf(TEXT("position: %s"), *UpdatedComponent->GetComponentLocation().ToCompactString()));
+		GEngine->AddOnScreenDebugMessage(2, 1.0f, FColor::Blue, FString::Printf(TEXT("angle: %s"), *CharacterOwner->GetControlRotation().ToCompactString()));
+		GEngine->AddOnScreenDebugMessage(3, 1.0f, FColor::Yellow, FString::Printf(TEXT("velocity: %f"), Velocity.Size()));
 	}
+	
+	//View roll is done by USurferCameraRollModifier on the local camera, not here
 	//Apply constatnt tick based braking/friction when on ground
 	bFrameForBraking = IsMovingOnGround();
 	//bCrouchFrameTolerated = IsCrouching();
 
 }
+
+/// <summary>
+/// Held jump with auto bhop, or a press buffered within the window before this landing
+/// </summary>
+/// <param name="remainingTime"></param>
+/// <returns></returns>
+bool USurferMovementComponent::ShouldHopOnLanding(float remainingTime) const
+{
+	if (CharacterOwner == nullptr || bCheatFlying)
+	{
+		return false;
+	}
+
+	const bool bAutoHop = CharacterOwner->bPressedJump && SurferCharacter && SurferCharacter->WantsAutoBunnyhop();
+	const double LandTime = StepStartTime + FMath::Max(0.0f, StepDeltaTime - remainingTime);
+	return bAutoHop || JumpBuffer.IsInWindow(LandTime, SimulationStep, FSurferJumpBuffer::GetWindowSeconds(), FSurferJumpBuffer::GetWindowTicks());
+}
+
+/// <summary>
+/// Same as the engine landing, but a buffered jump fires right here so the hop keeps its speed.
+/// Landed still gets called for fall damage and such, then we go straight back into falling for the rest of the step.
+/// </summary>
+/// <param name="Hit"></param>
+/// <param name="remainingTime"></param>
+/// <param name="Iterations"></param>
+void USurferMovementComponent::ProcessLanded(const FHitResult& Hit, float remainingTime, int32 Iterations)
+{
+	if (!ShouldHopOnLanding(remainingTime))
+	{
+		Super::ProcessLanded(Hit, remainingTime, Iterations);
+		return;
+	}
+
+	if (CharacterOwner->ShouldNotifyLanded(Hit))
+	{
+		CharacterOwner->Landed(Hit);
+	}
+	if (IsFalling())
+	{
+		SetPostLandedPhysics(Hit);
+	}
+
+	//Same bookkeeping as ACharacter::CheckJumpInput
+	if (IsMovingOnGround() && DoJump(CharacterOwner->bClientUpdating))
+	{
+		bBufferedHopThisStep = true;
+		if (!CharacterOwner->bWasJumping)
+		{
+			CharacterOwner->JumpCurrentCount++;
+			CharacterOwner->JumpForceTimeRemaining = CharacterOwner->GetJumpMaxHoldTime();
+			CharacterOwner->OnJumped();
+		}
+		CharacterOwner->bWasJumping = true;
+	}
+
+	StartNewPhysics(remainingTime, Iterations);
+}
+
+void USurferMovementComponent::ApplyInputCmd(const FSurferInputCmd& Cmd)
+{
+	LastInputCmd = Cmd;
+	if (Cmd.HasMove())
+	{
+		//Noclip flies where the camera looks, otherwise only the yaw counts like the engine dropping Z on ground and in air
+		const FRotator ControlRotation = CharacterOwner->GetControlRotation();
+		const FRotationMatrix ViewMatrix(bNoClip ? ControlRotation : FRotator(0.0f, ControlRotation.Yaw, 0.0f));
+		AddInputVector(ViewMatrix.GetUnitAxis(EAxis::X) * Cmd.ForwardMove + ViewMatrix.GetUnitAxis(EAxis::Y) * Cmd.SideMove);
+	}
+}
+
+void USurferMovementComponent::HandleImpact(const FHitResult& Hit, float TimeSlice, const FVector& MoveDelta)
+{
+	bTouchedSurface = true;
+	Super::HandleImpact(Hit, TimeSlice, MoveDelta);
+}
+
+/// <summary>
+/// Fast surfers near geometry get short substeps so sweeps don't skip ramp edges,
+/// in open air nothing is hit anyway so the steps can be long. Over budget every throttle level halves the substeps.
+/// Everything here comes from the position, velocity and mode at the start of the move and the replicated SimulationThrottle,
+/// which the client and the server both have for the same move, so a replayed move substeps exactly like the server did.
+/// </summary>
+/// <param name="DeltaTime"></param>
+void USurferMovementComponent::UpdateSimulationPolicy(float DeltaTime)
+{
+	//Noclip and spectators fly through everything, there is nothing to sweep carefully for
+	if (CVarAdaptiveSimulation.GetValueOnGameThread() == 0 || bNoClip || MovementMode == MOVE_Flying)
+	{
+		return;
+	}
+
+	const float Speed = Velocity.Size();
+	const bool bNearSurface = IsMovingOnGround() || IsNearSurface(FMath::Min(Speed * DeltaTime, CVarMaxStepDistance.GetValueOnGameThread() * 2.0f));
+
+	float TimeStep = MaxAdaptiveTimeStep;
+	if (Speed > KINDA_SMALL_NUMBER)
+	{
+		const float StepDistance = CVarMaxStepDistance.GetValueOnGameThread() * (bNearSurface ? 1.0f : 2.0f);
+		TimeStep = FMath::Clamp(StepDistance / Speed, MinSimulationTimeStep, MaxAdaptiveTimeStep);
+	}
+	//Room for the extra iterations of slides and landings
+	int32 Iterations = FMath::Clamp(FMath::CeilToInt(DeltaTime / TimeStep) + 2, 2, MaxAdaptiveIterations);
+
+	//Fewer, longer substeps cover the same move. Only moves made after the level reached the owner match the server,
+	//so a level change costs at most the corrections of one round trip
+	if (SimulationThrottle > 0)
+	{
+		Iterations = FMath::Max(2, Iterations >> SimulationThrottle);
+		TimeStep = FMath::Max(TimeStep, DeltaTime / (Iterations - 1));
+	}
+
+	MaxSimulationTimeStep = TimeStep;
+	MaxSimulationIterations = Iterations;
+}
+
+bool USurferMovementComponent::IsNearSurface(float Distance) const
+{
+	const UCapsuleComponent* Capsule = CharacterOwner ? CharacterOwner->GetCapsuleComponent() : nullptr;
+	if (Capsule == nullptr || Distance <= KINDA_SMALL_NUMBER)
+	{
+		return false;
+	}
+
+	//World static only: other players and projectiles are somewhere else on the client than on the server,
+	//the substeps would differ and the move come back as a correction
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(SurferNearSurface), false, CharacterOwner);
+	const FCollisionObjectQueryParams ObjectParams(ECC_WorldStatic);
+	const FCollisionShape Shape = FCollisionShape::MakeCapsule(Capsule->GetScaledCapsuleRadius() + Distance, Capsule->GetScaledCapsuleHalfHeight() + Distance);
+	return GetWorld()->OverlapAnyTestByObjectType(UpdatedComponent->GetComponentLocation(), UpdatedComponent->GetComponentQuat(), ObjectParams, Shape, QueryParams);
+}
+
+void USurferMovementComponent::PerformMovement(float DeltaTime)
+{
+	UpdateSimulationPolicy(DeltaTime);
+	bTouchedSurface = false;
+
+	//Noclip doesn't get to time runs. Only the server times them, a client replaying its moves after a correction
+	//would cross the same zones again, the owner gets the run state replicated instead
+	bTrackZoneMoves = ZoneSubsystem && SurferCharacter && !bNoClip && CharacterOwner->HasAuthority() && !CharacterOwner->bClientUpdating && ZoneSubsystem->HasZones();
+	const double RunStepStart = RunClock;
+	if (CharacterOwner->HasAuthority())
+	{
+		RunClock += DeltaTime;
+	}
+	ZoneSegments.Reset();
+
+	const bool bValidateMove = FSurferMoveValidator::ShouldValidate(*this);
+	if (bValidateMove)
+	{
+		MoveValidator.BeginMove(*this, DeltaTime, bNoClip || !PendingLaunchVelocity.IsZero());
+	}
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	Super::PerformMovement(DeltaTime);
+	if (MovementBudget)
+	{
+		MovementBudget->AddMovementTime(FPlatformTime::Cycles64() - StartCycles);
+	}
+
+	//Before the zones, so a flagged move that reaches the end zone doesn't get on the board
+	if (bValidateMove)
+	{
+		const int32 ViolationsBefore = MoveValidator.GetNumViolations();
+		MoveValidator.EndMove(*this, DeltaTime, bTouchedSurface);
+		if (SurferCharacter && (MoveValidator.GetNumViolations() > ViolationsBefore || MoveValidator.IsStrafeFlagged()))
+		{
+			SurferCharacter->InvalidateRun();
+		}
+	}
+
+	if (bTrackZoneMoves && ZoneSegments.Num() > 0)
+	{
+		ZoneSubsystem->TestStep(SurferCharacter, ZoneSegments, RunStepStart, DeltaTime);
+	}
+	bTrackZoneMoves = false;
+}
+
+/// <summary>
+/// A pending adjustment that is not a good move ack is a correction, the client will snap back to it.
+/// </summary>
+void USurferMovementComponent::SendClientAdjustment()
+{
+	if (SoakStats && HasPredictionData_Server())
+	{
+		const FNetworkPredictionData_Server_Character* ServerData = GetPredictionData_Server_Character();
+		if (ServerData->PendingAdjustment.TimeStamp > 0.0f && !ServerData->PendingAdjustment.bAckGoodMove)
+		{
+			SoakStats->AddCorrection();
+		}
+	}
+
+	Super::SendClientAdjustment();
+}
+
+/// <summary>
+/// Every swept segment of the step is kept with its length, the zones are tested on the whole step once it is done.
+/// The time along the step then goes by the distance travelled, which doesn't depend on the substeps, slides or landings in it.
+/// </summary>
+bool USurferMovementComponent::MoveUpdatedComponentImpl(const FVector& Delta, const FQuat& NewRotation, bool bSweep, FHitResult* OutHit, ETeleportType Teleport)
+{
+	if (!bTrackZoneMoves || UpdatedComponent == nullptr)
+	{
+		return Super::MoveUpdatedComponentImpl(Delta, NewRotation, bSweep, OutHit, Teleport);
+	}
+
+	const FVector Start = UpdatedComponent->GetComponentLocation();
+	const bool bMoved = Super::MoveUpdatedComponentImpl(Delta, NewRotation, bSweep, OutHit, Teleport);
+	const FVector End = UpdatedComponent->GetComponentLocation();
+
+	if (End != Start)
+	{
+		//Getting up and down a step is no progress, only the move across it takes time
+		const float Length = bInStepUp ? (End - Start).Size2D() : FVector::Dist(Start, End);
+		ZoneSegments.Add({ Start, End, Length });
+	}
+	return bMoved;
+}
+
+bool USurferMovementComponent::StepUp(const FVector& GravDir, const FVector& Delta, const FHitResult& Hit, FStepDownResult* OutStepDownResult)
+{
+	const bool bWasInStepUp = bInStepUp;
+	bInStepUp = true;
+	const bool bSteppedUp = Super::StepUp(GravDir, Delta, Hit, OutStepDownResult);
+	bInStepUp = bWasInStepUp;
+	return bSteppedUp;
+}
+
+FNetworkPredictionData_Client* USurferMovementComponent::GetPredictionData_Client() const
+{
+	if (ClientPredictionData == nullptr)
+	{
+		USurferMovementComponent* MutableThis = const_cast<USurferMovementComponent*>(this);
+		MutableThis->ClientPredictionData = new FNetworkPredictionData_Client_Surfer(*this);
+	}
+	return ClientPredictionData;
+}
+
+void FSavedMove_Surfer::Clear()
+{
+	Super::Clear();
+	JumpBuffer = FSurferJumpBuffer();
+	SimulationTime = 0.0;
+	SimulationStep = 0;
+	bLastPressedJump = false;
+}
+
+bool FSavedMove_Surfer::CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter, float MaxDelta) const
+{
+	//A press or a buffered jump in either move has to stay on its own step, or the replay moves the hop
+	const FSavedMove_Surfer* NewSurferMove = static_cast<const FSavedMove_Surfer*>(NewMove.Get());
+	if (bLastPressedJump != NewSurferMove->bLastPressedJump || JumpBuffer.bPending || NewSurferMove->JumpBuffer.bPending)
+	{
+		return false;
+	}
+	return Super::CanCombineWith(NewMove, InCharacter, MaxDelta);
+}
+
+void FSavedMove_Surfer::SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, FNetworkPredictionData_Client_Character& ClientData)
+{
+	Super::SetMoveFor(C, InDeltaTime, NewAccel, ClientData);
+
+	if (const USurferMovementComponent* Movement = Cast<USurferMovementComponent>(C->GetCharacterMovement()))
+	{
+		JumpBuffer = Movement->JumpBuffer;
+		SimulationTime = Movement->SimulationTime;
+		SimulationStep = Movement->SimulationStep;
+		bLastPressedJump = Movement->bLastPressedJump;
+	}
+}
+
+/// <summary>
+/// The combined move starts where the old one did, the server only sees one step for both
+/// </summary>
+void FSavedMove_Surfer::CombineWith(const FSavedMove_Character* OldMove, ACharacter* InCharacter, APlayerController* PC, const FVector& OldStartLocation)
+{
+	Super::CombineWith(OldMove, InCharacter, PC, OldStartLocation);
+
+	const FSavedMove_Surfer* OldSurferMove = static_cast<const FSavedMove_Surfer*>(OldMove);
+	JumpBuffer = OldSurferMove->JumpBuffer;
+	SimulationTime = OldSurferMove->SimulationTime;
+	SimulationStep = OldSurferMove->SimulationStep;
+	bLastPressedJump = OldSurferMove->bLastPressedJump;
+	if (USurferMovementComponent* Movement = Cast<USurferMovementComponent>(InCharacter->GetCharacterMovement()))
+	{
+		Movement->JumpBuffer = JumpBuffer;
+		Movement->SimulationTime = SimulationTime;
+		Movement->SimulationStep = SimulationStep;
+		Movement->bLastPressedJump = bLastPressedJump;
+	}
+}
+
+void FSavedMove_Surfer::PrepMoveFor(ACharacter* C)
+{
+	Super::PrepMoveFor(C);
+
+	if (USurferMovementComponent* Movement = Cast<USurferMovementComponent>(C->GetCharacterMovement()))
+	{
+		Movement->JumpBuffer = JumpBuffer;
+		Movement->SimulationTime = SimulationTime;
+		Movement->SimulationStep = SimulationStep;
+		Movement->bLastPressedJump = bLastPressedJump;
+	}
+}
+
+FSavedMovePtr FNetworkPredictionData_Client_Surfer::AllocateNewMove()
+{
+	return FSavedMovePtr(new FSavedMove_Surfer());
+}
@@ -5,13 +5,30 @@
 #include "CoreMinimal.h"
 #include "GameFramework/CharacterMovementComponent.h"
 #include "Runtime/Launch/Resources/Version.h"
+#include "WorldCollision.h"
+#include "SurferMovementPreset.h"
+#include "SurferJumpBuffer.h"
+#include "SurferMoveValidator.h"
+#include "SurferInputCmd.h"
+#include "SurferZoneSubsystem.h"
 #include "SurferMovementComponent.generated.h"
 
 /**
  * 
  */
 
+//One tuning value a Blueprint set on this component alone, Field indexes the old tuning properties (see TuningOverrideFields)
+USTRUCT()
+struct FSurferTuningOverride
+{
+	GENERATED_BODY()
 
+	UPROPERTY()
+		uint8 Field = 0;
+
+	UPROPERTY()
+		float Value = 0.0f;
+};
 
 
 UCLASS()
@@ -27,6 +44,12 @@ public:
 	USurferMovementComponent();
 
 	virtual void InitializeComponent() override;
+	virtual void UninitializeComponent() override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	virtual void PostLoad() override;
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
 	//Called when a component is registered https://docs.unrealengine.com/4.27/en-US/API/Runtime/Engine/Components/UActorComponent/OnRegister/
 	//This ensures that proper movement component is taken into considerations
 	void OnRegister() override;
@@ -39,6 +62,10 @@ public:
 	virtual void ApplyVelocityBraking(float DeltaTime, float Friction, float BrakingDecelarion) override;
 	//Doing logic when in air
 	void PhysFalling(float deltaTime, int32 Iterations);
+	//Flying, hands noclip over to PhysNoClip
+	void PhysFlying(float deltaTime, int32 Iterations) override;
+	//Free fly for noclip/spectators, no sweeps at all
+	void PhysNoClip(float deltaTime);
 	//restricting movement in air
 	bool ShouldLimitAirControl(float DeltaTime, const FVector& FallAcceleration) const override;
 	//Continues with new fall velocity.
@@ -47,6 +74,10 @@ public:
 	void UpdateCharacterStateBeforeMovement(float DeltaSeconds) override;
 	//Update the character state in PerformMovement right after doing the actual position change
 	void UpdateCharacterStateAfterMovement(float DeltaSeconds) override;
+	//Remembers touching a surface for the substep policy
+	void HandleImpact(const FHitResult& Hit, float TimeSlice = 0.f, const FVector& MoveDelta = FVector::ZeroVector) override;
+	//Landing, fires a buffered jump in the landing substep
+	void ProcessLanded(const FHitResult& Hit, float remainingTime, int32 Iterations) override;
 
 	//Surface friction
 	void UpdateSurfaceFriction(bool bIsSliding = false);
@@ -86,6 +117,9 @@ public:
 	//Trace floor is a very good function that I took directly from projectBorealis that make tracing floor really easy
 	//Essentaily it checks channels of capsle and matches it accordingly with floor
 	void TraceCharacterFloor(FHitResult& OutHit);
+	//Same sweep as TraceCharacterFloor but queued into the world's async trace batch.
+	//Results are read back next frame with QueryTraceData
+	FTraceHandle RequestCharacterFloorTrace();
 
 	//ForceinLine to ensure VS compiles it first in order to keep acceleration top priority
 	FORCEINLINE FVector GetAcceleration() const {
@@ -100,14 +134,33 @@ public:
 	//Calling after mode change
 	virtual void OnMovementModeChanged(EMovementMode PreviousMovementMode, uint8 PreviousCustomMode);
 
-	//
-	float CameraBehaviour();
+	//View roll for the strafe direction, ViewRight is the right vector of the view without roll
+	float CameraBehaviour(const FVector& ViewRight) const;
+
+	//Times the old matrix + control rotation roll against the cached right vector one, move.BenchCameraRoll
+	void BenchmarkCameraRoll(int32 Iterations) const;
+
+	//Simulated proxies: curved extrapolation along gravity and the surf ramp between updates, see SurferDeadReckoning.cpp
+	virtual void MoveSmooth(const FVector& InVelocity, const float DeltaSeconds, FStepDownResult* OutStepDownResult = nullptr) override;
+	//New position of a simulated proxy arrived, measures the prediction error and starts predicting from it
+	virtual void SmoothCorrection(const FVector& OldLocation, const FQuat& OldRotation, const FVector& NewLocation, const FQuat& NewRotation) override;
+
+	//Prediction error of this proxy against plain linear extrapolation, move.ProxyReport
+	void LogProxyReport() const;
+
+	//Throws random state at the velocity, braking, slope and catch air math and checks the invariants, move.Fuzz.
+	//Returns the number of failed cases
+	int32 RunMovementFuzz(int32 Cases, int32 Seed);
 
 	//noclip for cheat
-	void SetNoClip(bool bNoClip);
+	void SetNoClip(bool bInNoClip);
 	//Toggglin noclip
 	void ToggleNoClip();
 
+	bool IsNoClip() const {
+		return bNoClip;
+	}
+
 	//Check for slowing down
 	bool IsFrameBraking() const {
 		return bFrameForBraking;
@@ -117,23 +170,273 @@ public:
 	//	return bInCrouch;
 	//}
 
-	//overriding max speed
+	//overriding max speed, returns the cached value
 	virtual float GetMaxSpeed() const override;
+	//Recomputing the cached max speed, called when sprint/walk/crouch/noclip change
+	void UpdateMaxSpeedCache();
+
+	//Switching the preset asset, replicated so server can change it per player
+	UFUNCTION(BlueprintCallable, Category = "Surfing x Preset")
+		void SetMovementPreset(USurferMovementPreset* NewPreset);
+
+	//Switching to one of the built in styles, clears the preset asset
+	UFUNCTION(BlueprintCallable, Category = "Surfing x Preset")
+		void SetMovementStyle(ESurferMovementStyle NewStyle);
+
+	//Preset asset or built in style the movement runs with, runs are ranked per style
+	FString GetMovementStyleName() const;
+
+	//Server checks of this player's moves
+	const FSurferMoveValidator& GetMoveValidator() const {
+		return MoveValidator;
+	}
+
+	//Movement simulation clock, sum of the simulated steps
+	double GetSimulationTime() const {
+		return SimulationTime;
+	}
+
+	//Server clock runs are timed on, see RunClock
+	double GetRunClock() const {
+		return RunClock;
+	}
+
+	//Tuning that the movement code is currently running with, shared with every surfer on the same preset or style
+	const FSurferMovementTuning& GetMovementTuning() const {
+		return *ActiveTuning;
+	}
+
+	//The tuning used to be Blueprint read/write properties on the component, these keep the old graphs working.
+	//A setter only works on the server, it switches this component alone to a private copy of its tuning with the value changed
+	//until the next preset or style change. The value replicates, so the owner predicts with it too
+	UFUNCTION(BlueprintPure, Category = "Surfing", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetGroundAccelerationMultiplier() const { return ActiveTuning->GroundAccelerationMultiplier; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetGroundAccelerationMultiplier(float Value) { SetTuningValue(&FSurferMovementTuning::GroundAccelerationMultiplier, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing", meta = (DeprecatedFunction, DeprecationMessage = "Read AirAccelerationMultiplier from the movement preset"))
+		float GetAirAccelerationMulitplier() const { return ActiveTuning->AirAccelerationMultiplier; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing", meta = (DeprecatedFunction, DeprecationMessage = "Set AirAccelerationMultiplier on a movement preset"))
+		void SetAirAccelerationMulitplier(float Value) { SetTuningValue(&FSurferMovementTuning::AirAccelerationMultiplier, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetAirSpeedCap() const { return ActiveTuning->AirSpeedCap; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetAirSpeedCap(float Value) { SetTuningValue(&FSurferMovementTuning::AirSpeedCap, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetMinStepHeight() const { return ActiveTuning->MinStepHeight; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetMinStepHeight(float Value) { SetTuningValue(&FSurferMovementTuning::MinStepHeight, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing x Movement", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetWalkSpeed() const { return ActiveTuning->WalkSpeed; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing x Movement", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetWalkSpeed(float Value) { SetTuningValue(&FSurferMovementTuning::WalkSpeed, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing x Movement", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetRunSpeed() const { return ActiveTuning->RunSpeed; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing x Movement", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetRunSpeed(float Value) { SetTuningValue(&FSurferMovementTuning::RunSpeed, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing x Movement", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetSprintSpeed() const { return ActiveTuning->SprintSpeed; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing x Movement", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetSprintSpeed(float Value) { SetTuningValue(&FSurferMovementTuning::SprintSpeed, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing x Camera", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetRollAngle() const { return ActiveTuning->RollAngle; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing x Camera", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetRollAngle(float Value) { SetTuningValue(&FSurferMovementTuning::RollAngle, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing x Camera", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetRollSpeed() const { return ActiveTuning->RollSpeed; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing x Camera", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetRollSpeed(float Value) { SetTuningValue(&FSurferMovementTuning::RollSpeed, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing x Camera", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetMinimalSpeedMultiplier() const { return ActiveTuning->MinimalSpeedMultiplier; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing x Camera", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetMinimalSpeedMultiplier(float Value) { SetTuningValue(&FSurferMovementTuning::MinimalSpeedMultiplier, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing x Movement", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetMaximalSpeedMultiplier() const { return ActiveTuning->MaximalSpeedMultiplier; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing x Movement", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetMaximalSpeedMultiplier(float Value) { SetTuningValue(&FSurferMovementTuning::MaximalSpeedMultiplier, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing x Camera", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetCameraShakeMultiplier() const { return ActiveTuning->CameraShakeMultiplier; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing x Camera", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetCameraShakeMultiplier(float Value) { SetTuningValue(&FSurferMovementTuning::CameraShakeMultiplier, Value); }
+
+	UFUNCTION(BlueprintPure, Category = "Surfing x Camera", meta = (DeprecatedFunction, DeprecationMessage = "Read it from the movement preset"))
+		float GetAxisSpeedLimit() const { return ActiveTuning->AxisSpeedLimit; }
+	UFUNCTION(BlueprintCallable, Category = "Surfing x Camera", meta = (DeprecatedFunction, DeprecationMessage = "Set it on a movement preset"))
+		void SetAxisSpeedLimit(float Value) { SetTuningValue(&FSurferMovementTuning::AxisSpeedLimit, Value); }
+
+	//Bytes of movement state per player and the shared tuning, move.MemoryReport
+	static void LogMemoryReport(UWorld* World);
+
+	//Times the generic velocity update against the specialized ones on this component, move.BenchCalcVelocity
+	void BenchmarkCalcVelocity(int32 Iterations);
+
+	//Jumps the surfer standing on a floor through PerformMovement with the split and the analytic apex,
+	//logs the falling moves per jump and the apex notifications. move.BenchApex
+	void BenchmarkApex(int32 Jumps, float TickRate);
+
+	//Drops the surfer onto the floor below it through PerformMovement with a jump pressed at every step before the landing,
+	//and checks the hop happens exactly when the press was inside the buffer window. Returns the failures, move.TestJumpBuffer
+	int32 TestJumpBufferLanding(float TickRate, float WindowSeconds);
+
+	//Input command the movement ran with this frame, for the network and replay code
+	const FSurferInputCmd& GetLastInputCmd() const {
+		return LastInputCmd;
+	}
+
+	//Saved moves carrying the jump buffer, so a replayed move hops like the original
+	virtual FNetworkPredictionData_Client* GetPredictionData_Client() const override;
 
 	//Show pos for the data display
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing")
 		uint32 bShowPos : 1;
 
 private:
+	//Shared immutable tuning read by the hot path, swapped whenever the preset or style changes
+	const FSurferMovementTuning* ActiveTuning;
+
+	//State read and written every step, kept together and packed into bits.
+	//Max speed for the current sprint/walk/crouch/noclip state
+	float CachedMaxSpeed;
+	//Surface friction
+	float SurfaceFriction;
+	//Change modes
+	TEnumAsByte<EMovementMode> DelayMovementMode;
+	uint8 bDelayMovementMode : 1;
+	//Noclip is on, flying without collision
+	uint8 bNoClip : 1;
+	//Braking as applying friction in the frames.
+	uint8 bFrameForBraking : 1;
+	//A-D behavior aka if character is doing step
+	uint8 StepSide : 1;
+	//Jump input of the previous step, to see new presses
+	uint8 bLastPressedJump : 1;
+	//Hopped off the ground in this step, no ground friction
+	uint8 bBufferedHopThisStep : 1;
+	//Hit something during this step, for the move validator
+	uint8 bTouchedSurface : 1;
+	//Inside PerformMovement with zones to test
+	uint8 bTrackZoneMoves : 1;
+	//Inside StepUp, its vertical moves take no time of the step
+	uint8 bInStepUp : 1;
+	//Simulated proxy got an update to predict from
+	uint8 bHasReckoningUpdate : 1;
+	//Proxy ran into something since the update, straight line until the next one
+	uint8 bReckoningBlocked : 1;
+
+	float ComputeMaxSpeed() const;
+
+	//Picks preset asset, then style, then the values set on the component
+	void RefreshMovementTuning();
+	//Engine movement values as the designer set them on the component, before any style overwrote them. Used by Custom
+	const FSurferMovementTuning* CustomTuning;
+	void CaptureCustomTuning();
+	//Writes tuning into the component and the base movement properties
+	void ApplyMovementTuning(const FSurferMovementTuning& NewTuning);
+	//Copies ActiveTuning into the properties the base CharacterMovementComponent reads itself
+	void ApplyActiveTuning();
+	//Records one value for the deprecated Blueprint setters, server only
+	void SetTuningValue(float FSurferMovementTuning::* Field, float Value);
+	//Puts TuningOverrides on top of the tuning RefreshMovementTuning picked
+	void ApplyTuningOverrides();
+	//Copy of the active tuning with the overrides in it. Never shared, Blueprint values would otherwise stay interned until exit
+	TUniquePtr<FSurferMovementTuning> OverrideTuning;
+	//Hot reload of edited preset assets
+	void HandlePresetChanged(const USurferMovementPreset* ChangedPreset);
+
+	//Velocity update variants, compiled per combination so the per tick path has no mode checks
+	typedef void (USurferMovementComponent::*FCalcVelocityPath)(float, float, bool, float);
+	template<bool bSpecialCases, bool bSpeedModes>
+	void CalcVelocityPath(float DeltaTime, float Friction, bool bFluid, float BrakingDeceleration);
+	//Picked in ApplyMovementTuning
+	FCalcVelocityPath SelectedCalcVelocityPath;
+	void SelectCalcVelocityPath();
+
 	//Some values for character to mach
 	float DefaultStepHeight;
 	float DefaultWalkableFloorZ;
-	float SurfaceFriction;
 
-
-	//Change modes
-	bool bDelayMovementMode;
-	EMovementMode DelayMovementMode;
+	//Floor sweep queued last frame, consumed in UpdateSurfaceFriction
+	FTraceHandle FloorTraceHandle;
+	//Frame the sweep was queued in and where from, older results or ones from elsewhere are not used
+	uint64 FloorTraceFrame;
+	FVector FloorTraceLocation;
+
+	//Shared setup for the sync and async floor sweeps
+	void GetFloorTraceParams(FCollisionQueryParams& OutParams, FCollisionResponseParams& OutResponseParam, FVector& OutStart, FVector& OutEnd) const;
+
+	friend class FSavedMove_Surfer;
+
+	//Jump pressed in the air, waiting for the landing
+	FSurferJumpBuffer JumpBuffer;
+	//Movement simulation clock for the jump buffer
+	double SimulationTime;
+	int64 SimulationStep;
+	//Same moves the "Surfer falling moves" stat counts, that one only lives for a frame and is compiled out of shipping
+	uint64 FallingMoves;
+	//Start and length of the step being simulated
+	double StepStartTime;
+	float StepDeltaTime;
+
+	//Input taken from the character this frame
+	FSurferInputCmd LastInputCmd;
+	//Turns the command into the one input vector the engine movement consumes
+	void ApplyInputCmd(const FSurferInputCmd& Cmd);
+
+	//Frame budget shared by all surfers in the world
+	UPROPERTY(Transient)
+		class USurferMovementBudget* MovementBudget;
+	//Picks MaxSimulationTimeStep and MaxSimulationIterations for this step from speed, surfaces and the governor level
+	void UpdateSimulationPolicy(float DeltaTime);
+	//World static geometry within the distance the surfer can cover this step. Only reads the state at the start of the move
+	bool IsNearSurface(float Distance) const;
+
+	//Run zones of the world, tested with the capsule sweep of every move
+	UPROPERTY(Transient)
+		class USurferZoneSubsystem* ZoneSubsystem;
+
+	//Server numbers for capacity planning, counts the corrections
+	UPROPERTY(Transient)
+		class USurferSoakStats* SoakStats;
+
+	//Validation of the moves the owning client sends, server only
+	FSurferMoveValidator MoveValidator;
+
+	//Simulated proxy state since the last update
+	FVector ReckoningLocation;
+	FVector ReckoningVelocity;
+	//Replicated velocity at the update, for the linear reference
+	FVector ReckoningLinearVelocity;
+	//Surf ramp under the proxy at the update, zero when not on one
+	FVector ReckoningSurfNormal;
+	double ReckoningUpdateTime;
+	//move.DeadReckoning and the movement budget both allow it
+	bool IsDeadReckoningAllowed() const;
+
+	//Proxy prediction error at each update, ours and what linear extrapolation would have had
+	int32 ProxyUpdates;
+	double ProxyUpdateIntervalSum;
+	double ProxyErrorSum;
+	float ProxyErrorMax;
+	double ProxyLinearErrorSum;
+	float ProxyLinearErrorMax;
+	//Server only, sum of the move deltas the server simulated. For a remote player those come from the timestamps
+	//of its moves, so it doesn't depend on the server frame and is never rewound by a replay like SimulationTime
+	double RunClock;
+	//Swept moves of the current step, tested against the zones once the step is done
+	TArray<FSurferZoneSegment> ZoneSegments;
+
+	//Landing at remainingTime into the current step, should the buffered or held jump fire
+	bool ShouldHopOnLanding(float remainingTime) const;
 
 
 protected:
@@ -145,28 +448,90 @@ protected:
 	//float MoveSoundTime;
 
 
-	//A-D behavior aka if character is doing step
-	bool StepSide;
-
-	//Properties for calcualting various movement behaviours\
-	//Ground acceleration
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing")
-		float GroundAccelerationMultiplier;
+	//Preset asset with tuning values, wins over MovementStyle when set
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, ReplicatedUsing = OnRep_MovementPreset, Category = "Surfing x Preset")
+		USurferMovementPreset* MovementPreset;
+
+	//Built in style when there is no preset asset, Custom keeps the engine movement values set on the component
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, ReplicatedUsing = OnRep_MovementPreset, Category = "Surfing x Preset")
+		ESurferMovementStyle MovementStyle = ESurferMovementStyle::Custom;
+
+	UFUNCTION()
+		void OnRep_MovementPreset();
+
+	//Server's runtime edits of MovementPreset (move.PresetSet), clients replay them on their copy of the asset
+	UPROPERTY(Transient, ReplicatedUsing = OnRep_PresetState)
+		FSurferPresetState PresetState;
+
+	UFUNCTION()
+		void OnRep_PresetState();
+
+	//Values set through the deprecated Blueprint setters, cleared by the next preset or style change
+	UPROPERTY(Transient, ReplicatedUsing = OnRep_TuningOverrides)
+		TArray<FSurferTuningOverride> TuningOverrides;
+
+	UFUNCTION()
+		void OnRep_TuningOverrides();
+
+	//Values of the old tuning properties saved on this component, Custom applies them on top of the engine values
+	UPROPERTY()
+		TArray<FSurferTuningOverride> CustomTuningValues;
+
+#if WITH_EDITORONLY_DATA
+	//The old tuning properties, only loaded so PostLoad can move what was saved into CustomTuningValues
+	UPROPERTY()
+		float GroundAccelerationMultiplier_DEPRECATED;
+	UPROPERTY()
+		float AirAccelerationMulitplier_DEPRECATED;
+	UPROPERTY()
+		float AirSpeedCap_DEPRECATED;
+	UPROPERTY()
+		float MinStepHeight_DEPRECATED;
+	UPROPERTY()
+		float WalkSpeed_DEPRECATED;
+	UPROPERTY()
+		float RunSpeed_DEPRECATED;
+	UPROPERTY()
+		float SprintSpeed_DEPRECATED;
+	UPROPERTY()
+		float RollAngle_DEPRECATED;
+	UPROPERTY()
+		float RollSpeed_DEPRECATED;
+	UPROPERTY()
+		float MinimalSpeedMultiplier_DEPRECATED;
+	UPROPERTY()
+		float MaximalSpeedMultiplier_DEPRECATED;
+	UPROPERTY()
+		float CameraShakeMultiplier_DEPRECATED;
+	UPROPERTY()
+		float AxisSpeedLimit_DEPRECATED;
+#endif
+
+	//Noclip as others see it, their proxies of this surfer drop collision too. The owner gets it through the noclip RPCs
+	UPROPERTY(Transient, ReplicatedUsing = OnRep_NoClip)
+		bool bReplicatedNoClip;
+
+	UFUNCTION()
+		void OnRep_NoClip();
+
+	//Governor level the server runs this surfer's moves at. The owner predicts with the same substeps, so it has to have it too
+	UPROPERTY(Transient, Replicated)
+		uint8 SimulationThrottle;
+
+	//Adaptive substeps and the frame budget around the engine movement
+	virtual void PerformMovement(float DeltaTime) override;
+
+	//Every sweep of the step goes through here, tests it against the run zones with the time it covered
+	virtual bool MoveUpdatedComponentImpl(const FVector& Delta, const FQuat& NewRotation, bool bSweep, FHitResult* OutHit = nullptr, ETeleportType Teleport = ETeleportType::None) override;
 
-	//Air Acceeleration
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing")
-		float AirAccelerationMulitplier;
-
-	//Restricting speed in air
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing")
-		float AirSpeedCap;
+public:
+	//Counts the corrections sent to the owning client for the soak report
+	virtual void SendClientAdjustment() override;
 
-	//Minimal distance to walk on stuff
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing")
-		float MinStepHeight;
+	//Its up and down moves are only there to get over the step, they are kept out of the run timing
+	virtual bool StepUp(const FVector& GravDir, const FVector& Delta, const FHitResult& Hit, FStepDownResult* OutStepDownResult = nullptr) override;
 
-	//Braking as applying friction in the frames.
-	bool bFrameForBraking;
+protected:
 
 	//bool bCrouchFrameTolerated = false;
 
@@ -177,46 +542,42 @@ protected:
 
 	class ASurferCharacter* SurferCharacter;
 
-	//Setting up properties for stats like speed etc.
-
-
-	//Walk speed when you hold shift 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
-		float WalkSpeed;
-	//Run is a default mode
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
-		float RunSpeed;
-
-	//Sprint mode when exceeding speed
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
-		float SprintSpeed;
-
 	//i think irrelevant
 	//UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
 		//float LadderSpeed;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing x Camera")
-		float RollAngle = 0.0f;
-
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing x Camera")
-		float RollSpeed = 0.0f;
+	//bool bShouldPlayMoveSounds = true;
 
-	// Minimum speed to scale up from for slope movement  
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing x Camera", meta = (ClampMin = "0", UIMin = "0"))
-		float MinimalSpeedMultiplier;
+};
 
-	// Max speed to scale up from for slope movement 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
-		float MaximalSpeedMultiplier;
+//Saved move with the jump buffer state
+class FSavedMove_Surfer : public FSavedMove_Character
+{
+	typedef FSavedMove_Character Super;
 
-	//Speed of rolling the camera 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing x Camera")
-		float CameraShakeMultiplier = 0.0f;
+public:
+	//Jump buffer state at the start of the move, put back before the move is replayed after a correction
+	FSurferJumpBuffer JumpBuffer;
+	double SimulationTime = 0.0;
+	int64 SimulationStep = 0;
+	bool bLastPressedJump = false;
+
+	virtual void Clear() override;
+	virtual bool CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter, float MaxDelta) const override;
+	virtual void SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, FNetworkPredictionData_Client_Character& ClientData) override;
+	virtual void CombineWith(const FSavedMove_Character* OldMove, ACharacter* InCharacter, APlayerController* PC, const FVector& OldStartLocation) override;
+	virtual void PrepMoveFor(ACharacter* C) override;
+};
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Surfing x Camera", meta = (ClampMin = "0", UIMin = "0"))
-		float AxisSpeedLimit = 6666.6f;
+class FNetworkPredictionData_Client_Surfer : public FNetworkPredictionData_Client_Character
+{
+	typedef FNetworkPredictionData_Client_Character Super;
 
-	
-	//bool bShouldPlayMoveSounds = true;
+public:
+	FNetworkPredictionData_Client_Surfer(const UCharacterMovementComponent& ClientMovement)
+		: Super(ClientMovement)
+	{
+	}
 
+	virtual FSavedMovePtr AllocateNewMove() override;
 };
@@ -0,0 +1,224 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferMovementComponent.h"
+
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectIterator.h"
+
+#include "SpeedGam340.h"
+#include "SurferCharacter.h"
+
+/* Fuzzing for the surf math. Tuning changes have given us NaN velocities and speed gained from ramps before,
+* this runs the real component functions on random input and checks what must always hold:
+* - CalcVelocity: no NaN, horizontal axes inside AxisSpeedLimit, step height and walkable floor stay finite
+* - ApplyVelocityBraking: no NaN, never speeds up, never reverses
+* - HandleSlopeBoosting: no NaN, no speed gained when CameraShakeMultiplier is 0
+* - ShouldCatchAir: leaves the velocity alone, never catches air at zero speed
+*
+* Runs headless too, e.g. a -server -nullrhi instance with -ExecCmds="move.Fuzz 1000000 7, quit".
+* A surfer is spawned for it if the world has none.
+*/
+
+//Random unit vector with extra weight on the cases that have bitten us, flat and vertical
+static FVector RandomNormal(FRandomStream& Stream)
+{
+	switch (Stream.RandHelper(8))
+	{
+	case 0:
+		return FVector::UpVector;
+	case 1:
+		return FVector(Stream.FRandRange(-1.0f, 1.0f), Stream.FRandRange(-1.0f, 1.0f), 0.0f).GetSafeNormal(UE_SMALL_NUMBER, FVector::ForwardVector);
+	default:
+		return Stream.GetUnitVector();
+	}
+}
+
+static FVector RandomVector(FRandomStream& Stream, float MaxComponent)
+{
+	//Sometimes exactly zero, sometimes tiny, mostly anything up to the limit
+	switch (Stream.RandHelper(10))
+	{
+	case 0:
+		return FVector::ZeroVector;
+	case 1:
+		return Stream.GetUnitVector() * KINDA_SMALL_NUMBER;
+	default:
+		return FVector(Stream.FRandRange(-MaxComponent, MaxComponent), Stream.FRandRange(-MaxComponent, MaxComponent), Stream.FRandRange(-MaxComponent, MaxComponent));
+	}
+}
+
+int32 USurferMovementComponent::RunMovementFuzz(int32 Cases, int32 Seed)
+{
+	if (!HasValidData())
+	{
+		UE_LOG(LogSurfer, Warning, TEXT("move.Fuzz needs a surfer with valid movement"));
+		return 0;
+	}
+
+	//Everything the fuzz touches goes back afterwards
+	TGuardValue<FVector> RestoreVelocity(Velocity, Velocity);
+	TGuardValue<FVector> RestoreAcceleration(Acceleration, Acceleration);
+	TGuardValue<float> RestoreStepHeight(MaxStepHeight, MaxStepHeight);
+	TGuardValue<float> RestoreSurfaceFriction(SurfaceFriction, SurfaceFriction);
+	//Slope boosting is checked without bounce, the tuning is shared so it gets swapped instead of changed
+	FSurferMovementTuning NoBounceTuning = *ActiveTuning;
+	NoBounceTuning.CameraShakeMultiplier = 0.0f;
+	TGuardValue<const FSurferMovementTuning*> RestoreTuning(ActiveTuning, FSurferMovementTuning::Share(NoBounceTuning));
+	//Bit fields, no TGuardValue
+	const bool bSavedFrameForBraking = bFrameForBraking;
+	const bool bSavedBufferedHop = bBufferedHopThisStep;
+	bBufferedHopThisStep = false;
+	const TEnumAsByte<EMovementMode> SavedMovementMode = MovementMode;
+	const float SavedWalkableFloorZ = GetWalkableFloorZ();
+
+	FRandomStream Stream(Seed);
+	const float AxisLimit = ActiveTuning->AxisSpeedLimit;
+	//Clamping happens with floats, allow the rounding of a value that size
+	const float Tolerance = AxisLimit * 1.0e-5f;
+	int32 Failed = 0;
+
+	auto Fail = [&](int32 Case, const TCHAR* What)
+	{
+		if (Failed++ < 20)
+		{
+			UE_LOG(LogSurfer, Error, TEXT("move.Fuzz seed %d case %d: %s (velocity %s)"), Seed, Case, What, *Velocity.ToString());
+		}
+	};
+
+	const double StartTime = FPlatformTime::Seconds();
+	for (int32 Case = 0; Case < Cases; ++Case)
+	{
+		const float DeltaTime = Stream.FRandRange(MIN_TICK_TIME, 0.25f);
+		const float Friction = Stream.FRandRange(0.0f, 10.0f);
+		SurfaceFriction = Stream.FRand();
+		bFrameForBraking = Stream.RandHelper(2) != 0;
+		MovementMode = Stream.RandHelper(2) != 0 ? MOVE_Walking : MOVE_Falling;
+
+		//CalcVelocity
+		Velocity = RandomVector(Stream, AxisLimit * 2.0f);
+		Acceleration = Stream.RandHelper(10) == 0 ? FVector::ZeroVector : RandomVector(Stream, MaxAcceleration * 2.0f);
+		CalcVelocity(DeltaTime, Friction, false, Stream.FRandRange(0.0f, 2.0f * BrakingDecelerationWalking));
+		if (Velocity.ContainsNaN())
+		{
+			Fail(Case, TEXT("CalcVelocity produced NaN"));
+		}
+		else if (FMath::Abs(Velocity.X) > AxisLimit + Tolerance || FMath::Abs(Velocity.Y) > AxisLimit + Tolerance)
+		{
+			Fail(Case, TEXT("CalcVelocity exceeded AxisSpeedLimit"));
+		}
+		if (!FMath::IsFinite(MaxStepHeight) || !FMath::IsFinite(GetWalkableFloorZ()))
+		{
+			Fail(Case, TEXT("CalcVelocity left step height or walkable floor non finite"));
+		}
+
+		//ApplyVelocityBraking
+		Velocity = RandomVector(Stream, AxisLimit);
+		const FVector BeforeBraking = Velocity;
+		ApplyVelocityBraking(DeltaTime, Friction, Stream.FRandRange(0.0f, 2.0f * BrakingDecelerationWalking));
+		if (Velocity.ContainsNaN())
+		{
+			Fail(Case, TEXT("ApplyVelocityBraking produced NaN"));
+		}
+		else if (Velocity.SizeSquared() > BeforeBraking.SizeSquared() * (1.0f + KINDA_SMALL_NUMBER) + KINDA_SMALL_NUMBER)
+		{
+			Fail(Case, TEXT("ApplyVelocityBraking gained speed"));
+		}
+		else if ((Velocity | BeforeBraking) < 0.0f)
+		{
+			Fail(Case, TEXT("ApplyVelocityBraking reversed the velocity"));
+		}
+
+		//HandleSlopeBoosting
+		const FVector Delta = RandomVector(Stream, AxisLimit) * DeltaTime;
+		const float Time = Stream.FRand();
+		FHitResult Hit(1.0f);
+		Hit.ImpactNormal = RandomNormal(Stream);
+		Hit.Normal = RandomNormal(Stream);
+		const FVector Boosted = HandleSlopeBoosting(Delta, Delta, Time, Hit.Normal, Hit);
+		if (Boosted.ContainsNaN())
+		{
+			Fail(Case, TEXT("HandleSlopeBoosting produced NaN"));
+		}
+		else if (Boosted.SizeSquared() > (Delta * Time).SizeSquared() * (1.0f + 1.0e-4f) + KINDA_SMALL_NUMBER)
+		{
+			Fail(Case, TEXT("HandleSlopeBoosting gained speed with CameraShakeMultiplier 0"));
+		}
+
+		//ShouldCatchAir
+		FFindFloorResult OldFloor;
+		FFindFloorResult NewFloor;
+		OldFloor.HitResult.ImpactNormal = RandomNormal(Stream);
+		NewFloor.HitResult.ImpactNormal = RandomNormal(Stream);
+		Velocity = Stream.RandHelper(10) == 0 ? FVector::ZeroVector : RandomVector(Stream, AxisLimit);
+		const FVector BeforeCatchAir = Velocity;
+		const bool bCatchAir = ShouldCatchAir(OldFloor, NewFloor);
+		if (Velocity != BeforeCatchAir)
+		{
+			Fail(Case, TEXT("ShouldCatchAir changed the velocity"));
+		}
+		else if (bCatchAir && Velocity.IsNearlyZero())
+		{
+			Fail(Case, TEXT("ShouldCatchAir caught air at zero speed"));
+		}
+	}
+	const double Elapsed = FPlatformTime::Seconds() - StartTime;
+
+	MovementMode = SavedMovementMode;
+	SetWalkableFloorZ(SavedWalkableFloorZ);
+	bFrameForBraking = bSavedFrameForBraking;
+	bBufferedHopThisStep = bSavedBufferedHop;
+
+	UE_LOG(LogSurfer, Display, TEXT("move.Fuzz seed %d: %d cases, %d failed, %.0f cases/sec"),
+		Seed, Cases, Failed, Cases / FMath::Max(Elapsed, 1e-9));
+	return Failed;
+}
+
+//e.g. "move.Fuzz 1000000 7", cases and seed are optional
+static void FuzzMovementForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	if (World == nullptr)
+	{
+		return;
+	}
+
+	const int32 Cases = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100000;
+	const int32 Seed = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : FMath::Rand();
+
+	USurferMovementComponent* Movement = nullptr;
+	for (TObjectIterator<USurferMovementComponent> It; It; ++It)
+	{
+		if (It->GetWorld() == World && !It->IsTemplate() && It->GetOwner())
+		{
+			Movement = *It;
+			break;
+		}
+	}
+
+	//Headless servers have nobody connected, bring our own surfer
+	ASurferCharacter* SpawnedSurfer = nullptr;
+	if (Movement == nullptr)
+	{
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		SpawnParams.ObjectFlags |= RF_Transient;
+		SpawnedSurfer = World->SpawnActor<ASurferCharacter>(ASurferCharacter::StaticClass(), FTransform::Identity, SpawnParams);
+		Movement = SpawnedSurfer ? SpawnedSurfer->GetMovementPtr() : nullptr;
+	}
+
+	if (Movement)
+	{
+		Movement->RunMovementFuzz(Cases, Seed);
+	}
+
+	if (SpawnedSurfer)
+	{
+		SpawnedSurfer->Destroy();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdFuzzMovement(
+	TEXT("move.Fuzz"),
+	TEXT("Run the surf movement math on random input and check its invariants, optional case count and seed\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&FuzzMovementForWorld));
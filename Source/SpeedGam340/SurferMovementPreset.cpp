@@ -0,0 +1,307 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferMovementPreset.h"
+
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ScopeLock.h"
+
+#include "SpeedGam340.h"
+
+FOnSurferMovementPresetChanged USurferMovementPreset::OnPresetChanged;
+
+//Hot reload without the editor, e.g. "move.PresetSet /Game/Presets/Surf64.Surf64 AirSpeedCap 60".
+//Runs on the server, the components using the preset replicate the edit so clients switch with it
+static void SetPresetValue(const TArray<FString>& Args, UWorld* World)
+{
+	if (Args.Num() < 3)
+	{
+		UE_LOG(LogSurfer, Warning, TEXT("Usage: move.PresetSet <PresetPath> <Property> <Value>"));
+		return;
+	}
+
+	if (World != nullptr && World->GetNetMode() == NM_Client)
+	{
+		UE_LOG(LogSurfer, Warning, TEXT("move.PresetSet: run it on the server, clients get the values from there"));
+		return;
+	}
+
+	USurferMovementPreset* Preset = LoadObject<USurferMovementPreset>(nullptr, *Args[0]);
+	if (Preset == nullptr)
+	{
+		UE_LOG(LogSurfer, Warning, TEXT("move.PresetSet: no preset %s"), *Args[0]);
+		return;
+	}
+
+	if (!Preset->SetRuntimeValue(FName(*Args[1]), Args[2]))
+	{
+		UE_LOG(LogSurfer, Warning, TEXT("move.PresetSet: %s is not an editable property or %s is not a valid value for it"), *Args[1], *Args[2]);
+		return;
+	}
+	UE_LOG(LogSurfer, Log, TEXT("move.PresetSet: %s.%s = %s, version %d"), *Preset->GetName(), *Args[1], *Args[2], Preset->Version);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs PresetSetCommand(
+	TEXT("move.PresetSet"),
+	TEXT("Set one value of a movement preset on the server and reapply it to every surfer using it, clients included. Works in cooked builds too"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&SetPresetValue),
+	ECVF_Cheat);
+
+/// <summary>
+/// Built in styles. Source values are converted to UE units (x1.905).
+/// HL2 matches the values that were in the movement component constructor.
+/// </summary>
+/// <param name="Style"></param>
+/// <returns></returns>
+FSurferMovementTuning FSurferMovementTuning::ForStyle(ESurferMovementStyle Style)
+{
+	FSurferMovementTuning Tuning;
+	switch (Style)
+	{
+	case ESurferMovementStyle::CounterStrike16:
+		//sv_accelerate 5, sv_airaccelerate 10, sv_stopspeed 75, sv_maxspeed 250, sv_gravity 800
+		Tuning.GroundAccelerationMultiplier = 5.0f;
+		Tuning.AirAccelerationMultiplier = 10.0f;
+		Tuning.GroundFriction = 4.0f;
+		Tuning.BrakingDecelerationWalking = 142.875f;
+		Tuning.WalkSpeed = 247.65f;
+		Tuning.RunSpeed = 476.25f;
+		Tuning.SprintSpeed = 476.25f;
+		Tuning.JumpZVelocity = 511.1f;
+		Tuning.GravityZ = -1524.0f;
+		break;
+	case ESurferMovementStyle::CounterStrikeGO:
+		//sv_accelerate 5.5, sv_airaccelerate 12, sv_friction 5.2, sv_stopspeed 80, sv_maxspeed 250, sv_gravity 800
+		Tuning.GroundAccelerationMultiplier = 5.5f;
+		Tuning.AirAccelerationMultiplier = 12.0f;
+		Tuning.GroundFriction = 5.2f;
+		Tuning.BrakingDecelerationWalking = 152.4f;
+		Tuning.WalkSpeed = 247.65f;
+		Tuning.RunSpeed = 476.25f;
+		Tuning.SprintSpeed = 476.25f;
+		Tuning.JumpZVelocity = 575.29f;
+		Tuning.GravityZ = -1524.0f;
+		break;
+	case ESurferMovementStyle::TeamFortress2:
+		//sv_accelerate 10, sv_airaccelerate 10, sv_stopspeed 100, 300 HU run (400 HU scout as sprint), sv_gravity 800
+		Tuning.GroundAccelerationMultiplier = 10.0f;
+		Tuning.AirAccelerationMultiplier = 10.0f;
+		Tuning.GroundFriction = 4.0f;
+		Tuning.BrakingDecelerationWalking = 190.5f;
+		Tuning.WalkSpeed = 285.75f;
+		Tuning.RunSpeed = 571.5f;
+		Tuning.SprintSpeed = 762.0f;
+		Tuning.JumpZVelocity = 550.55f;
+		Tuning.GravityZ = -1524.0f;
+		break;
+	case ESurferMovementStyle::HalfLife2:
+	case ESurferMovementStyle::Custom:
+	default:
+		//Defaults of the struct are HL2
+		break;
+	}
+	return Tuning;
+}
+
+bool FSurferMovementTuning::operator==(const FSurferMovementTuning& Other) const
+{
+	return GroundAccelerationMultiplier == Other.GroundAccelerationMultiplier
+		&& AirAccelerationMultiplier == Other.AirAccelerationMultiplier
+		&& AirSpeedCap == Other.AirSpeedCap
+		&& AxisSpeedLimit == Other.AxisSpeedLimit
+		&& WalkSpeed == Other.WalkSpeed
+		&& RunSpeed == Other.RunSpeed
+		&& SprintSpeed == Other.SprintSpeed
+		&& MinStepHeight == Other.MinStepHeight
+		&& MinimalSpeedMultiplier == Other.MinimalSpeedMultiplier
+		&& MaximalSpeedMultiplier == Other.MaximalSpeedMultiplier
+		&& CameraShakeMultiplier == Other.CameraShakeMultiplier
+		&& bAllowSprint == Other.bAllowSprint
+		&& bAllowWalk == Other.bAllowWalk
+		&& bAllowCrouch == Other.bAllowCrouch
+		&& MaxAcceleration == Other.MaxAcceleration
+		&& GroundFriction == Other.GroundFriction
+		&& BrakingDecelerationWalking == Other.BrakingDecelerationWalking
+		&& JumpZVelocity == Other.JumpZVelocity
+		&& GravityZ == Other.GravityZ
+		&& MaxStepHeight == Other.MaxStepHeight
+		&& RollAngle == Other.RollAngle
+		&& RollSpeed == Other.RollSpeed
+		&& Version == Other.Version;
+}
+
+static FCriticalSection SharedTuningsLock;
+static TArray<TUniquePtr<FSurferMovementTuning>> SharedTunings;
+
+/// <summary>
+/// Linear search, there are only as many as presets and styles in use (plus edited preset versions in the editor).
+/// Locked because component constructors can run on the async loading thread.
+/// </summary>
+/// <param name="Tuning"></param>
+/// <returns></returns>
+const FSurferMovementTuning* FSurferMovementTuning::Share(const FSurferMovementTuning& Tuning)
+{
+	FScopeLock Lock(&SharedTuningsLock);
+	for (const TUniquePtr<FSurferMovementTuning>& Shared : SharedTunings)
+	{
+		if (*Shared == Tuning)
+		{
+			return Shared.Get();
+		}
+	}
+	return SharedTunings.Add_GetRef(MakeUnique<FSurferMovementTuning>(Tuning)).Get();
+}
+
+int32 FSurferMovementTuning::GetNumShared()
+{
+	FScopeLock Lock(&SharedTuningsLock);
+	return SharedTunings.Num();
+}
+
+USurferMovementPreset::USurferMovementPreset()
+{
+	SetFromTuning(FSurferMovementTuning::ForStyle(Style));
+}
+
+/// <summary>
+/// Packing the asset into the hot path struct
+/// </summary>
+/// <returns></returns>
+FSurferMovementTuning USurferMovementPreset::ToTuning() const
+{
+	FSurferMovementTuning Tuning;
+	Tuning.MaxAcceleration = MaxAcceleration;
+	Tuning.GroundAccelerationMultiplier = GroundAccelerationMultiplier;
+	Tuning.AirAccelerationMultiplier = AirAccelerationMultiplier;
+	Tuning.AirSpeedCap = AirSpeedCap;
+	Tuning.GroundFriction = GroundFriction;
+	Tuning.BrakingDecelerationWalking = BrakingDecelerationWalking;
+	Tuning.WalkSpeed = WalkSpeed;
+	Tuning.RunSpeed = RunSpeed;
+	Tuning.SprintSpeed = SprintSpeed;
+	Tuning.JumpZVelocity = JumpZVelocity;
+	Tuning.GravityZ = GravityZ;
+	Tuning.MaxStepHeight = MaxStepHeight;
+	Tuning.MinStepHeight = MinStepHeight;
+	Tuning.AxisSpeedLimit = AxisSpeedLimit;
+	Tuning.MinimalSpeedMultiplier = MinimalSpeedMultiplier;
+	Tuning.MaximalSpeedMultiplier = MaximalSpeedMultiplier;
+	Tuning.CameraShakeMultiplier = CameraShakeMultiplier;
+	Tuning.RollAngle = RollAngle;
+	Tuning.RollSpeed = RollSpeed;
+	Tuning.Version = Version;
+	Tuning.bAllowSprint = bAllowSprint;
+	Tuning.bAllowWalk = bAllowWalk;
+	Tuning.bAllowCrouch = bAllowCrouch;
+	return Tuning;
+}
+
+void USurferMovementPreset::NotifyPresetChanged()
+{
+	++Version;
+	OnPresetChanged.Broadcast(this);
+}
+
+bool USurferMovementPreset::SetRuntimeValue(FName PropertyName, const FString& Value)
+{
+	if (!ImportValue(PropertyName, Value))
+	{
+		return false;
+	}
+
+	FSurferPresetEdit* Edit = RuntimeEdits.FindByPredicate([PropertyName](const FSurferPresetEdit& Entry) { return Entry.Property == PropertyName; });
+	if (Edit == nullptr)
+	{
+		Edit = &RuntimeEdits.AddDefaulted_GetRef();
+		Edit->Property = PropertyName;
+	}
+	Edit->Value = Value;
+
+	NotifyPresetChanged();
+	return true;
+}
+
+FSurferPresetState USurferMovementPreset::GetRuntimeState() const
+{
+	FSurferPresetState State;
+	State.Preset = const_cast<USurferMovementPreset*>(this);
+	State.Version = Version;
+	State.Edits = RuntimeEdits;
+	return State;
+}
+
+/// <summary>
+/// Client side of move.PresetSet. Every component on the preset calls this with the same state, only the first one does anything.
+/// </summary>
+/// <param name="State"></param>
+void USurferMovementPreset::ApplyRuntimeState(const FSurferPresetState& State)
+{
+	if (State.Version == Version)
+	{
+		return;
+	}
+
+	for (const FSurferPresetEdit& Edit : State.Edits)
+	{
+		ImportValue(Edit.Property, Edit.Value);
+	}
+	RuntimeEdits = State.Edits;
+	Version = State.Version;
+	OnPresetChanged.Broadcast(this);
+}
+
+bool USurferMovementPreset::ImportValue(FName PropertyName, const FString& Value)
+{
+	//Version only ever comes from NotifyPresetChanged or the server
+	FProperty* Property = StaticClass()->FindPropertyByName(PropertyName);
+	if (Property == nullptr || PropertyName == GET_MEMBER_NAME_CHECKED(USurferMovementPreset, Version) || !Property->HasAnyPropertyFlags(CPF_Edit))
+	{
+		return false;
+	}
+	return Property->ImportText_InContainer(*Value, this, this, PPF_None) != nullptr;
+}
+
+void USurferMovementPreset::SetFromTuning(const FSurferMovementTuning& Tuning)
+{
+	MaxAcceleration = Tuning.MaxAcceleration;
+	GroundAccelerationMultiplier = Tuning.GroundAccelerationMultiplier;
+	AirAccelerationMultiplier = Tuning.AirAccelerationMultiplier;
+	AirSpeedCap = Tuning.AirSpeedCap;
+	GroundFriction = Tuning.GroundFriction;
+	BrakingDecelerationWalking = Tuning.BrakingDecelerationWalking;
+	WalkSpeed = Tuning.WalkSpeed;
+	RunSpeed = Tuning.RunSpeed;
+	SprintSpeed = Tuning.SprintSpeed;
+	JumpZVelocity = Tuning.JumpZVelocity;
+	GravityZ = Tuning.GravityZ;
+	MaxStepHeight = Tuning.MaxStepHeight;
+	MinStepHeight = Tuning.MinStepHeight;
+	AxisSpeedLimit = Tuning.AxisSpeedLimit;
+	MinimalSpeedMultiplier = Tuning.MinimalSpeedMultiplier;
+	MaximalSpeedMultiplier = Tuning.MaximalSpeedMultiplier;
+	CameraShakeMultiplier = Tuning.CameraShakeMultiplier;
+	RollAngle = Tuning.RollAngle;
+	RollSpeed = Tuning.RollSpeed;
+}
+
+#if WITH_EDITOR
+/// <summary>
+/// Every edit bumps the version and tells the components using this preset to reapply it.
+/// That is the hot reload, no restart of PIE or the server needed.
+/// </summary>
+/// <param name="PropertyChangedEvent"></param>
+void USurferMovementPreset::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	NotifyPresetChanged();
+}
+
+void USurferMovementPreset::LoadStyleDefaults()
+{
+	Modify();
+	SetFromTuning(FSurferMovementTuning::ForStyle(Style));
+	NotifyPresetChanged();
+}
+#endif
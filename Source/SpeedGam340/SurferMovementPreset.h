@@ -0,0 +1,251 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "SurferMovementPreset.generated.h"
+
+/* Movement presets hold the tuning values that used to be hard coded in the USurferMovementComponent constructor.
+* Servers can switch between styles (HL2, CS 1.6, CS:GO, TF2) or custom preset assets at runtime.
+* All values are in UE units, Source units are converted with 1 HU = 1.905 UU.
+*
+* https://docs.unrealengine.com/5.1/en-US/data-assets-in-unreal-engine/
+* https://developer.valvesoftware.com/wiki/Dimensions
+*/
+
+UENUM(BlueprintType)
+enum class ESurferMovementStyle : uint8
+{
+	//HL2 surf values with the engine movement values set on the component itself
+	Custom,
+	HalfLife2,
+	CounterStrike16,
+	CounterStrikeGO,
+	TeamFortress2,
+};
+
+//Tuning the movement runs with. Instances are immutable and shared, every surfer on the same preset or style
+//points at the same one (see Share), so none of these values are stored per player.
+//The values read every step come first and fit in one cache line, the rest is only read when the tuning is applied
+struct alignas(PLATFORM_CACHE_LINE_SIZE) FSurferMovementTuning
+{
+	//sv_accelerate
+	float GroundAccelerationMultiplier = 10.0f;
+	//sv_airaccelerate
+	float AirAccelerationMultiplier = 10.0f;
+	//30 HU air speed cap
+	float AirSpeedCap = 57.15f;
+	//sv_maxvelocity
+	float AxisSpeedLimit = 6667.5f;
+	float WalkSpeed = 285.75f;
+	float RunSpeed = 361.9f;
+	float SprintSpeed = 609.6f;
+	float MinStepHeight = 10.0f;
+	//Speeds the step height goes from MaxStepHeight down to MinStepHeight between, the top one also decides catching air.
+	//The component used to compute these from SprintSpeed before it was set, so 0 is what the movement has been tuned with
+	float MinimalSpeedMultiplier = 0.0f;
+	float MaximalSpeedMultiplier = 0.0f;
+	//Bounce off ramps, 0 for none
+	float CameraShakeMultiplier = 0.0f;
+	//Speed modes the server allows, with all of them off GetMaxSpeed is just RunSpeed
+	uint8 bAllowSprint : 1;
+	uint8 bAllowWalk : 1;
+	uint8 bAllowCrouch : 1;
+
+	//cl_forwardspeed / cl_sidespeed
+	float MaxAcceleration = 857.25f;
+	//sv_friction
+	float GroundFriction = 4.0f;
+	//sv_stopspeed
+	float BrakingDecelerationWalking = 190.5f;
+	float JumpZVelocity = 304.8f;
+	//sv_gravity
+	float GravityZ = -1143.0f;
+	float MaxStepHeight = 34.29f;
+	//View roll while strafing, once per frame
+	float RollAngle = 0.0f;
+	float RollSpeed = 0.0f;
+	//Version of the preset this was built from, 0 if it didnt come from an asset
+	int32 Version = 0;
+
+	FSurferMovementTuning()
+		: bAllowSprint(true)
+		, bAllowWalk(true)
+		, bAllowCrouch(true)
+	{
+	}
+
+	bool HasSpeedModes() const {
+		return bAllowSprint || bAllowWalk || bAllowCrouch;
+	}
+
+	bool operator==(const FSurferMovementTuning& Other) const;
+
+	//Built in values for the supported styles
+	static FSurferMovementTuning ForStyle(ESurferMovementStyle Style);
+
+	//Shared immutable copy of Tuning, equal tunings get the same instance. Instances live until exit
+	static const FSurferMovementTuning* Share(const FSurferMovementTuning& Tuning);
+	//Distinct tunings shared so far
+	static int32 GetNumShared();
+};
+
+static_assert(STRUCT_OFFSET(FSurferMovementTuning, MaxAcceleration) <= PLATFORM_CACHE_LINE_SIZE, "Surfer movement tuning read per step has to fit in one cache line");
+
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnSurferMovementPresetChanged, const class USurferMovementPreset*);
+
+//One value changed on a preset while the game runs (move.PresetSet), as the text it was set from
+USTRUCT()
+struct FSurferPresetEdit
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+		FName Property;
+
+	UPROPERTY()
+		FString Value;
+};
+
+//The server's runtime edits of a preset, replicated by the components using it so clients end up on the same values and version
+USTRUCT()
+struct FSurferPresetState
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+		class USurferMovementPreset* Preset = nullptr;
+
+	UPROPERTY()
+		int32 Version = 0;
+
+	UPROPERTY()
+		TArray<FSurferPresetEdit> Edits;
+};
+
+/**
+ * Versioned movement preset asset. Assign it on the movement component or switch it at runtime with move.Preset
+ */
+UCLASS(BlueprintType)
+class SPEEDGAM340_API USurferMovementPreset : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	USurferMovementPreset();
+
+	//Packs the values of this asset into the struct read by the movement code
+	FSurferMovementTuning ToTuning() const;
+
+	//Fired when a preset is edited so components using it can pick up the new values without restart
+	static FOnSurferMovementPresetChanged OnPresetChanged;
+
+	//Bumps the version and fires OnPresetChanged. Editor edits and the move.PresetSet command both end here
+	void NotifyPresetChanged();
+
+	//Sets one property from text and remembers the edit so it can be replicated, false if there is no such property or the value is bad
+	bool SetRuntimeValue(FName PropertyName, const FString& Value);
+
+	//Edits made with SetRuntimeValue and the version they led to
+	FSurferPresetState GetRuntimeState() const;
+
+	//Replays the server's edits on this machine's copy and takes its version, fires OnPresetChanged if anything changed
+	void ApplyRuntimeState(const FSurferPresetState& State);
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+
+	//Overwrite the values with one of the built in styles
+	UFUNCTION(CallInEditor, Category = "Preset")
+		void LoadStyleDefaults();
+#endif
+
+	//Style used by LoadStyleDefaults
+	UPROPERTY(EditAnywhere, Category = "Preset")
+		ESurferMovementStyle Style = ESurferMovementStyle::HalfLife2;
+
+	//Bumped every time the preset is edited
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Preset")
+		int32 Version = 1;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing", meta = (ClampMin = "0", UIMin = "0"))
+		float MaxAcceleration;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing", meta = (ClampMin = "0", UIMin = "0"))
+		float GroundAccelerationMultiplier;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing", meta = (ClampMin = "0", UIMin = "0"))
+		float AirAccelerationMultiplier;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing", meta = (ClampMin = "0", UIMin = "0"))
+		float AirSpeedCap;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing", meta = (ClampMin = "0", UIMin = "0"))
+		float GroundFriction;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing", meta = (ClampMin = "0", UIMin = "0"))
+		float BrakingDecelerationWalking;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
+		float WalkSpeed;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
+		float RunSpeed;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
+		float SprintSpeed;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
+		float JumpZVelocity;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Movement")
+		float GravityZ;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
+		float MaxStepHeight;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
+		float MinStepHeight;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
+		float AxisSpeedLimit;
+
+	//Speeds the step height goes from MaxStepHeight down to MinStepHeight between
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
+		float MinimalSpeedMultiplier;
+
+	//Top of the step height range, also decides catching air off ramps
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
+		float MaximalSpeedMultiplier;
+
+	//Bounce off ramps, 0 for none
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Movement", meta = (ClampMin = "0", UIMin = "0"))
+		float CameraShakeMultiplier;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Camera")
+		float RollAngle;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Camera")
+		float RollSpeed;
+
+	//Turning all speed modes off lets the movement run its specialized path with a constant max speed
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Modes")
+		bool bAllowSprint = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Modes")
+		bool bAllowWalk = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Surfing x Modes")
+		bool bAllowCrouch = true;
+
+private:
+	void SetFromTuning(const FSurferMovementTuning& Tuning);
+
+	bool ImportValue(FName PropertyName, const FString& Value);
+
+	//Latest runtime value per property, in the order they were first set
+	UPROPERTY(Transient)
+		TArray<FSurferPresetEdit> RuntimeEdits;
+};
@@ -0,0 +1,149 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferNetPolicy.h"
+
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+
+#include "SpeedGam340.h"
+#include "SurferCharacter.h"
+#include "SurferMovementBudget.h"
+#include "SurferMovementComponent.h"
+
+static TAutoConsoleVariable<int32> CVarNetPolicy(TEXT("move.NetPolicy"), 1, TEXT("Scale surfer replication rate and priority by speed and distance, 0 keeps the actor defaults\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarNetRateIdle(TEXT("move.NetRateIdle"), 4.0f, TEXT("Updates per second of a standing surfer\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarNetRateFast(TEXT("move.NetRateFast"), 64.0f, TEXT("Updates per second of a surfer at move.NetFastSpeed and above\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarNetFastSpeed(TEXT("move.NetFastSpeed"), 1500.0f, TEXT("Speed at which a surfer gets the full update rate\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarNetNearDistance(TEXT("move.NetNearDistance"), 3000.0f, TEXT("Viewers closer than this get full priority for a surfer\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarNetFarDistance(TEXT("move.NetFarDistance"), 15000.0f, TEXT("Viewers this far away get a quarter of the priority\n"), ECVF_Default);
+static TAutoConsoleVariable<float> CVarNetReportInterval(TEXT("move.NetReportInterval"), 0.0f, TEXT("Seconds between server bandwidth reports in the log, 0 for none\n"), ECVF_Default);
+
+//Rates follow speed, they don't need to every frame
+constexpr float NetPolicyInterval = 0.25f;
+
+//Bandwidth and rates, e.g. "move.NetReport"
+static void NetReportForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	if (const USurferNetPolicy* Policy = World ? World->GetSubsystem<USurferNetPolicy>() : nullptr)
+	{
+		Policy->LogReport();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdNetReport(
+	TEXT("move.NetReport"),
+	TEXT("Log the server's outgoing bandwidth per client and the surfer replication rates\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&NetReportForWorld));
+
+TStatId USurferNetPolicy::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USurferNetPolicy, STATGROUP_Tickables);
+}
+
+float USurferNetPolicy::GetViewerPriorityScale(const AActor* Actor, const FVector& ViewPos)
+{
+	if (CVarNetPolicy.GetValueOnGameThread() == 0)
+	{
+		return 1.0f;
+	}
+
+	const float Near = CVarNetNearDistance.GetValueOnGameThread();
+	const float Far = FMath::Max(CVarNetFarDistance.GetValueOnGameThread(), Near + 1.0f);
+	const float Distance = FVector::Dist(Actor->GetActorLocation(), ViewPos);
+	return FMath::GetMappedRangeValueClamped(FVector2f(Near, Far), FVector2f(1.0f, 0.25f), Distance);
+}
+
+void USurferNetPolicy::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	UWorld* World = GetWorld();
+	if (World == nullptr || World->GetNetMode() == NM_Client || World->GetNetMode() == NM_Standalone)
+	{
+		return;
+	}
+
+	const float ReportInterval = CVarNetReportInterval.GetValueOnGameThread();
+	if (ReportInterval > 0.0f && (TimeToReport -= DeltaTime) <= 0.0f)
+	{
+		TimeToReport = ReportInterval;
+		LogReport();
+	}
+
+	if ((TimeToUpdate -= DeltaTime) > 0.0f || CVarNetPolicy.GetValueOnGameThread() == 0)
+	{
+		return;
+	}
+	TimeToUpdate = NetPolicyInterval;
+
+	const float IdleRate = FMath::Max(CVarNetRateIdle.GetValueOnGameThread(), 1.0f);
+	//Over budget servers send fast surfers less often, see USurferMovementBudget
+	USurferMovementBudget* Budget = World->GetSubsystem<USurferMovementBudget>();
+	const float NetRateScale = Budget ? Budget->GetNetRateScale() : 1.0f;
+	const float FastRate = FMath::Max(CVarNetRateFast.GetValueOnGameThread() * NetRateScale, IdleRate);
+	const float FastSpeed = FMath::Max(CVarNetFastSpeed.GetValueOnGameThread(), 1.0f);
+	for (TActorIterator<ASurferCharacter> It(World); It; ++It)
+	{
+		const USurferMovementComponent* Movement = It->GetMovementPtr();
+		if (Movement == nullptr)
+		{
+			continue;
+		}
+
+		//Square root so medium speeds already get most of the rate, curves at 800 u/s need it too
+		const float Alpha = FMath::Sqrt(FMath::Clamp(Movement->Velocity.Size() / FastSpeed, 0.0f, 1.0f));
+		const float Rate = FMath::Lerp(IdleRate, FastRate, Alpha);
+		if (NetRateScale < 1.0f && Alpha > 0.0f)
+		{
+			Budget->ReportThrottled(*It);
+		}
+		const float OldRate = It->NetUpdateFrequency;
+		if (!FMath::IsNearlyEqual(OldRate, Rate, 0.5f))
+		{
+			It->NetUpdateFrequency = Rate;
+			It->MinNetUpdateFrequency = IdleRate;
+			//Speeding up from standing should not wait for the old slow update
+			if (Rate > OldRate * 2.0f)
+			{
+				It->ForceNetUpdate();
+			}
+		}
+	}
+}
+
+void USurferNetPolicy::LogReport() const
+{
+	const UWorld* World = GetWorld();
+	const UNetDriver* NetDriver = World ? World->GetNetDriver() : nullptr;
+	if (NetDriver == nullptr)
+	{
+		return;
+	}
+
+	int32 Clients = 0;
+	int64 ClientBytes = 0;
+	for (const UNetConnection* Connection : NetDriver->ClientConnections)
+	{
+		if (Connection)
+		{
+			++Clients;
+			ClientBytes += Connection->OutBytesPerSecond;
+		}
+	}
+
+	int32 Surfers = 0;
+	float RateSum = 0.0f;
+	for (TActorIterator<ASurferCharacter> It(const_cast<UWorld*>(World)); It; ++It)
+	{
+		++Surfers;
+		RateSum += It->NetUpdateFrequency;
+	}
+
+	UE_LOG(LogSurfer, Display, TEXT("NetReport policy %d: %d clients, %.1f KB/s out, %.2f KB/s per client, %d surfers at %.1f updates/s on average"),
+		CVarNetPolicy.GetValueOnGameThread(), Clients, ClientBytes / 1024.0, Clients > 0 ? ClientBytes / 1024.0 / Clients : 0.0,
+		Surfers, Surfers > 0 ? RateSum / Surfers : 0.0f);
+}
@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SurferNetPolicy.generated.h"
+
+class AActor;
+
+/* Replication rates of surfers on the server.
+* A few times a second every surfer gets a NetUpdateFrequency from its speed, fast surfers up to move.NetRateFast,
+* standing ones down to move.NetRateIdle. Distance to each viewer goes into the priority, see GetViewerPriorityScale.
+* Adaptive net update frequency (net.UseAdaptiveNetUpdateFrequency) then drops idle ones further when nothing changes.
+* With move.NetReportInterval the server logs its outgoing bandwidth, for comparing the policy on and off.
+*/
+UCLASS()
+class SPEEDGAM340_API USurferNetPolicy : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	//Priority multiplier of Actor for a viewer at ViewPos
+	static float GetViewerPriorityScale(const AActor* Actor, const FVector& ViewPos);
+
+	//Logs bandwidth per connection and the surfer update rates, move.NetReport
+	void LogReport() const;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+private:
+	float TimeToUpdate = 0.0f;
+	float TimeToReport = 0.0f;
+};
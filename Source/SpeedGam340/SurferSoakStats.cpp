@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferSoakStats.h"
+
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+
+#include "SpeedGam340.h"
+#include "SurferCharacter.h"
+#include "SurferMovementBudget.h"
+
+static TAutoConsoleVariable<float> CVarSoakReportInterval(TEXT("move.SoakReportInterval"), 0.0f, TEXT("Seconds between SoakReport lines of the server in the log, 0 for none\n"), ECVF_Default);
+
+//Numbers since the last report, e.g. "move.SoakReport"
+static void SoakReportForWorld(const TArray<FString>& Args, UWorld* World)
+{
+	if (USurferSoakStats* Stats = World ? World->GetSubsystem<USurferSoakStats>() : nullptr)
+	{
+		Stats->LogReport();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CmdSoakReport(
+	TEXT("move.SoakReport"),
+	TEXT("Log frame time, memory, bandwidth and corrections of the server since the last report\n"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&SoakReportForWorld));
+
+TStatId USurferSoakStats::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USurferSoakStats, STATGROUP_Tickables);
+}
+
+/// <summary>
+/// DeltaTime is the whole server frame including the sleep of the tick rate cap, GGameThreadTime is the work in it.
+/// Capacity runs out when the game thread time reaches the frame time of NetServerMaxTickRate.
+/// </summary>
+/// <param name="DeltaTime"></param>
+void USurferSoakStats::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	const UWorld* World = GetWorld();
+	if (World == nullptr || World->GetNetMode() == NM_Client || World->GetNetMode() == NM_Standalone)
+	{
+		return;
+	}
+
+	const float FrameMs = DeltaTime * 1000.0f;
+	const float GameThreadMs = FPlatformTime::ToMilliseconds(GGameThreadTime);
+	++Frames;
+	FrameTimeSum += FrameMs;
+	FrameTimeMax = FMath::Max(FrameTimeMax, FrameMs);
+	GameThreadMsSum += GameThreadMs;
+	GameThreadMsMax = FMath::Max(GameThreadMsMax, GameThreadMs);
+	if (const USurferMovementBudget* Budget = World->GetSubsystem<USurferMovementBudget>())
+	{
+		GovernorLevelMax = FMath::Max(GovernorLevelMax, Budget->GetThrottleLevel());
+	}
+
+	const float ReportInterval = CVarSoakReportInterval.GetValueOnGameThread();
+	if (ReportInterval > 0.0f && (TimeToReport -= DeltaTime) <= 0.0f)
+	{
+		TimeToReport = ReportInterval;
+		LogReport();
+	}
+}
+
+/// <summary>
+/// Key=value pairs on one line so the soak script can pick them apart with awk.
+/// </summary>
+void USurferSoakStats::LogReport()
+{
+	const UWorld* World = GetWorld();
+	const UNetDriver* NetDriver = World ? World->GetNetDriver() : nullptr;
+
+	int32 Clients = 0;
+	if (NetDriver)
+	{
+		for (const UNetConnection* Connection : NetDriver->ClientConnections)
+		{
+			Clients += Connection != nullptr;
+		}
+	}
+
+	int32 Surfers = 0;
+	for (TActorIterator<ASurferCharacter> It(const_cast<UWorld*>(World)); It; ++It)
+	{
+		++Surfers;
+	}
+
+	const USurferMovementBudget* Budget = World ? World->GetSubsystem<USurferMovementBudget>() : nullptr;
+	const int32 GovernorChanges = Budget ? Budget->GetLevelChanges() : 0;
+	const uint64 FallingIterations = Budget ? Budget->GetTotalFallingIterations() : 0;
+
+	const FPlatformMemoryStats Memory = FPlatformMemory::GetStats();
+	PeakUsedPhysical = FMath::Max<uint64>(PeakUsedPhysical, Memory.UsedPhysical);
+	const int32 SafeFrames = FMath::Max(Frames, 1);
+
+	UE_LOG(LogSurfer, Display, TEXT("SoakReport clients=%d surfers=%d frames=%d frame_avg_ms=%.2f frame_max_ms=%.2f gt_avg_ms=%.2f gt_max_ms=%.2f mem_mb=%.1f mem_peak_mb=%.1f out_kbs=%.1f in_kbs=%.1f corrections=%d corrections_total=%lld governor_max=%d governor_changes=%d falling_iters=%.1f"),
+		Clients, Surfers, Frames, FrameTimeSum / SafeFrames, FrameTimeMax, GameThreadMsSum / SafeFrames, GameThreadMsMax,
+		Memory.UsedPhysical / (1024.0 * 1024.0), PeakUsedPhysical / (1024.0 * 1024.0),
+		NetDriver ? NetDriver->OutBytesPerSecond / 1024.0 : 0.0, NetDriver ? NetDriver->InBytesPerSecond / 1024.0 : 0.0,
+		Corrections, TotalCorrections, GovernorLevelMax, GovernorChanges - GovernorChangesAtReport,
+		double(FallingIterations - FallingIterationsAtReport) / SafeFrames);
+
+	Frames = 0;
+	FrameTimeSum = 0.0;
+	FrameTimeMax = 0.0f;
+	GameThreadMsSum = 0.0;
+	GameThreadMsMax = 0.0f;
+	Corrections = 0;
+	GovernorLevelMax = Budget ? Budget->GetThrottleLevel() : 0;
+	GovernorChangesAtReport = GovernorChanges;
+	FallingIterationsAtReport = FallingIterations;
+}
@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SurferSoakStats.generated.h"
+
+/* Server numbers for capacity planning.
+* Collects frame time, game thread time, memory, bandwidth, the movement corrections sent to clients, the level of
+* the movement governor (USurferMovementBudget) and the falling iterations it counted, and with
+* move.SoakReportInterval logs them as one SoakReport line per interval. Scripts/SoakTest.sh starts several servers
+* with bot clients and puts the lines of all of them into one report.
+*/
+UCLASS()
+class SPEEDGAM340_API USurferSoakStats : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	//Server sent a client a position correction
+	void AddCorrection() {
+		++Corrections;
+		++TotalCorrections;
+	}
+
+	//Logs the numbers since the last report and starts a new interval, move.SoakReport
+	void LogReport();
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+private:
+	float TimeToReport = 0.0f;
+
+	//Since the last report
+	int32 Frames = 0;
+	double FrameTimeSum = 0.0;
+	float FrameTimeMax = 0.0f;
+	double GameThreadMsSum = 0.0;
+	float GameThreadMsMax = 0.0f;
+	int32 Corrections = 0;
+
+	int32 GovernorLevelMax = 0;
+	int32 GovernorChangesAtReport = 0;
+	//PhysFalling iterations per frame, the work the overload soak makes slow
+	uint64 FallingIterationsAtReport = 0;
+
+	int64 TotalCorrections = 0;
+	uint64 PeakUsedPhysical = 0;
+};
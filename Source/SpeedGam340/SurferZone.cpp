@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferZone.h"
+
+#include "Components/BoxComponent.h"
+#include "Engine/World.h"
+
+#include "SurferZoneSubsystem.h"
+
+ASurferZone::ASurferZone()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	//Only there to place and size the zone in the editor
+	Box = CreateDefaultSubobject<UBoxComponent>(TEXT("Box"));
+	Box->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Box->SetGenerateOverlapEvents(false);
+	Box->SetCanEverAffectNavigation(false);
+	Box->SetHiddenInGame(true);
+	Box->InitBoxExtent(FVector(200.0f, 200.0f, 200.0f));
+	RootComponent = Box;
+
+	ZoneType = ESurferZoneType::Checkpoint;
+	CheckpointIndex = 0;
+	ZoneHandle = INDEX_NONE;
+}
+
+void ASurferZone::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (USurferZoneSubsystem* Zones = GetWorld()->GetSubsystem<USurferZoneSubsystem>())
+	{
+		ZoneHandle = Zones->RegisterZone(this);
+	}
+}
+
+void ASurferZone::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (ZoneHandle != INDEX_NONE)
+	{
+		if (USurferZoneSubsystem* Zones = GetWorld()->GetSubsystem<USurferZoneSubsystem>())
+		{
+			Zones->UnregisterZone(ZoneHandle);
+		}
+		ZoneHandle = INDEX_NONE;
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ASurferZone::GetZoneBox(FTransform& OutTransform, FVector& OutExtent) const
+{
+	const FTransform& BoxTransform = Box->GetComponentTransform();
+	OutTransform = FTransform(BoxTransform.GetRotation(), BoxTransform.GetLocation());
+	OutExtent = Box->GetScaledBoxExtent();
+}
@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "SurferZone.generated.h"
+
+class UBoxComponent;
+
+UENUM(BlueprintType)
+enum class ESurferZoneType : uint8
+{
+	Start,
+	Checkpoint,
+	End
+};
+
+/* Start, end or checkpoint of a timed run.
+* The box has no collision, the zone is put into the spatial hash of USurferZoneSubsystem
+* and every sweep of the surfer movement tests its capsule against it, so fast surfers can't skip thin zones.
+* Zones are static, moving one after BeginPlay does nothing.
+*/
+UCLASS()
+class SPEEDGAM340_API ASurferZone : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	ASurferZone();
+
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	ESurferZoneType GetZoneType() const { return ZoneType; }
+	int32 GetCheckpointIndex() const { return CheckpointIndex; }
+
+	//World space box, scale is baked into the extent
+	void GetZoneBox(FTransform& OutTransform, FVector& OutExtent) const;
+
+protected:
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Zone")
+		UBoxComponent* Box;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Zone")
+		ESurferZoneType ZoneType;
+
+	//Checkpoints have to be passed in order, 0 first
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Zone", meta = (EditCondition = "ZoneType == ESurferZoneType::Checkpoint", ClampMin = "0"))
+		int32 CheckpointIndex;
+
+private:
+	//Slot in the zone subsystem, INDEX_NONE while not registered
+	int32 ZoneHandle;
+};
+
+/* Where a surfer is in the run, kept by the character and advanced by the zone subsystem on the server.
+* The owning client gets it replicated.
+*/
+USTRUCT()
+struct FSurferRunState
+{
+	GENERATED_BODY()
+
+	//Running since leaving the start zone
+	UPROPERTY()
+		bool bRunning = false;
+	//Server run clock of the surfer when the start zone was left, see USurferMovementComponent::GetRunClock
+	UPROPERTY()
+		double StartTime = 0.0;
+	//Checkpoint that has to come next
+	UPROPERTY()
+		int32 NextCheckpoint = 0;
+	//Run time at every checkpoint
+	UPROPERTY()
+		TArray<double> Splits;
+	//The move validator flagged a move during the run, it doesn't go on the leaderboard
+	UPROPERTY()
+		bool bInvalidated = false;
+};
@@ -0,0 +1,427 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurferZoneSubsystem.h"
+
+#include "Algo/Sort.h"
+#include "Components/CapsuleComponent.h"
+#include "HAL/IConsoleManager.h"
+
+#include "SpeedGam340.h"
+#include "SurferCharacter.h"
+
+static TAutoConsoleVariable<float> CVarZoneCellSize(TEXT("move.ZoneCellSize"), 1024.0f, TEXT("Cell size of the run zone spatial hash, used from the next map load\n"), ECVF_Default);
+
+DECLARE_CYCLE_STAT(TEXT("Surfer zone checks"), STAT_SurferZoneChecks, STATGROUP_Character);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Surfer zones tested"), STAT_SurferZonesTested, STATGROUP_Character);
+
+//e.g. "move.BenchZones 64 500 256", players, zones and frames are optional
+static void BenchZones(const TArray<FString>& Args)
+{
+	const int32 Players = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 64;
+	const int32 Zones = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 500;
+	const int32 Frames = Args.Num() > 2 ? FMath::Max(1, FCString::Atoi(*Args[2])) : 256;
+	USurferZoneSubsystem::Benchmark(Players, Zones, Frames);
+}
+
+static FAutoConsoleCommand CmdBenchZones(
+	TEXT("move.BenchZones"),
+	TEXT("Time run zone checks per frame with the spatial hash against testing every zone, optional players, zones and frames\n"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchZones));
+
+FSurferZoneGrid::FSurferZoneGrid(float InCellSize)
+	: CellSize(FMath::Max(InCellSize, 1.0f))
+	, NumCheckpoints(0)
+	, QueryStamp(0)
+{
+}
+
+FIntVector FSurferZoneGrid::GetCell(const FVector& Location) const
+{
+	return FIntVector(
+		FMath::FloorToInt(Location.X / CellSize),
+		FMath::FloorToInt(Location.Y / CellSize),
+		FMath::FloorToInt(Location.Z / CellSize));
+}
+
+int32 FSurferZoneGrid::Add(const FTransform& Transform, const FVector& Extent, ESurferZoneType Type, int32 CheckpointIndex)
+{
+	const int32 Zone = FreeShapes.Num() > 0 ? FreeShapes.Pop(false) : Shapes.AddDefaulted();
+	QueryStamps.SetNumZeroed(Shapes.Num());
+
+	FSurferZoneShape& Shape = Shapes[Zone];
+	Shape.Transform = Transform;
+	Shape.Extent = Extent;
+	Shape.Bounds = FBox(-Extent, Extent).TransformBy(Transform);
+	Shape.Type = Type;
+	Shape.CheckpointIndex = CheckpointIndex;
+	Shape.bValid = true;
+	QueryStamps[Zone] = 0;
+
+	const FIntVector MinCell = GetCell(Shape.Bounds.Min);
+	const FIntVector MaxCell = GetCell(Shape.Bounds.Max);
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+			{
+				Cells.FindOrAdd(FIntVector(X, Y, Z)).Add(Zone);
+			}
+		}
+	}
+
+	if (Type == ESurferZoneType::Checkpoint)
+	{
+		NumCheckpoints = FMath::Max(NumCheckpoints, CheckpointIndex + 1);
+	}
+	return Zone;
+}
+
+void FSurferZoneGrid::Remove(int32 Zone)
+{
+	if (!Shapes.IsValidIndex(Zone) || !Shapes[Zone].bValid)
+	{
+		return;
+	}
+
+	FSurferZoneShape& Shape = Shapes[Zone];
+	const FIntVector MinCell = GetCell(Shape.Bounds.Min);
+	const FIntVector MaxCell = GetCell(Shape.Bounds.Max);
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+			{
+				const FIntVector Cell(X, Y, Z);
+				if (TArray<int32>* CellZones = Cells.Find(Cell))
+				{
+					CellZones->RemoveSwap(Zone);
+					if (CellZones->Num() == 0)
+					{
+						Cells.Remove(Cell);
+					}
+				}
+			}
+		}
+	}
+	Shape.bValid = false;
+	FreeShapes.Add(Zone);
+
+	//Zones only go away on level unload, a scan is fine
+	NumCheckpoints = 0;
+	for (const FSurferZoneShape& Other : Shapes)
+	{
+		if (Other.bValid && Other.Type == ESurferZoneType::Checkpoint)
+		{
+			NumCheckpoints = FMath::Max(NumCheckpoints, Other.CheckpointIndex + 1);
+		}
+	}
+}
+
+/// <summary>
+/// Slab test in the space of the box. Enter and exit are fractions of the segment,
+/// outside of 0..1 when the segment starts or ends inside.
+/// </summary>
+bool FSurferZoneGrid::IntersectSegment(const FSurferZoneShape& Shape, const FVector& Start, const FVector& End, const FVector& CapsuleExtent, float& OutEnter, float& OutExit)
+{
+	const FVector LocalStart = Shape.Transform.InverseTransformPositionNoScale(Start);
+	const FVector LocalEnd = Shape.Transform.InverseTransformPositionNoScale(End);
+	const FVector Direction = LocalEnd - LocalStart;
+	const FVector Extent = Shape.Extent + CapsuleExtent;
+
+	float Enter = -BIG_NUMBER;
+	float Exit = BIG_NUMBER;
+	for (int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		if (FMath::Abs(Direction[Axis]) < KINDA_SMALL_NUMBER)
+		{
+			//Parallel to the slab, either always in it or never
+			if (FMath::Abs(LocalStart[Axis]) > Extent[Axis])
+			{
+				return false;
+			}
+			continue;
+		}
+
+		const float InvDirection = 1.0f / Direction[Axis];
+		float Near = (-Extent[Axis] - LocalStart[Axis]) * InvDirection;
+		float Far = (Extent[Axis] - LocalStart[Axis]) * InvDirection;
+		if (Near > Far)
+		{
+			Swap(Near, Far);
+		}
+		Enter = FMath::Max(Enter, Near);
+		Exit = FMath::Min(Exit, Far);
+		if (Enter > Exit)
+		{
+			return false;
+		}
+	}
+
+	OutEnter = Enter;
+	OutExit = Exit;
+	return Exit >= 0.0f && Enter <= 1.0f;
+}
+
+void FSurferZoneGrid::TestShape(int32 Zone, const FVector& Start, const FVector& End, const FVector& CapsuleExtent, TArray<FSurferZoneCrossing>& OutCrossings) const
+{
+	float Enter, Exit;
+	if (!IntersectSegment(Shapes[Zone], Start, End, CapsuleExtent, Enter, Exit))
+	{
+		return;
+	}
+
+	//Touching the boundary at the end of a step counts as in, the next step then starts inside
+	if (Enter > 0.0f && Enter <= 1.0f)
+	{
+		OutCrossings.Add({ Zone, Enter, true });
+	}
+	if (Exit >= 0.0f && Exit < 1.0f)
+	{
+		OutCrossings.Add({ Zone, Exit, false });
+	}
+}
+
+int32 FSurferZoneGrid::QuerySegment(const FVector& Start, const FVector& End, const FVector& CapsuleExtent, TArray<FSurferZoneCrossing>& OutCrossings) const
+{
+	const FIntVector MinCell = GetCell(Start.ComponentMin(End) - CapsuleExtent);
+	const FIntVector MaxCell = GetCell(Start.ComponentMax(End) + CapsuleExtent);
+	const int64 NumCells = int64(MaxCell.X - MinCell.X + 1) * (MaxCell.Y - MinCell.Y + 1) * (MaxCell.Z - MinCell.Z + 1);
+	if (NumCells > Shapes.Num())
+	{
+		//Very long segment, walking the cells costs more than the zones
+		return QuerySegmentBruteForce(Start, End, CapsuleExtent, OutCrossings);
+	}
+
+	if (++QueryStamp == 0)
+	{
+		FMemory::Memzero(QueryStamps.GetData(), QueryStamps.Num() * sizeof(uint32));
+		QueryStamp = 1;
+	}
+
+	const int32 FirstCrossing = OutCrossings.Num();
+	int32 Tested = 0;
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+			{
+				const TArray<int32>* CellZones = Cells.Find(FIntVector(X, Y, Z));
+				if (CellZones == nullptr)
+				{
+					continue;
+				}
+				for (const int32 Zone : *CellZones)
+				{
+					if (QueryStamps[Zone] != QueryStamp)
+					{
+						QueryStamps[Zone] = QueryStamp;
+						TestShape(Zone, Start, End, CapsuleExtent, OutCrossings);
+						++Tested;
+					}
+				}
+			}
+		}
+	}
+
+	if (OutCrossings.Num() - FirstCrossing > 1)
+	{
+		Algo::Sort(MakeArrayView(OutCrossings.GetData() + FirstCrossing, OutCrossings.Num() - FirstCrossing),
+			[](const FSurferZoneCrossing& A, const FSurferZoneCrossing& B) { return A.Fraction < B.Fraction; });
+	}
+	return Tested;
+}
+
+int32 FSurferZoneGrid::QuerySegmentBruteForce(const FVector& Start, const FVector& End, const FVector& CapsuleExtent, TArray<FSurferZoneCrossing>& OutCrossings) const
+{
+	const int32 FirstCrossing = OutCrossings.Num();
+	int32 Tested = 0;
+	for (int32 Zone = 0; Zone < Shapes.Num(); ++Zone)
+	{
+		if (Shapes[Zone].bValid)
+		{
+			TestShape(Zone, Start, End, CapsuleExtent, OutCrossings);
+			++Tested;
+		}
+	}
+
+	if (OutCrossings.Num() - FirstCrossing > 1)
+	{
+		Algo::Sort(MakeArrayView(OutCrossings.GetData() + FirstCrossing, OutCrossings.Num() - FirstCrossing),
+			[](const FSurferZoneCrossing& A, const FSurferZoneCrossing& B) { return A.Fraction < B.Fraction; });
+	}
+	return Tested;
+}
+
+USurferZoneSubsystem::USurferZoneSubsystem()
+	: Grid(CVarZoneCellSize.GetValueOnAnyThread())
+{
+}
+
+int32 USurferZoneSubsystem::RegisterZone(const ASurferZone* Zone)
+{
+	FTransform Transform;
+	FVector Extent;
+	Zone->GetZoneBox(Transform, Extent);
+	return Grid.Add(Transform, Extent, Zone->GetZoneType(), Zone->GetCheckpointIndex());
+}
+
+void USurferZoneSubsystem::UnregisterZone(int32 ZoneHandle)
+{
+	Grid.Remove(ZoneHandle);
+}
+
+void USurferZoneSubsystem::TestStep(ASurferCharacter* Surfer, TArrayView<const FSurferZoneSegment> Segments, double StepStartTime, float StepTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SurferZoneChecks);
+
+	const UCapsuleComponent* Capsule = Surfer->GetCapsuleComponent();
+	const float Radius = Capsule->GetScaledCapsuleRadius();
+	const FVector CapsuleExtent(Radius, Radius, Capsule->GetScaledCapsuleHalfHeight());
+
+	float TotalLength = 0.0f;
+	for (const FSurferZoneSegment& Segment : Segments)
+	{
+		TotalLength += Segment.Length;
+	}
+	//Nothing but step ups, everything happened at the end of the step
+	const double TimePerLength = TotalLength > KINDA_SMALL_NUMBER ? StepTime / TotalLength : 0.0;
+	const double EmptyStepTime = TotalLength > KINDA_SMALL_NUMBER ? 0.0 : StepTime;
+
+	float Travelled = 0.0f;
+	for (const FSurferZoneSegment& Segment : Segments)
+	{
+		Crossings.Reset();
+		const int32 Tested = Grid.QuerySegment(Segment.Start, Segment.End, CapsuleExtent, Crossings);
+		INC_DWORD_STAT_BY(STAT_SurferZonesTested, Tested);
+
+		for (const FSurferZoneCrossing& Crossing : Crossings)
+		{
+			const double Time = StepStartTime + EmptyStepTime + (Travelled + Crossing.Fraction * Segment.Length) * TimePerLength;
+			HandleCrossing(Surfer, Grid.GetShape(Crossing.Zone), Crossing.bEnter, Time);
+		}
+		Travelled += Segment.Length;
+	}
+}
+
+/// <summary>
+/// Leaving the start zone starts the run, going back in cancels it.
+/// Checkpoints count in order, the end zone only finishes the run once all of them were passed.
+/// </summary>
+void USurferZoneSubsystem::HandleCrossing(ASurferCharacter* Surfer, const FSurferZoneShape& Zone, bool bEnter, double Time)
+{
+	FSurferRunState& Run = Surfer->GetRunState();
+	switch (Zone.Type)
+	{
+	case ESurferZoneType::Start:
+		if (bEnter)
+		{
+			Run.bRunning = false;
+		}
+		else
+		{
+			Run.bRunning = true;
+			Run.StartTime = Time;
+			Run.NextCheckpoint = 0;
+			Run.Splits.Reset();
+			Run.bInvalidated = false;
+		}
+		break;
+	case ESurferZoneType::Checkpoint:
+		if (bEnter && Run.bRunning && Zone.CheckpointIndex == Run.NextCheckpoint)
+		{
+			Run.Splits.Add(Time - Run.StartTime);
+			++Run.NextCheckpoint;
+		}
+		break;
+	case ESurferZoneType::End:
+		if (bEnter && Run.bRunning && Run.NextCheckpoint >= Grid.GetNumCheckpoints())
+		{
+			Run.bRunning = false;
+			Surfer->RunFinished(Time - Run.StartTime);
+		}
+		break;
+	}
+}
+
+/// <summary>
+/// Random zones, some of them thin walls, and players going 5000 u/s at 64 tick.
+/// The same paths go through the hash and through every zone, the crossings have to match.
+/// </summary>
+void USurferZoneSubsystem::Benchmark(int32 Players, int32 Zones, int32 Frames)
+{
+	constexpr float WorldExtent = 32768.0f;
+	constexpr float Speed = 5000.0f;
+	constexpr float StepTime = 1.0f / 64.0f;
+	const FVector CapsuleExtent(34.0f, 34.0f, 88.0f);
+
+	FRandomStream Stream(340);
+	FSurferZoneGrid BenchGrid(CVarZoneCellSize.GetValueOnGameThread());
+	for (int32 Index = 0; Index < Zones; ++Index)
+	{
+		const bool bThin = Stream.RandHelper(4) == 0;
+		const FVector Extent(
+			bThin ? 4.0f : Stream.FRandRange(50.0f, 1500.0f),
+			Stream.FRandRange(50.0f, 1500.0f),
+			Stream.FRandRange(50.0f, 600.0f));
+		const FVector Location(Stream.FRandRange(-WorldExtent, WorldExtent), Stream.FRandRange(-WorldExtent, WorldExtent), Stream.FRandRange(-WorldExtent, WorldExtent) * 0.25f);
+		const FTransform Transform(FRotator(0.0f, Stream.FRandRange(0.0f, 360.0f), 0.0f), Location);
+		BenchGrid.Add(Transform, Extent, ESurferZoneType::Checkpoint, Index);
+	}
+
+	//Paths first so both queries get the same ones
+	TArray<FVector> Path;
+	Path.SetNumUninitialized((Frames + 1) * Players);
+	for (int32 Player = 0; Player < Players; ++Player)
+	{
+		FVector Location(Stream.FRandRange(-WorldExtent, WorldExtent), Stream.FRandRange(-WorldExtent, WorldExtent), 0.0f);
+		FVector Velocity = Stream.GetUnitVector() * Speed;
+		for (int32 Frame = 0; Frame <= Frames; ++Frame)
+		{
+			Path[Frame * Players + Player] = Location;
+			Location += Velocity * StepTime;
+			//Curving a bit like a strafe, turning back at the edge of the map
+			Velocity = Velocity.RotateAngleAxis(Stream.FRandRange(-3.0f, 3.0f), FVector::UpVector);
+			if (FMath::Abs(Location.X) > WorldExtent || FMath::Abs(Location.Y) > WorldExtent)
+			{
+				Velocity = -Velocity;
+			}
+		}
+	}
+
+	TArray<FSurferZoneCrossing> Crossings;
+	auto Run = [&](bool bBruteForce, int64& OutTested, int32& OutCrossings)
+	{
+		OutTested = 0;
+		OutCrossings = 0;
+		const double StartTime = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < Frames; ++Frame)
+		{
+			for (int32 Player = 0; Player < Players; ++Player)
+			{
+				const FVector& Start = Path[Frame * Players + Player];
+				const FVector& End = Path[(Frame + 1) * Players + Player];
+				Crossings.Reset();
+				OutTested += bBruteForce
+					? BenchGrid.QuerySegmentBruteForce(Start, End, CapsuleExtent, Crossings)
+					: BenchGrid.QuerySegment(Start, End, CapsuleExtent, Crossings);
+				OutCrossings += Crossings.Num();
+			}
+		}
+		return (FPlatformTime::Seconds() - StartTime) * 1e6 / Frames;
+	};
+
+	int64 HashTested, BruteTested;
+	int32 HashCrossings, BruteCrossings;
+	const double HashMicros = Run(false, HashTested, HashCrossings);
+	const double BruteMicros = Run(true, BruteTested, BruteCrossings);
+
+	UE_LOG(LogSurfer, Display, TEXT("move.BenchZones %d players, %d zones, %d frames: hash %.2f us/frame (%.1f zones tested per move), every zone %.2f us/frame (%.1f per move), crossings %d/%d%s"),
+		Players, Zones, Frames,
+		HashMicros, double(HashTested) / (Frames * Players),
+		BruteMicros, double(BruteTested) / (Frames * Players),
+		HashCrossings, BruteCrossings, HashCrossings == BruteCrossings ? TEXT("") : TEXT(" MISMATCH"));
+}
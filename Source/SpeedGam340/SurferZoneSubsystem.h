@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+
+#include "SurferZone.h"
+
+#include "SurferZoneSubsystem.generated.h"
+
+class ASurferCharacter;
+
+//Zone box as the hash stores it
+struct FSurferZoneShape
+{
+	FTransform Transform;
+	FVector Extent;
+	//World bounds, the cells it was put in
+	FBox Bounds;
+	ESurferZoneType Type;
+	int32 CheckpointIndex;
+	bool bValid;
+};
+
+//One swept move of the capsule during a movement step
+struct FSurferZoneSegment
+{
+	FVector Start;
+	FVector End;
+	//Share of the step it took, usually its length
+	float Length;
+};
+
+//Swept capsule went into or out of a zone during one movement step
+struct FSurferZoneCrossing
+{
+	int32 Zone;
+	//0 is the start of the segment, 1 the end
+	float Fraction;
+	bool bEnter;
+};
+
+/* Uniform grid spatial hash of zone boxes.
+* A zone is put into every cell its bounds touch, a query only looks at the cells the swept capsule touches.
+* Plain struct so the benchmark can build one without a world.
+*/
+struct FSurferZoneGrid
+{
+	explicit FSurferZoneGrid(float InCellSize = 1024.0f);
+
+	int32 Add(const FTransform& Transform, const FVector& Extent, ESurferZoneType Type, int32 CheckpointIndex);
+	void Remove(int32 Zone);
+
+	//Adds the crossings of the segment inflated by CapsuleExtent, sorted by fraction. Returns the number of zones tested
+	int32 QuerySegment(const FVector& Start, const FVector& End, const FVector& CapsuleExtent, TArray<FSurferZoneCrossing>& OutCrossings) const;
+
+	//Same without the hash, for the benchmark
+	int32 QuerySegmentBruteForce(const FVector& Start, const FVector& End, const FVector& CapsuleExtent, TArray<FSurferZoneCrossing>& OutCrossings) const;
+
+	//Segment against a box inflated by CapsuleExtent in the box space.
+	//Exact for boxes that are only yawed, apart from the rounded ends and edges of the capsule
+	static bool IntersectSegment(const FSurferZoneShape& Shape, const FVector& Start, const FVector& End, const FVector& CapsuleExtent, float& OutEnter, float& OutExit);
+
+	const FSurferZoneShape& GetShape(int32 Zone) const { return Shapes[Zone]; }
+	int32 Num() const { return Shapes.Num() - FreeShapes.Num(); }
+	int32 GetNumCheckpoints() const { return NumCheckpoints; }
+
+private:
+	FIntVector GetCell(const FVector& Location) const;
+	void TestShape(int32 Zone, const FVector& Start, const FVector& End, const FVector& CapsuleExtent, TArray<FSurferZoneCrossing>& OutCrossings) const;
+
+	float CellSize;
+	TArray<FSurferZoneShape> Shapes;
+	TArray<int32> FreeShapes;
+	TMap<FIntVector, TArray<int32>> Cells;
+	int32 NumCheckpoints;
+
+	//A zone in several cells is only tested once per query
+	mutable TArray<uint32> QueryStamps;
+	mutable uint32 QueryStamp;
+};
+
+/* Run timing for the world.
+* Server side surfer movement hands the swept moves of its capsule in one step to TestStep together with the step's time,
+* the crossings are turned into run start, checkpoint splits and the finish at the exact time the capsule touched the zone.
+* That time doesn't depend on the tick rate, only on the speed inside the step being constant.
+*/
+UCLASS()
+class SPEEDGAM340_API USurferZoneSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	USurferZoneSubsystem();
+
+	int32 RegisterZone(const ASurferZone* Zone);
+	void UnregisterZone(int32 ZoneHandle);
+
+	bool HasZones() const { return Grid.Num() > 0; }
+
+	//Capsule went through Segments in one step that started at StepStartTime on the run clock and took StepTime.
+	//A crossing gets the time of its distance along all the segments
+	void TestStep(ASurferCharacter* Surfer, TArrayView<const FSurferZoneSegment> Segments, double StepStartTime, float StepTime);
+
+	//Checks the hash against brute force and times zone checks per frame, move.BenchZones
+	static void Benchmark(int32 Players, int32 Zones, int32 Frames);
+
+private:
+	void HandleCrossing(ASurferCharacter* Surfer, const FSurferZoneShape& Zone, bool bEnter, double Time);
+
+	FSurferZoneGrid Grid;
+
+	//Kept to avoid reallocating every step
+	TArray<FSurferZoneCrossing> Crossings;
+};
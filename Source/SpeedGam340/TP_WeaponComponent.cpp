@@ -4,15 +4,32 @@
 #include "TP_WeaponComponent.h"
 #include "SpeedGam340Character.h"
 #include "SpeedGam340Projectile.h"
+#include "SpeedGam340ProjectilePool.h"
+#include "SpeedGam340ProjectileManager.h"
+#include "SpeedGam340LagCompensation.h"
+#include "GameFramework/GameStateBase.h"
 #include "GameFramework/PlayerController.h"
 #include "Camera/PlayerCameraManager.h"
 #include "Kismet/GameplayStatics.h"
 
+DECLARE_CYCLE_STAT(TEXT("Spawned projectile"), STAT_ProjectileSpawn, STATGROUP_SpeedGam340Projectiles);
+
 // Sets default values for this component's properties
 UTP_WeaponComponent::UTP_WeaponComponent()
 {
 	// Default offset from the character location for projectiles to spawn
 	MuzzleOffset = FVector(100.0f, 0.0f, 10.0f);
+
+	// 20 shots a second with the 3 second projectile lifetime
+	ProjectilePoolSize = 64;
+
+	FireMode = EWeaponFireMode::Projectile;
+	HitscanRange = 50000.0f;
+	HitscanDamage = 20.0f;
+	MaxFireOriginError = 200.0f;
+
+	// Managed projectiles reach the other clients through this component
+	SetIsReplicatedByDefault(true);
 }
 
 
@@ -23,26 +40,32 @@ void UTP_WeaponComponent::Fire()
 		return;
 	}
 
-	// Try and fire a projectile
-	if (ProjectileClass != nullptr)
+	APlayerController* PlayerController = Cast<APlayerController>(Character->GetController());
+	if (PlayerController == nullptr || PlayerController->PlayerCameraManager == nullptr)
 	{
-		UWorld* const World = GetWorld();
-		if (World != nullptr)
+		return;
+	}
+
+	// Shots leave from the camera, not the muzzle, so they go where the crosshair is
+	const FVector Origin = PlayerController->PlayerCameraManager->GetCameraLocation();
+	const FVector Dir = PlayerController->PlayerCameraManager->GetCameraRotation().Vector();
+	const AGameStateBase* GameState = GetWorld()->GetGameState();
+	const double ClientTime = GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+
+	if (GetOwner()->HasAuthority())
+	{
+		ServerFire_Implementation(Origin, Dir, ClientTime);
+	}
+	else
+	{
+		// Only a visual projectile is predicted here, the server does the real shot
+		if (FireMode == EWeaponFireMode::Projectile)
 		{
-			APlayerController* PlayerController = Cast<APlayerController>(Character->GetController());
-			const FRotator SpawnRotation = PlayerController->PlayerCameraManager->GetCameraRotation();
-			// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
-			const FVector SpawnLocation = GetOwner()->GetActorLocation() + SpawnRotation.RotateVector(MuzzleOffset);
-	
-			//Set Spawn Collision Handling Override
-			FActorSpawnParameters ActorSpawnParams;
-			ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
-	
-			// Spawn the projectile at the muzzle
-			World->SpawnActor<ASpeedGam340Projectile>(ProjectileClass, SpawnLocation, SpawnRotation, ActorSpawnParams);
+			FireProjectile(Dir.Rotation(), false);
 		}
+		ServerFire(Origin, Dir, ClientTime);
 	}
-	
+
 	// Try and play the sound if specified
 	if (FireSound != nullptr)
 	{
@@ -61,6 +84,99 @@ void UTP_WeaponComponent::Fire()
 	}
 }
 
+void UTP_WeaponComponent::ServerFire_Implementation(FVector_NetQuantize Origin, FVector_NetQuantizeNormal Dir, double ClientTime)
+{
+	if (Character == nullptr || Character->GetController() == nullptr)
+	{
+		return;
+	}
+
+	// A shot from somewhere the shooter can't be is dropped, the camera is never far from the pawn's eyes
+	if (FVector::DistSquared(Origin, Character->GetPawnViewLocation()) > FMath::Square(MaxFireOriginError))
+	{
+		return;
+	}
+
+	if (FireMode == EWeaponFireMode::Hitscan)
+	{
+		// Rewound to what the shooter saw and traced together with every other shot of this frame, damage is only ever applied here
+		UWorld* const World = GetWorld();
+		USpeedGam340LagCompensation* LagCompensation = World ? World->GetSubsystem<USpeedGam340LagCompensation>() : nullptr;
+		if (LagCompensation != nullptr)
+		{
+			const double ShotTime = LagCompensation->GetShotTime(Character->GetController(), ClientTime);
+			LagCompensation->QueueHitscan(Character, Character->GetController(), Origin, Origin + Dir * HitscanRange, HitscanDamage, ShotTime);
+		}
+	}
+	else
+	{
+		FireProjectile(Dir.Rotation(), true);
+	}
+}
+
+void UTP_WeaponComponent::FireProjectile(const FRotator& SpawnRotation, bool bAuthority)
+{
+	UWorld* const World = GetWorld();
+	if (World == nullptr || ProjectileClass == nullptr)
+	{
+		return;
+	}
+
+	// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
+	const FVector SpawnLocation = GetOwner()->GetActorLocation() + SpawnRotation.RotateVector(MuzzleOffset);
+
+	USpeedGam340ProjectileManager* Manager = World->GetSubsystem<USpeedGam340ProjectileManager>();
+	USpeedGam340ProjectilePool* Pool = World->GetSubsystem<USpeedGam340ProjectilePool>();
+	if (Manager != nullptr && USpeedGam340ProjectileManager::IsEnabled())
+	{
+		// Simulated as data by the manager, no actor at all. The server's copy is the real one,
+		// the shooter predicts a visual one and everyone else gets theirs from the multicast
+		Manager->Fire(ProjectileClass, SpawnLocation, SpawnRotation, Character, !bAuthority);
+		if (bAuthority)
+		{
+			MulticastFireProjectile(SpawnLocation, SpawnRotation.Vector());
+		}
+	}
+	else if (Pool != nullptr && USpeedGam340ProjectilePool::IsPoolingEnabled())
+	{
+		// Reuse a parked projectile from the pool
+		if (ASpeedGam340Projectile* Projectile = Pool->Acquire(ProjectileClass, SpawnLocation, SpawnRotation))
+		{
+			Projectile->SetCosmetic(!bAuthority);
+		}
+	}
+	else
+	{
+		SCOPE_CYCLE_COUNTER(STAT_ProjectileSpawn);
+
+		//Set Spawn Collision Handling Override
+		FActorSpawnParameters ActorSpawnParams;
+		ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+
+		// Spawn the projectile at the muzzle
+		ASpeedGam340Projectile* Projectile = World->SpawnActor<ASpeedGam340Projectile>(ProjectileClass, SpawnLocation, SpawnRotation, ActorSpawnParams);
+		if (Projectile != nullptr && !bAuthority)
+		{
+			Projectile->SetCosmetic(true);
+		}
+	}
+}
+
+void UTP_WeaponComponent::MulticastFireProjectile_Implementation(FVector_NetQuantize Location, FVector_NetQuantizeNormal Direction)
+{
+	// The server has the real one and the shooter already predicted it
+	UWorld* const World = GetWorld();
+	if (World == nullptr || GetOwner()->HasAuthority() || ProjectileClass == nullptr || (Character != nullptr && Character->IsLocallyControlled()))
+	{
+		return;
+	}
+
+	if (USpeedGam340ProjectileManager* Manager = World->GetSubsystem<USpeedGam340ProjectileManager>())
+	{
+		Manager->Fire(ProjectileClass, Location, Direction.Rotation(), Character, true);
+	}
+}
+
 void UTP_WeaponComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	if(Character != nullptr)
@@ -81,6 +197,20 @@ void UTP_WeaponComponent::AttachWeapon(ASpeedGam340Character* TargetCharacter)
 
 		// Register so that Fire is called every time the character tries to use the item being held
 		Character->OnUseItem.AddDynamic(this, &UTP_WeaponComponent::Fire);
+
+		// The weapon actor has to replicate and belong to the shooter for its RPCs to go anywhere
+		if (GetOwner()->HasAuthority())
+		{
+			GetOwner()->SetReplicates(true);
+			GetOwner()->SetOwner(Character);
+		}
+
+		// Fill the projectile pool now so the first shots don't pay for spawning
+		USpeedGam340ProjectilePool* Pool = GetWorld() ? GetWorld()->GetSubsystem<USpeedGam340ProjectilePool>() : nullptr;
+		if (Pool != nullptr && USpeedGam340ProjectilePool::IsPoolingEnabled())
+		{
+			Pool->Prewarm(ProjectileClass, ProjectilePoolSize);
+		}
 	}
 }
 
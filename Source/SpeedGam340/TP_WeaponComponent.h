@@ -4,10 +4,21 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "Engine/NetSerialization.h"
 #include "TP_WeaponComponent.generated.h"
 
 class ASpeedGam340Character;
 
+/** How the weapon delivers its shots */
+UENUM(BlueprintType)
+enum class EWeaponFireMode : uint8
+{
+	/** Spawns a projectile from the muzzle */
+	Projectile,
+	/** Instant trace from the camera, lag compensated on the server */
+	Hitscan,
+};
+
 UCLASS(Blueprintable, BlueprintType, ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class SPEEDGAM340_API UTP_WeaponComponent : public UActorComponent
 {
@@ -18,6 +29,22 @@ public:
 	UPROPERTY(EditDefaultsOnly, Category=Projectile)
 	TSubclassOf<class ASpeedGam340Projectile> ProjectileClass;
 
+	/** Projectile or hitscan */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
+	EWeaponFireMode FireMode;
+
+	/** Max distance of a hitscan shot */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Hitscan, meta=(ClampMin="0"))
+	float HitscanRange;
+
+	/** Damage applied to a character hit by a hitscan shot */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Hitscan, meta=(ClampMin="0"))
+	float HitscanDamage;
+
+	/** How far from the shooter's eyes the server still accepts the origin of a shot */
+	UPROPERTY(EditDefaultsOnly, Category=Gameplay, meta=(ClampMin="0"))
+	float MaxFireOriginError;
+
 	/** Sound to play each time we fire */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
 	USoundBase* FireSound;
@@ -26,6 +53,10 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Gameplay)
 	UAnimMontage* FireAnimation;
 
+	/** How many projectiles to keep ready in the pool, about fire rate times projectile lifetime */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile, meta=(ClampMin="0"))
+	int32 ProjectilePoolSize;
+
 	/** Gun muzzle's offset from the characters location */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
 	FVector MuzzleOffset;
@@ -37,10 +68,18 @@ public:
 	UFUNCTION(BlueprintCallable, Category="Weapon")
 	void AttachWeapon(ASpeedGam340Character* TargetCharacter);
 
-	/** Make the weapon Fire a Projectile */
+	/** Make the weapon Fire a Projectile or a hitscan shot */
 	UFUNCTION(BlueprintCallable, Category="Weapon")
 	void Fire();
 
+	/** Shot of the owning client, traced or spawned for real on the server. ClientTime is the server clock as the client saw it */
+	UFUNCTION(Server, Reliable)
+	void ServerFire(FVector_NetQuantize Origin, FVector_NetQuantizeNormal Dir, double ClientTime);
+
+	/** Server fired a managed projectile, everyone else draws a visual only copy of it */
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastFireProjectile(FVector_NetQuantize Location, FVector_NetQuantizeNormal Direction);
+
 protected:
 	/** Ends gameplay for this component. */
 	UFUNCTION()
@@ -48,6 +87,9 @@ protected:
 		
 
 private:
+	/** Manager, pool or spawned actor. Only the server's projectile is real, a client one is just for the shooter to see */
+	void FireProjectile(const FRotator& SpawnRotation, bool bAuthority);
+
 	/** The Character holding this weapon*/
 	ASpeedGam340Character* Character;
 };